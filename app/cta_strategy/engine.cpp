@@ -96,7 +96,7 @@ namespace Keen
 
 		void CtaEngine::process_tick_event(const Event &event)
 		{
-			const TickData &tick = std::any_cast<const TickData &>(event.data);
+			const TickData &tick = event.get<TickData>();
 
 			std::list<CtaTemplate *> strategies = this->symbol_strategy_map[tick.kt_symbol];
 			if (!strategies.size())
@@ -113,7 +113,7 @@ namespace Keen
 
 		void CtaEngine::process_order_event(const Event &event)
 		{
-			const OrderData &order = std::any_cast<const OrderData &>(event.data);
+			const OrderData &order = event.get<OrderData>();
 
 			CtaTemplate *strategy = GetWithNull(this->orderid_strategy_map, order.kt_orderid);
 			if (not strategy)
@@ -148,7 +148,7 @@ namespace Keen
 
 		void CtaEngine::process_trade_event(const Event &event)
 		{
-			const TradeData &trade = std::any_cast<const TradeData &>(event.data);
+			const TradeData &trade = event.get<TradeData>();
 
 			// Filter duplicate trade push
 			if (this->kt_tradeids.count(trade.kt_tradeid))
@@ -529,7 +529,19 @@ namespace Keen
 						.interval = interval};
 					req.__post_init__();
 
-					bars = this->trade_engine->query_history(req, contract->exchange_name);
+					if (!callback)
+					{
+						bars = this->trade_engine->query_history(req, contract->exchange_name);
+					}
+					else if (this->collecting_history)
+					{
+						// _init_strategy loads it before the strategy counts as inited
+						this->history_loads.push_back({ req, contract->exchange_name, std::move(callback) });
+					}
+					else
+					{
+						api::SpawnToQueue(this->_load_history(req, contract->exchange_name, std::move(callback)));
+					}
 				}
 				// Try to query bars from RQData, if not found, load from database.
 				else
@@ -541,6 +553,15 @@ namespace Keen
 			return bars;
 		}
 
+		api::Task<void> CtaEngine::_load_history(HistoryRequest req, AString exchange_name, FnMut<void(BarData)> callback)
+		{
+			std::list<BarData> bars = co_await this->trade_engine->query_history_async(std::move(req), exchange_name);
+			for (const auto& bar : bars)
+			{
+				callback(bar);
+			}
+		}
+
 		void CtaEngine::call_strategy_func(CtaTemplate *strategy, FnMut<void(std::any)> func, std::any params)
 		{
 			/*
@@ -603,12 +624,12 @@ namespace Keen
 		void CtaEngine::init_strategy(AString strategy_name)
 		{
 			/*
-			 * Init a strategy.
+			 * Init a strategy on the main loop, without blocking it while history loads.
 			 */
-			this->_init_strategy(strategy_name);
+			api::SpawnToQueue(this->_init_strategy(strategy_name));
 		}
 
-		void CtaEngine::_init_strategy(AString strategy_name)
+		api::Task<void> CtaEngine::_init_strategy(AString strategy_name)
 		{
 			/*
 			 * Init strategies in queue.
@@ -618,13 +639,33 @@ namespace Keen
 			if (strategy->inited)
 			{
 				this->write_log(Printf("%s initialization has been completed. Repeated operation is prohibited.", strategy_name.c_str()));
-				return;
+				co_return;
+			}
+
+			if (this->initializing_strategies.count(strategy_name))
+			{
+				this->write_log(Printf("%s is already initializing. Repeated operation is prohibited.", strategy_name.c_str()));
+				co_return;
 			}
 
 			this->write_log(Printf("%s starts initialization", strategy_name.c_str()));
+			this->initializing_strategies.insert(strategy_name);
 
-			// Call on_init function of strategy
+			// Call on_init function of strategy, the history it asks for is collected and loaded below
+			this->collecting_history = true;
 			strategy->on_init();
+			this->collecting_history = false;
+
+			std::list<HistoryLoad> loads = std::move(this->history_loads);
+			this->history_loads.clear();
+			for (auto& load : loads)
+			{
+				std::list<BarData> bars = co_await this->trade_engine->query_history_async(load.req, load.exchange_name);
+				for (const auto& bar : bars)
+				{
+					load.callback(bar);
+				}
+			}
 
 			// Restore strategy data(variables)
 			Json data = this->strategy_data.value(strategy_name, Json());
@@ -658,8 +699,14 @@ namespace Keen
 
 			// Put event to update init completed status.
 			strategy->inited = true;
+			this->initializing_strategies.erase(strategy_name);
 			this->put_strategy_event(strategy);
 			this->write_log(Printf("%s Initialization completed", strategy_name.c_str()));
+
+			if (this->start_after_init.erase(strategy_name))
+			{
+				this->start_strategy(strategy_name);
+			}
 		}
 
 		void CtaEngine::start_strategy(AString strategy_name)
@@ -668,6 +715,13 @@ namespace Keen
 			 * Start a strategy
 			 */
 			CtaTemplate *strategy = this->strategies[strategy_name];
+			if (!strategy->inited && this->initializing_strategies.count(strategy_name))
+			{
+				this->write_log(Printf("%s starts once its initialization completes", strategy_name.c_str()));
+				this->start_after_init.insert(strategy_name);
+				return;
+			}
+
 			if (!strategy->inited)
 			{
 				this->write_log(Printf("Strategy %s failed to start, please initialize first", strategy->strategy_name.c_str()));
@@ -692,11 +746,13 @@ namespace Keen
 			 * Stop a strategy
 			 */
 			CtaTemplate *strategy = this->strategies[strategy_name];
+			this->start_after_init.erase(strategy_name);
 			if (!strategy->trading)
 				return;
 
 			// Call on_stop function of the strategy
 			strategy->on_stop();
+			strategy->stop_timer();
 
 			// Change trading status of strategy to false
 			strategy->trading = false;
@@ -735,6 +791,12 @@ namespace Keen
 				return false;
 			}
 
+			if (this->initializing_strategies.count(strategy_name))
+			{
+				this->write_log(Printf("strategy %s removal failed, it is still initializing", strategy->strategy_name.c_str()));
+				return false;
+			}
+
 			// Remove setting
 			this->remove_strategy_setting(strategy_name);
 
@@ -109,6 +109,8 @@ namespace Keen
 
 			virtual int get_size(CtaTemplate* strategy);
 
+			/** With a callback, bars from an exchange are loaded without blocking the main loop and handed to callback
+			later; nothing is returned. While a strategy initializes they are all delivered before it counts as inited. */
 			virtual std::list<BarData> load_bar(AString kt_symbol, float days, Interval interval, FnMut<void(BarData)> callback = nullptr, bool use_database = false);
 
 			void call_strategy_func(CtaTemplate *strategy, FnMut<void(std::any)> func, std::any params = nullptr);
@@ -117,7 +119,9 @@ namespace Keen
 
 			void init_strategy(AString strategy_name);
 
-			void _init_strategy(AString strategy_name);
+			api::Task<void> _init_strategy(AString strategy_name);
+
+			api::Task<void> _load_history(HistoryRequest req, AString exchange_name, FnMut<void(BarData)> callback);
 
 			void start_strategy(AString strategy_name);
 
@@ -182,6 +186,18 @@ namespace Keen
 			int stop_order_count = 0;                                       // for generating stop_orderid
 		std::map<AString, StopOrder> stop_orders;                       // stop_orderid: stop_order
 			AStringSet kt_tradeids;                                         // for filtering duplicate trade
+
+			struct HistoryLoad
+			{
+				HistoryRequest req;
+				AString exchange_name;
+				FnMut<void(BarData)> callback;
+			};
+
+			bool collecting_history = false;                                // load_bar is called from on_init
+			std::list<HistoryLoad> history_loads;                           // history on_init asked for
+			AStringSet initializing_strategies;                             // waiting for their history
+			AStringSet start_after_init;                                    // started while still initializing
 		};
 	}
 }
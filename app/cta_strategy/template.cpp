@@ -35,7 +35,7 @@ namespace Keen
 
 		CtaTemplate::~CtaTemplate()
 		{
-
+			this->timer.cancel();
 		}
 
 		void CtaTemplate::update_setting(Json setting)
@@ -155,6 +155,29 @@ namespace Keen
 			*/
 		}
 
+		void CtaTemplate::on_timer()
+		{
+			/*
+			* Callback of the strategy timer, see start_timer.
+			*/
+		}
+
+		void CtaTemplate::start_timer(std::chrono::milliseconds interval)
+		{
+			/*
+			* Call on_timer on the main loop every interval, until stop_timer or the strategy is stopped.
+			*/
+			this->timer.cancel();
+			this->timer = api::RepeatToQueue(interval, [this]() {
+				this->cta_engine->call_strategy_func(this, [this](std::any) { this->on_timer(); });
+			});
+		}
+
+		void CtaTemplate::stop_timer()
+		{
+			this->timer.cancel();
+		}
+
 		AStringList CtaTemplate::Buy(float price, float volume, bool stop/* = false*/, bool lock/* = false*/, bool net/* = false*/)
 		{
 			/*
@@ -262,6 +285,7 @@ namespace Keen
 		{
 			/*
 			* Load historical bar data for initializing strategy.
+			* Bars from the exchange reach callback after on_init returns, but before the strategy is inited.
 			*/
 			if (!callback)
 				callback = std::bind(&CtaTemplate::on_bar, this, _1);
@@ -44,6 +44,8 @@ namespace Keen
 			bool trading;
 			float pos;
 
+			api::TimerHandle timer;
+
 			CtaTemplate(
 				CtaEngine* cta_engine,
 				AString strategy_name,
@@ -80,6 +82,12 @@ namespace Keen
 
 			virtual void on_stop_order(const StopOrder& stop_order);
 
+			virtual void on_timer();
+
+			void start_timer(std::chrono::milliseconds interval);
+
+			void stop_timer();
+
 			AStringList Buy(float price, float volume, bool stop = false, bool lock = false, bool net = false);
 
 			AStringList Sell(float price, float volume, bool stop = false, bool lock = false, bool net = false);
@@ -1,3 +1,4 @@
 find_package(OpenSSL REQUIRED)
+find_package(ZLIB REQUIRED)  # websocket permessage-deflate
 
 include_directories(${libs_loc}/fmt/include)
\ No newline at end of file
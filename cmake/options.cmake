@@ -1,6 +1,7 @@
 
 option(BUILD_SHARED "build shared library" ON)
 option(BUILD_STATIC "build static library" OFF)
+option(BUILD_TESTS "build the tests run by ctest" ON)
 
 set(CMAKE_POSITION_INDEPENDENT_CODE ON)
 
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+namespace Keen
+{
+    namespace api
+    {
+        template <class T>
+        class Task;
+
+        namespace detail
+        {
+            class TaskPromiseBase
+            {
+            public:
+                /** Hands control back to whoever co_awaited the task, if anyone did. */
+                class FinalAwaiter
+                {
+                public:
+                    bool await_ready() const noexcept { return false; }
+
+                    template <class PromiseT>
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseT> handle) noexcept
+                    {
+                        std::coroutine_handle<> continuation = handle.promise().continuation_;
+                        return continuation ? continuation : std::noop_coroutine();
+                    }
+
+                    void await_resume() noexcept {}
+                };
+
+                std::suspend_always initial_suspend() noexcept { return {}; }
+
+                FinalAwaiter final_suspend() noexcept { return {}; }
+
+                void unhandled_exception() { error_ = std::current_exception(); }
+
+            protected:
+                void rethrow() const
+                {
+                    if (error_)
+                    {
+                        std::rethrow_exception(error_);
+                    }
+                }
+
+            public:
+                std::coroutine_handle<> continuation_;
+
+            private:
+                std::exception_ptr error_;
+            };
+
+            template <class T>
+            class TaskPromise : public TaskPromiseBase
+            {
+            public:
+                Task<T> get_return_object() noexcept;
+
+                template <class U>
+                void return_value(U &&value) { value_.emplace(std::forward<U>(value)); }
+
+                T result()
+                {
+                    rethrow();
+                    return std::move(*value_);
+                }
+
+            private:
+                std::optional<T> value_;
+            };
+
+            template <>
+            class TaskPromise<void> : public TaskPromiseBase
+            {
+            public:
+                Task<void> get_return_object() noexcept;
+
+                void return_void() noexcept {}
+
+                void result() { rethrow(); }
+            };
+        }
+
+        /** Lazily started coroutine producing a T.
+        Nothing runs until it is co_awaited from another coroutine or handed to SpawnToQueue(). Exceptions thrown
+        inside come out of the co_await. */
+        template <class T = void>
+        class [[nodiscard]] Task
+        {
+        public:
+            using promise_type = detail::TaskPromise<T>;
+
+            Task() noexcept = default;
+
+            explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+                : handle_(handle) {}
+
+            Task(Task &&other) noexcept
+                : handle_(std::exchange(other.handle_, nullptr)) {}
+
+            Task &operator=(Task &&other) noexcept
+            {
+                if (this != &other)
+                {
+                    reset();
+                    handle_ = std::exchange(other.handle_, nullptr);
+                }
+                return *this;
+            }
+
+            ~Task() { reset(); }
+
+            bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle_.promise().continuation_ = awaiting;
+                return handle_;
+            }
+
+            T await_resume() { return handle_.promise().result(); }
+
+        private:
+            void reset()
+            {
+                if (handle_)
+                {
+                    handle_.destroy();
+                    handle_ = nullptr;
+                }
+            }
+
+            std::coroutine_handle<promise_type> handle_;
+
+            DISALLOW_COPY_AND_ASSIGN(Task);
+        };
+
+        namespace detail
+        {
+            template <class T>
+            Task<T> TaskPromise<T>::get_return_object() noexcept
+            {
+                return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+            }
+
+            inline Task<void> TaskPromise<void>::get_return_object() noexcept
+            {
+                return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+            }
+        }
+
+        /** co_await to continue on the main loop, e.g. after work that resumed on another thread. */
+        class QueueAwaiter
+        {
+        public:
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                InvokeToQueue([handle]() { handle.resume(); });
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        inline QueueAwaiter ResumeOnQueue() { return {}; }
+
+        /** co_await to continue on the main loop after delay, without blocking any thread. */
+        class DelayAwaiter
+        {
+        public:
+            explicit DelayAwaiter(std::chrono::milliseconds delay)
+                : delay_(delay) {}
+
+            bool await_ready() const noexcept { return delay_.count() <= 0; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                DelayToQueue(delay_, [handle]() { handle.resume(); });
+            }
+
+            void await_resume() noexcept {}
+
+        private:
+            std::chrono::milliseconds delay_;
+        };
+
+        inline DelayAwaiter AsyncDelay(std::chrono::milliseconds delay) { return DelayAwaiter(delay); }
+
+        /** Starts the task on the main loop and lets it run to completion on its own.
+        An exception escaping the task is logged. */
+        KEEN_API_EXPORT void SpawnToQueue(Task<void> task);
+    }
+}
@@ -120,6 +120,7 @@ using Json = nlohmann::json;
 #include "OSSupport/CriticalSection.h"
 #include "OSSupport/Event.h"
 #include "OSSupport/File.h"
+#include "OSSupport/MappedFile.h"
 #include "OSSupport/StackTrace.h"
 #include "OSSupport/ConsoleSignalHandler.h"
 
@@ -1,17 +1,307 @@
 #include "Globals.h" // NOTE: MSVC stupidness requires this to be the same across all modules
 #include "EventLoop.h"
 #include "OSSupport/Singleton.h"
+#include "OSSupport/LockFreeQueue.h"
+#include "OSSupport/ThreadTopology.h"
 
 #define _WEBSOCKETPP_CPP11_STL_
 #define ASIO_STANDALONE 1
 
 #include <asio.hpp>
 #include <iostream>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#include <immintrin.h>
+#endif
 
 namespace Keen
 {
 	namespace api
 	{
+		/** Drives a TimerWheel from the main loop with a single asio timer armed for the wheel's next deadline. */
+		class TimerDriver
+		{
+		public:
+			TimerDriver(asio::io_service& io_service, asio::strand<asio::io_context::executor_type>& strand)
+				: _strand(strand)
+				, _timer(io_service)
+				, _armed(TimerWheel::Clock::time_point::max())
+			{
+			}
+
+			TimerHandle schedule(std::chrono::milliseconds delay, std::chrono::milliseconds period, TimerWheel::Callback callback)
+			{
+				UInt64 id = this->_wheel.schedule(delay, period, std::move(callback));
+
+				// Re-arm from the main loop if the new timer is due before the asio timer goes off
+				if (this->_wheel.next_deadline() < this->_armed.load())
+				{
+					asio::post(this->_strand, [this]() { this->_arm(); });
+				}
+				return TimerHandle(&this->_wheel, id);
+			}
+
+		private:
+			void _arm()
+			{
+				auto deadline = this->_wheel.next_deadline();
+				if (deadline == this->_armed.load())
+				{
+					return;
+				}
+
+				this->_armed = deadline;
+				if (deadline == TimerWheel::Clock::time_point::max())
+				{
+					this->_timer.cancel();
+					return;
+				}
+
+				this->_timer.expires_at(deadline);
+				this->_timer.async_wait(asio::bind_executor(this->_strand, [this](const asio::error_code& ec) {
+					if (ec)
+					{
+						return;  // re-armed or shut down
+					}
+					this->_armed = TimerWheel::Clock::time_point::max();
+					this->_wheel.advance(TimerWheel::Clock::now());
+					this->_arm();
+				}));
+			}
+
+			TimerWheel _wheel;
+			asio::strand<asio::io_context::executor_type>& _strand;
+			asio::steady_timer _timer;
+			std::atomic<TimerWheel::Clock::time_point> _armed;
+		};
+
+		/** io_service shared by network clients, run by a fixed set of threads.
+		Each client serializes its own handlers on a strand of it. */
+		class NetworkPool
+		{
+		public:
+			NetworkPool(const char* role, const char* thread_prefix)
+				: _role(role)
+				, _thread_prefix(thread_prefix)
+			{
+			}
+
+			~NetworkPool()
+			{
+				this->stop();
+				for (auto& thread : this->_threads)
+				{
+					if (thread.joinable())
+					{
+						thread.join();
+					}
+				}
+			}
+
+			void start(size_t count)
+			{
+				if ((count == 0) || !this->_threads.empty())
+				{
+					return;
+				}
+
+				this->_work.emplace(asio::make_work_guard(this->_io_service));
+				for (size_t i = 0; i < count; ++i)
+				{
+					this->_threads.emplace_back([this, i]() {
+						cThreadTopology::Apply(this->_role, this->_thread_prefix + std::to_string(i));
+						// A handler that throws unwinds out of run(); keep the thread serving the pool until stop()
+						for (;;)
+						{
+							try
+							{
+								this->_io_service.run();
+								break;
+							}
+							catch (const std::exception& e)
+							{
+								LOGERROR("Exception in network thread %s%zu: %s", this->_thread_prefix.c_str(), i, e.what());
+							}
+						}
+					});
+				}
+			}
+
+			void stop()
+			{
+				this->_work.reset();
+				this->_io_service.stop();
+			}
+
+			bool is_running() const
+			{
+				return !this->_threads.empty();
+			}
+
+			asio::io_service& get_io_service()
+			{
+				return this->_io_service;
+			}
+
+		private:
+			AString _role;
+			AString _thread_prefix;
+			asio::io_service _io_service;
+			std::optional<asio::executor_work_guard<asio::io_context::executor_type>> _work;
+			std::vector<std::thread> _threads;
+		};
+
+		// Idle PooledTasks kept for reuse, a burst beyond this allocates and frees the extra tasks
+		const size_t POOLED_TASK_CACHE = 4096;
+
+		/** Free list of PooledTasks, shared by every thread that posts to the main loop. */
+		class PooledTaskCache
+		{
+		public:
+			PooledTaskCache()
+				: _free(POOLED_TASK_CACHE)
+			{
+			}
+
+			~PooledTaskCache()
+			{
+				PooledTask* task;
+				while (this->_free.TryPop(task))
+				{
+					delete task;
+				}
+			}
+
+			PooledTask* acquire()
+			{
+				PooledTask* task;
+				if (this->_free.TryPop(task))
+				{
+					return task;
+				}
+				return new PooledTask();
+			}
+
+			void release(PooledTask* task)
+			{
+				if (!this->_free.TryPush(task))
+				{
+					delete task;
+				}
+			}
+
+		private:
+			cLockFreeQueue<PooledTask*> _free;
+		};
+
+		// Tasks run per strand handler before the queue yields to other main loop work (timers, sockets)
+		const size_t MAIN_LOOP_DRAIN_LIMIT = 256;
+
+		/** Tasks waiting for the main loop, as an intrusive MPSC list (Dmitry Vyukov's node-based queue).
+		Producers only touch the strand when the queue goes from idle to busy; one drain handler then runs
+		everything that was posted, so the per-task cost is an atomic exchange. */
+		class MainLoopQueue
+		{
+		public:
+			MainLoopQueue(asio::strand<asio::io_context::executor_type>& strand)
+				: _strand(strand)
+				, _head(&_stub)
+				, _tail(&_stub)
+				, _scheduled(false)
+			{
+			}
+
+			void push(PooledTask* task)
+			{
+				this->_link(task);
+
+				// Whoever flips the flag owns posting the drain, a drain already running will see the task
+				if (!this->_scheduled.exchange(true))
+				{
+					asio::post(this->_strand, [this]() { this->_drain(); });
+				}
+			}
+
+		private:
+			void _link(PooledTask* task)
+			{
+				task->next_.store(nullptr, std::memory_order_relaxed);
+				PooledTask* prev = this->_head.exchange(task, std::memory_order_acq_rel);
+				prev->next_.store(task, std::memory_order_release);
+			}
+
+			/** Single consumer. Returns nullptr when empty, or while a producer is halfway through _link. */
+			PooledTask* _pop()
+			{
+				PooledTask* tail = this->_tail;
+				PooledTask* next = tail->next_.load(std::memory_order_acquire);
+				if (tail == &this->_stub)
+				{
+					if (next == nullptr)
+					{
+						return nullptr;
+					}
+					this->_tail = next;
+					tail = next;
+					next = next->next_.load(std::memory_order_acquire);
+				}
+
+				if (next != nullptr)
+				{
+					this->_tail = next;
+					return tail;
+				}
+
+				if (tail != this->_head.load(std::memory_order_acquire))
+				{
+					return nullptr;
+				}
+
+				// tail is the last task, put the stub behind it so it can be taken
+				this->_link(&this->_stub);
+				next = tail->next_.load(std::memory_order_acquire);
+				if (next != nullptr)
+				{
+					this->_tail = next;
+					return tail;
+				}
+				return nullptr;
+			}
+
+			void _drain()
+			{
+				// Cleared first: a task linked from now on either gets popped below or schedules a new drain
+				this->_scheduled.store(false);
+
+				for (size_t i = 0; i < MAIN_LOOP_DRAIN_LIMIT; ++i)
+				{
+					PooledTask* task = this->_pop();
+					if (task == nullptr)
+					{
+						return;
+					}
+
+					struct Release
+					{
+						PooledTask* task;
+						~Release() { ReleasePooledTask(task); }
+					} release{ task };
+
+					task->Run();
+				}
+
+				if (!this->_scheduled.exchange(true))
+				{
+					asio::post(this->_strand, [this]() { this->_drain(); });
+				}
+			}
+
+			asio::strand<asio::io_context::executor_type>& _strand;
+			PooledTask _stub;
+			std::atomic<PooledTask*> _head;
+			PooledTask* _tail;  // only touched by the drain, which the strand serializes
+			std::atomic<bool> _scheduled;
+		};
+
 		// Singleton pattern for managing the io_service instance
 		class IOService : public Singleton<IOService>
 		{
@@ -27,6 +317,31 @@ namespace Keen
 				static asio::strand<asio::io_context::executor_type> instance(get_io_service().get_executor());
 				return instance;
 			}
+
+			TimerDriver& get_timer_driver()
+			{
+				static TimerDriver instance(get_io_service(), get_strand());
+				return instance;
+			}
+
+			NetworkPool& get_network_pool(NetworkChannel channel = NetworkChannel::MARKET_DATA)
+			{
+				static NetworkPool market_data("network", "kt-net-");
+				static NetworkPool order("order", "kt-order-");
+				return (channel == NetworkChannel::ORDER) ? order : market_data;
+			}
+
+			PooledTaskCache& get_task_cache()
+			{
+				static PooledTaskCache instance;
+				return instance;
+			}
+
+			MainLoopQueue& get_main_loop_queue()
+			{
+				static MainLoopQueue instance(get_strand());
+				return instance;
+			}
 		};
 
 		void* get_main_event_loop()
@@ -34,13 +349,107 @@ namespace Keen
 			return &IOService::get_instance().get_io_service();
 		}
 
+		// Pause instructions between clock reads while the main loop spins
+		static const size_t MAIN_LOOP_SPIN_CHECK_INTERVAL = 64;
+
+		// Pause instructions before a spin-then-yield wait starts yielding
+		static const size_t MAIN_LOOP_SPIN_BEFORE_YIELD = 128;
+
+		static WaitStrategy g_main_loop_strategy = WaitStrategy::BLOCKING;
+		static std::chrono::microseconds g_main_loop_spin_budget(0);
+		static std::atomic<UInt64> g_main_loop_spin_ns(0);
+		static std::atomic<UInt64> g_main_loop_parks(0);
+
+		static inline void main_loop_relax()
+		{
+		#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+			_mm_pause();
+		#else
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		#endif
+		}
+
+		/** Polls the io_service while it has nothing ready, and parks in run_one once the spin budget is used up.
+		Returns like run(): when the loop is stopped or runs out of work. */
+		static void spin_main_event_loop(asio::io_service& io_service)
+		{
+			bool bounded = (g_main_loop_spin_budget.count() > 0);
+			while (!io_service.stopped())
+			{
+				if (io_service.poll() != 0)
+					continue;
+
+				auto start = std::chrono::steady_clock::now();
+				auto deadline = start + g_main_loop_spin_budget;
+				bool ready = false;
+				for (size_t i = 1; !io_service.stopped(); ++i)
+				{
+					if (io_service.poll_one() != 0)
+					{
+						ready = true;
+						break;
+					}
+
+					if ((g_main_loop_strategy == WaitStrategy::SPIN_YIELD) && (i > MAIN_LOOP_SPIN_BEFORE_YIELD))
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						main_loop_relax();
+						if ((i % MAIN_LOOP_SPIN_CHECK_INTERVAL) != 0)
+						{
+							continue;
+						}
+					}
+
+					if (bounded && (std::chrono::steady_clock::now() >= deadline))
+					{
+						break;
+					}
+				}
+
+				// Only this thread writes the counters
+				UInt64 ns = static_cast<UInt64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+				g_main_loop_spin_ns.store(g_main_loop_spin_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+
+				if (!ready && !io_service.stopped())
+				{
+					g_main_loop_parks.store(g_main_loop_parks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					io_service.run_one();
+				}
+			}
+		}
+
+		void set_main_event_loop_wait(WaitStrategy strategy, std::chrono::microseconds spin_budget)
+		{
+			g_main_loop_strategy = strategy;
+			g_main_loop_spin_budget = spin_budget;
+		}
+
+		MainLoopStats get_main_event_loop_stats()
+		{
+			MainLoopStats stats;
+			stats.spin_ns = g_main_loop_spin_ns.load(std::memory_order_relaxed);
+			stats.parks = g_main_loop_parks.load(std::memory_order_relaxed);
+			return stats;
+		}
+
 		int run_main_event_loop()
 		{
 			auto& io_service = IOService::get_instance().get_io_service();
+			cThreadTopology::Apply("main", "kt-main");
 
 			try
 			{
-				io_service.run();
+				if (g_main_loop_strategy == WaitStrategy::BLOCKING)
+				{
+					io_service.run();
+				}
+				else
+				{
+					spin_main_event_loop(io_service);
+				}
 			}
 			catch (const std::exception& e)
 			{
@@ -57,6 +466,8 @@ namespace Keen
 
 			try
 			{
+				IOService::get_instance().get_network_pool(NetworkChannel::ORDER).stop();
+				IOService::get_instance().get_network_pool(NetworkChannel::MARKET_DATA).stop();
 				io_service.stop();
 			}
 			catch (const std::exception& e)
@@ -68,46 +479,109 @@ namespace Keen
 			return 0;
 		}
 
-		template <class F, class... Args>
-		auto enqueue(F&& f, Args &&...args)
-			-> std::future<typename std::invoke_result<F, Args...>::type>
+		bool is_main_event_loop_thread()
 		{
-			using return_type = typename std::invoke_result<F, Args...>::type;
+			return IOService::get_instance().get_io_service().get_executor().running_in_this_thread();
+		}
 
-			auto task = std::make_shared<std::packaged_task<return_type()>>(
-				std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		void start_network_threads(size_t count, NetworkChannel channel)
+		{
+			IOService::get_instance().get_network_pool(channel).start(count);
+		}
 
-			std::future<return_type> res = task->get_future();
-			auto& strand = IOService::get_instance().get_strand();
-			asio::post(strand, [task]()
-				{ (*task)(); });
+		void* get_network_event_loop(NetworkChannel channel)
+		{
+			auto& pool = IOService::get_instance().get_network_pool(channel);
+			if (pool.is_running())
+			{
+				return &pool.get_io_service();
+			}
+			if (channel == NetworkChannel::ORDER)
+			{
+				return get_network_event_loop(NetworkChannel::MARKET_DATA);
+			}
+			return get_main_event_loop();
+		}
 
-			return res;
+		PooledTask* AcquirePooledTask()
+		{
+			return IOService::get_instance().get_task_cache().acquire();
+		}
+
+		void ReleasePooledTask(PooledTask* task)
+		{
+			IOService::get_instance().get_task_cache().release(task);
+		}
+
+		void PostPooledTask(PooledTask* task)
+		{
+			IOService::get_instance().get_main_loop_queue().push(task);
 		}
 
 		void InvokeOnMainLoop(MessageData* pdata)
 		{
-			auto& strand = IOService::get_instance().get_strand();
-			asio::post(strand, [pdata]() {
-				if (pdata)
+			// Same queue as the pooled tasks, so both kinds run in posting order
+			std::unique_ptr<MessageData> message(pdata);
+			PooledTask* task = AcquirePooledTask();
+			task->emplace([pdata = message.release()]() {
+				std::unique_ptr<MessageData> message(pdata);
+				if (message)
+				{
+					message->Run();
+				}
+			});
+			PostPooledTask(task);
+		}
+
+		namespace
+		{
+			/** Eagerly started, self-destroying coroutine that owns a spawned task. */
+			class DetachedTask
+			{
+			public:
+				class promise_type
 				{
-					pdata->Run();
-					delete pdata;
-				} 
+				public:
+					DetachedTask get_return_object() noexcept { return {}; }
+					std::suspend_never initial_suspend() noexcept { return {}; }
+					std::suspend_never final_suspend() noexcept { return {}; }
+					void return_void() noexcept {}
+					void unhandled_exception() noexcept {}
+				};
+			};
+
+			DetachedTask RunDetached(Task<void> task)
+			{
+				try
+				{
+					co_await task;
+				}
+				catch (const std::exception& e)
+				{
+					LOGERROR("Unhandled exception in coroutine: %s", e.what());
+				}
+			}
+		}
+
+		void SpawnToQueue(Task<void> task)
+		{
+			InvokeToQueue([task = std::move(task)]() mutable {
+				RunDetached(std::move(task));
 			});
 		}
 
-		void DelayOnMainLoop(int seconds, MessageData* pdata)
+		TimerHandle DelayOnMainLoop(int seconds, MessageData* pdata)
 		{
-			auto timer = std::make_shared<asio::steady_timer>(
-				IOService::get_instance().get_io_service(),
-				asio::chrono::seconds(seconds));
+			return ScheduleOnMainLoop(std::chrono::seconds(seconds), std::chrono::milliseconds::zero(), pdata);
+		}
 
-			timer->async_wait([pdata, timer](const asio::error_code& /*e*/) {
-				if (pdata)
+		TimerHandle ScheduleOnMainLoop(std::chrono::milliseconds delay, std::chrono::milliseconds period, MessageData* pdata)
+		{
+			std::shared_ptr<MessageData> message(pdata);
+			return IOService::get_instance().get_timer_driver().schedule(delay, period, [message]() {
+				if (message)
 				{
-					pdata->Run();
-					delete pdata;
+					message->Run();
 				}
 			});
 		}
@@ -11,6 +11,47 @@ namespace Keen
 
         extern KEEN_API_EXPORT int exit_main_event_loop();
 
+        /** True on the thread running the main loop, where waiting for main loop work to finish would never end. */
+        extern KEEN_API_EXPORT bool is_main_event_loop_thread();
+
+        /** How a loop thread waits for work. */
+        enum class WaitStrategy
+        {
+            BLOCKING,       // park on an event right away, every wake-up goes through the kernel
+            SPIN_YIELD,     // spin briefly, then yield the core until the spin budget runs out, then park
+            BUSY_SPIN       // spin on the queues until the spin budget runs out, then park
+        };
+
+        /** How run_main_event_loop waits between handlers. The spinning strategies poll the io_service, so work the
+        event dispatcher posts starts without a kernel wake-up; a spin budget of zero never parks and keeps a core
+        busy for as long as the loop runs. Call before run_main_event_loop. */
+        extern KEEN_API_EXPORT void set_main_event_loop_wait(WaitStrategy strategy, std::chrono::microseconds spin_budget = std::chrono::microseconds(0));
+
+        class MainLoopStats
+        {
+        public:
+            UInt64 spin_ns = 0;     // main loop time spent spinning or yielding without work
+            UInt64 parks = 0;       // times the main loop went to sleep in the io_service
+        };
+
+        extern KEEN_API_EXPORT MainLoopStats get_main_event_loop_stats();
+
+        /** Which network pool a client runs on. */
+        enum class NetworkChannel
+        {
+            MARKET_DATA,    // market data and everything else
+            ORDER           // order entry and order updates, kept off the market data threads
+        };
+
+        /** Starts count threads that run the channel's network I/O (TLS, websocket framing, JSON parsing) off the
+        main loop. 0 leaves the channel where it was: ORDER on the market data pool, that one on the main loop.
+        Call once per channel, before any client is started. */
+        extern KEEN_API_EXPORT void start_network_threads(size_t count, NetworkChannel channel = NetworkChannel::MARKET_DATA);
+
+        /** The io_service the channel's clients run on: its own pool once started, else the market data pool, else
+        the main loop. */
+        extern KEEN_API_EXPORT void *get_network_event_loop(NetworkChannel channel = NetworkChannel::MARKET_DATA);
+
         class MessageData
         {
         public:
@@ -35,22 +76,115 @@ namespace Keen
             DISALLOW_COPY_AND_ASSIGN(MessageWithFunctor);
         };
 
+        /** Fire-and-forget main loop task with the callable stored inline.
+        Tasks are recycled through a pool and queued on an intrusive list, so posting one costs no heap
+        allocation once the pool is warm. */
+        class PooledTask final
+        {
+        public:
+            static constexpr size_t INLINE_SIZE = 232;  // keeps the task at 256 bytes
+
+            template <class FunctorT>
+            static constexpr bool fits()
+            {
+                return (sizeof(FunctorT) <= INLINE_SIZE) && (alignof(FunctorT) <= alignof(std::max_align_t));
+            }
+
+            template <class FunctorT>
+            void emplace(FunctorT &&functor)
+            {
+                using Fn = std::decay_t<FunctorT>;
+                static_assert(fits<Fn>(), "Callable does not fit in a PooledTask");
+
+                new (storage_) Fn(std::forward<FunctorT>(functor));
+                invoke_ = [](void *storage) { (*static_cast<Fn *>(storage))(); };
+                destroy_ = [](void *storage) { static_cast<Fn *>(storage)->~Fn(); };
+            }
+
+            /** Runs the callable and destroys it, even if it throws. */
+            void Run()
+            {
+                struct Cleanup
+                {
+                    PooledTask *task;
+                    ~Cleanup() { task->destroy_(task->storage_); }
+                } cleanup{this};
+
+                invoke_(storage_);
+            }
+
+        private:
+            friend class MainLoopQueue;
+
+            alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+            void (*invoke_)(void *) = nullptr;
+            void (*destroy_)(void *) = nullptr;
+            std::atomic<PooledTask *> next_ = nullptr;
+        };
+
+        KEEN_API_EXPORT PooledTask *AcquirePooledTask();
+
+        /** Returns an empty task to the pool, for when emplace() threw. */
+        KEEN_API_EXPORT void ReleasePooledTask(PooledTask *task);
+
+        /** Runs the task on the main loop, then returns it to the pool. Tasks run in the order they were posted,
+        together with MessageData posted through InvokeOnMainLoop. */
+        KEEN_API_EXPORT void PostPooledTask(PooledTask *task);
+
+        /** Runs the functor on the main loop. Callables that fit a PooledTask skip the heap;
+        larger ones fall back to a MessageData. */
         template <class FunctorT>
         void InvokeToQueue(FunctorT &&functor)
         {
-            InvokeOnMainLoop(new MessageWithFunctor<FunctorT>(
+            if constexpr (PooledTask::fits<std::decay_t<FunctorT>>())
+            {
+                PooledTask *task = AcquirePooledTask();
+                try
+                {
+                    task->emplace(std::forward<FunctorT>(functor));
+                }
+                catch (...)
+                {
+                    ReleasePooledTask(task);
+                    throw;
+                }
+                PostPooledTask(task);
+            }
+            else
+            {
+                InvokeOnMainLoop(new MessageWithFunctor<FunctorT>(
+                    std::forward<FunctorT>(functor)));
+            }
+        }
+
+        template <class FunctorT>
+        TimerHandle DelayToQueue(int seconds, FunctorT&& functor)
+        {
+            return DelayOnMainLoop(seconds, new MessageWithFunctor<FunctorT>(
+                std::forward<FunctorT>(functor)));
+        }
+
+        /** Runs the functor once on the main loop after delay. */
+        template <class FunctorT>
+        TimerHandle DelayToQueue(std::chrono::milliseconds delay, FunctorT&& functor)
+        {
+            return ScheduleOnMainLoop(delay, std::chrono::milliseconds::zero(), new MessageWithFunctor<FunctorT>(
                 std::forward<FunctorT>(functor)));
         }
 
+        /** Runs the functor on the main loop every period until the returned handle is cancelled. */
         template <class FunctorT>
-        void DelayToQueue(int seconds, FunctorT&& functor)
+        TimerHandle RepeatToQueue(std::chrono::milliseconds period, FunctorT&& functor)
         {
-            DelayOnMainLoop(seconds, new MessageWithFunctor<FunctorT>(
+            return ScheduleOnMainLoop(period, period, new MessageWithFunctor<FunctorT>(
                 std::forward<FunctorT>(functor)));
         }
 
         KEEN_API_EXPORT void InvokeOnMainLoop(MessageData *pdata);
 
-        KEEN_API_EXPORT void DelayOnMainLoop(int seconds, MessageData* pdata);
+        KEEN_API_EXPORT TimerHandle DelayOnMainLoop(int seconds, MessageData* pdata);
+
+        /** Schedules pdata on the main loop's timer wheel; a zero period makes it one-shot. Takes ownership of pdata. */
+        KEEN_API_EXPORT TimerHandle ScheduleOnMainLoop(std::chrono::milliseconds delay, std::chrono::milliseconds period, MessageData* pdata);
     }
 }
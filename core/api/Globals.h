@@ -99,6 +99,8 @@
 #include "Defines.h"
 #include "StringUtils.h"
 #include "DateTime.h"
+#include "TimerWheel.h"
 #include "EventLoop.h"
+#include "Coroutine.h"
 
 
@@ -4,17 +4,20 @@ namespace Keen
 {
     namespace api
     {
+        /** Id of a request in flight, see Sender::send. Ids increase monotonically, 0 is never used. */
+        using RequestId = UInt64;
+
         class HTTPAbstractDoneHandler
         {
         public:
-            virtual void operator()(const AString &requestId, const AString& data) = 0;
+            virtual void operator()(RequestId requestId, const AString& data) = 0;
         };
         using HTTPDoneHandlerPtr = std::shared_ptr<HTTPAbstractDoneHandler>;
 
         class HTTPAbstractFailHandler
         {
         public:
-            virtual void operator()(const AString &requestId, const Error &e) = 0;
+            virtual void operator()(RequestId requestId, const Error &e) = 0;
         };
 
         using HTTPFailHandlerPtr = std::shared_ptr<HTTPAbstractFailHandler>;
@@ -22,7 +25,7 @@ namespace Keen
         class HTTPAbstractErrorHandler
         {
         public:
-            virtual void operator()(const AString& requestId, const std::exception& e) = 0;
+            virtual void operator()(RequestId requestId, const std::exception& e) = 0;
         };
 
         using HTTPErrorHandlerPtr = std::shared_ptr<HTTPAbstractErrorHandler>;
@@ -30,7 +33,7 @@ namespace Keen
         class HTTPAbstractProcessHandler
         {
         public:
-            virtual void operator()(const AString &requestId, const Process &process) = 0;
+            virtual void operator()(RequestId requestId, const Process &process) = 0;
         };
         using HTTPProcessHandlerPtr = std::shared_ptr<HTTPAbstractProcessHandler>;
 
@@ -13,6 +13,7 @@ namespace Keen
 		using RequestData = std::variant<Json, AString>;
 
 		using CALLBACK_TYPE = std::function<void(const Json&, const Request&)>;
+		using BODY_CALLBACK_TYPE = std::function<void(const AString&, const Request&)>;
 		using ON_FAILED_TYPE = std::function<void(const Error&, const Request&)>;
 		using ON_ERROR_TYPE = std::function<void(const std::exception&, const Request&)>;
 		using CONNECTED_TYPE = std::function<void(const Request&)>;
@@ -120,7 +121,12 @@ namespace Keen
 			RequestData data = AString();
 			std::any extra;
 
+			/** Fails the request with status 408 if no response came in time, zero uses the Sender's default. */
+			std::chrono::milliseconds timeout = std::chrono::milliseconds::zero();
+
 			CALLBACK_TYPE callback;
+			/** Called with the raw body instead of callback, for replies too large to parse into one Json (see ParseJsonRecords). */
+			BODY_CALLBACK_TYPE body_callback;
 			ON_FAILED_TYPE on_failed;
 			ON_ERROR_TYPE on_error;
 
@@ -35,26 +35,174 @@ namespace Keen
 			return h;
 		}
 
-		AString exception_detail(const std::exception& ex, const Request& request)
+		AString exception_detail(const std::exception& ex, RequestId requestId, const Response& response)
 		{
 			AString text = Printf("[%s]: Unhandled RestClient Error:%s\n",
 				DateTimeToString(currentDateTime()).c_str(), typeid(ex).name());
-			text += Printf("request:%s\n", request.__str__().c_str());
+			text += Printf("request id:%llu status:%d\n", static_cast<unsigned long long>(requestId), response.status);
 			text += "Exception trace: \n";
 			text += ex.what();
 			text += " \n\n";
 			return text;
 		}
 
-		Response _http_request(const Request& request, const AString& url_base, const AString& proxy_host, uint16_t proxy_port)
+		/** Keep-alive connections to one url_base (and proxy), shared by every Sender that points at it.
+		A connection is used by one request at a time; at most max_connections exist, further requests wait for one. */
+		class HttpConnectionPool
 		{
-			httplib::Client cli(url_base);
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			HttpConnectionPool(const AString& url_base, const AString& proxy_host, uint16_t proxy_port)
+				: _url_base(url_base)
+				, _proxy_host(proxy_host)
+				, _proxy_port(proxy_port)
+			{
+			}
+
+			/** Returns an idle connection, or opens a new one if the pool has room. Idle connections past the timeout are closed.
+			A returned idle connection is not probed: if the server dropped it, the request's single retry in _http_request
+			is the only health check. */
+			std::unique_ptr<httplib::Client> acquire(bool& reused)
+			{
+				std::unique_lock<std::mutex> lock(this->_mutex);
+				for (;;)
+				{
+					auto now = Clock::now();
+					auto stale = std::remove_if(this->_idle.begin(), this->_idle.end(),
+						[this, now](const Idle& idle) { return now - idle.since > this->_idle_timeout; });
+					this->_total -= static_cast<size_t>(this->_idle.end() - stale);
+					this->_idle.erase(stale, this->_idle.end());
+
+					if (!this->_idle.empty())
+					{
+						// Most recently used first, it is the least likely to have been closed by the server
+						auto client = std::move(this->_idle.back().client);
+						this->_idle.pop_back();
+						reused = true;
+						return client;
+					}
+
+					if (this->_total < this->_max_connections)
+					{
+						++this->_total;
+						lock.unlock();
+						reused = false;
+						return this->_connect();
+					}
+
+					this->_available.wait(lock);
+				}
+			}
+
+			/** Returns the connection to the pool; a connection that failed is closed instead. */
+			void release(std::unique_ptr<httplib::Client> client, bool healthy)
+			{
+				{
+					std::lock_guard<std::mutex> lock(this->_mutex);
+					if (healthy)
+					{
+						this->_idle.push_back({ std::move(client), Clock::now() });
+					}
+					else
+					{
+						--this->_total;
+					}
+				}
+				this->_available.notify_one();
+			}
+
+			void set_limits(size_t max_connections, std::chrono::seconds idle_timeout)
+			{
+				{
+					std::lock_guard<std::mutex> lock(this->_mutex);
+					this->_max_connections = std::max<size_t>(max_connections, 1);
+					this->_idle_timeout = idle_timeout;
+				}
+				this->_available.notify_all();
+			}
 
-			if (!proxy_host.empty() && proxy_port)
+		private:
+			struct Idle
 			{
-				cli.set_proxy(proxy_host, proxy_port);
+				std::unique_ptr<httplib::Client> client;
+				Clock::time_point since;
+			};
+
+			std::unique_ptr<httplib::Client> _connect()
+			{
+				auto client = std::make_unique<httplib::Client>(this->_url_base);
+				client->set_keep_alive(true);
+				client->set_tcp_nodelay(true);
+				if (!this->_proxy_host.empty() && this->_proxy_port)
+				{
+					client->set_proxy(this->_proxy_host, this->_proxy_port);
+				}
+				return client;
 			}
 
+			AString _url_base;
+			AString _proxy_host;
+			uint16_t _proxy_port;
+
+			std::mutex _mutex;
+			std::condition_variable _available;
+			std::vector<Idle> _idle;
+			size_t _total = 0;
+			size_t _max_connections = 8;
+			std::chrono::seconds _idle_timeout = std::chrono::seconds(30);
+		};
+
+		/** Every connection pool, by url_base and proxy. Pools live as long as the process. */
+		class HttpConnectionPools
+		{
+		public:
+			static HttpConnectionPools& get_instance()
+			{
+				static HttpConnectionPools instance;
+				return instance;
+			}
+
+			HttpConnectionPool& get(const AString& url_base, const AString& proxy_host, uint16_t proxy_port)
+			{
+				AString key = Printf("%s|%s:%u", url_base.c_str(), proxy_host.c_str(), proxy_port);
+				std::lock_guard<std::mutex> lock(this->_mutex);
+				auto& pool = this->_pools[key];
+				if (!pool)
+				{
+					pool = std::make_unique<HttpConnectionPool>(url_base, proxy_host, proxy_port);
+					pool->set_limits(this->_max_connections, this->_idle_timeout);
+				}
+				return *pool;
+			}
+
+			void set_limits(size_t max_connections, std::chrono::seconds idle_timeout)
+			{
+				std::lock_guard<std::mutex> lock(this->_mutex);
+				this->_max_connections = max_connections;
+				this->_idle_timeout = idle_timeout;
+				for (auto& [key, pool] : this->_pools)
+				{
+					pool->set_limits(max_connections, idle_timeout);
+				}
+			}
+
+		private:
+			std::mutex _mutex;
+			std::map<AString, std::unique_ptr<HttpConnectionPool>> _pools;
+			size_t _max_connections = 8;
+			std::chrono::seconds _idle_timeout = std::chrono::seconds(30);
+		};
+
+		void set_http_pool_limits(size_t max_connections, std::chrono::seconds idle_timeout)
+		{
+			HttpConnectionPools::get_instance().set_limits(max_connections, idle_timeout);
+		}
+
+		Response _http_request(const Request& request, const AString& url_base, const AString& proxy_host, uint16_t proxy_port)
+		{
+			HttpConnectionPool& pool = HttpConnectionPools::get_instance().get(url_base, proxy_host, proxy_port);
+
 			httplib::Request req;
 			req.method = request.method;
 			req.path = request.path;
@@ -67,9 +215,27 @@ namespace Keen
 				req.path = httplib::append_query_params(request.path, req.params);
 			}
 
-			httplib::Result res = cli.send(req);
+			bool reused = false;
+			auto client = pool.acquire(reused);
+			httplib::Result res = client->send(req);
 			auto error = res.error();
 
+			// A kept-alive connection the server has dropped fails to connect before anything is sent, and that is
+			// the only failure retried for other methods: after a write error part of a POST may have reached the
+			// server and been executed. GET is retried on any failure
+			if (reused && (error == httplib::Error::Connection
+				|| (error != httplib::Error::Success && request.method == "GET")))
+			{
+				pool.release(std::move(client), false);
+				client = pool.acquire(reused);
+				res = client->send(req);
+				error = res.error();
+			}
+
+			// The server asked to close, or the connection broke: don't reuse it
+			bool healthy = res && (error == httplib::Error::Success) && (res->get_header_value("Connection") != "close");
+			pool.release(std::move(client), healthy);
+
 			Response response;
 			response.code = (int)error;
 
@@ -89,25 +255,134 @@ namespace Keen
 			return response;
 		}
 
-		void Sender::sendRequest(const AString& requestId, const Request& request, HTTPResponseHandler&& callbacks)
+		// Requests in flight per Sender; a send beyond that fails right away
+		const size_t MAX_REQUESTS_IN_FLIGHT = 4096;
+
+		// How often requests past their deadline are failed
+		const std::chrono::milliseconds EXPIRE_INTERVAL = std::chrono::milliseconds(100);
+
+		RequestTable::RequestTable(size_t capacity)
 		{
-			storeRequest(requestId, std::move(callbacks));
+			size_t slots = 2;
+			while (slots < capacity)
+			{
+				slots <<= 1;
+			}
+			this->_mask = slots - 1;
+			this->_slots.reset(new Slot[slots]);
+		}
 
+		RequestId RequestTable::insert(HTTPResponseHandler&& callbacks, Clock::time_point deadline)
+		{
+			// Ids whose slot is still taken by an older request are skipped, so ids keep increasing
+			for (size_t attempt = 0; attempt <= this->_mask; ++attempt)
+			{
+				RequestId id = this->_next.fetch_add(1, std::memory_order_relaxed);
+				Slot& slot = this->_slots[id & this->_mask];
+				UInt64 expected = 0;
+				if (slot.state.compare_exchange_strong(expected, BUSY, std::memory_order_acquire))
+				{
+					slot.callbacks = std::move(callbacks);
+					slot.deadline.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+					slot.state.store(id, std::memory_order_release);
+					this->_size.fetch_add(1, std::memory_order_relaxed);
+					return id;
+				}
+			}
+			return 0;
+		}
+
+		bool RequestTable::take(RequestId id, HTTPResponseHandler& callbacks)
+		{
+			Slot& slot = this->_slots[id & this->_mask];
+			UInt64 expected = id;
+			if ((id == 0) || !slot.state.compare_exchange_strong(expected, BUSY, std::memory_order_acquire))
+			{
+				return false;
+			}
+			callbacks = std::move(slot.callbacks);
+			slot.callbacks = HTTPResponseHandler();
+			slot.state.store(0, std::memory_order_release);
+			this->_size.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		void RequestTable::expire(Clock::time_point now, const FnMut<void(RequestId, HTTPResponseHandler&)>& on_expired)
+		{
+			if (this->size() == 0)
+			{
+				return;
+			}
+
+			for (size_t i = 0; i <= this->_mask; ++i)
+			{
+				Slot& slot = this->_slots[i];
+				UInt64 id = slot.state.load(std::memory_order_acquire);
+				if ((id == 0) || (id == BUSY) || (slot.deadline.load(std::memory_order_relaxed) > now.time_since_epoch().count()))
+				{
+					continue;
+				}
+
+				// The slot may have moved on to another request since, then take() fails
+				HTTPResponseHandler callbacks;
+				if (this->take(id, callbacks))
+				{
+					on_expired(id, callbacks);
+				}
+			}
+		}
+
+		RequestId Sender::send(
+			const Request& request,
+			HTTPDoneHandlerPtr&& onDone,
+			HTTPProcessHandlerPtr&& onProcess,
+			HTTPFailHandlerPtr&& onFail,
+			HTTPErrorHandlerPtr&& OnError)
+		{
+			auto timeout = (request.timeout > std::chrono::milliseconds::zero()) ? request.timeout : this->_timeout;
+			HTTPErrorHandlerPtr error = OnError;
+			RequestId requestId = this->_requests.insert(
+				HTTPResponseHandler(std::move(onDone), std::move(onFail), std::move(OnError), std::move(onProcess)),
+				RequestTable::Clock::now() + timeout);
+			if (requestId == 0)
+			{
+				std::runtime_error e("too many HTTP requests in flight");
+				LOGERROR("%s", e.what());
+				if (error)
+				{
+					(*error)(requestId, e);
+				}
+				return 0;
+			}
+
+			if (!this->_expiring.exchange(true))
+			{
+				this->_expire_timer = RepeatToQueue(EXPIRE_INTERVAL, [this]() { this->expire(); });
+			}
+
+			sendRequest(requestId, request);
+			return requestId;
+		}
+
+		void Sender::sendRequest(RequestId requestId, const Request& request)
+		{
 			auto do_http_request = [=, this]()
 				{
 					Response response = _http_request(request, this->_url_base, this->_proxy_host, this->_proxy_port);
+					if (this->_observer)
+					{
+						this->_observer(response);
+					}
 
 					bool success = response.code == 0 && response.status / 100 == 2;
 
-					InvokeToQueue([=, this]() {
+					// Capture only what the completion needs, so it fits a PooledTask
+					InvokeToQueue([this, requestId, success, response = std::move(response)]() {
 						HTTPResponseHandler h;
+						if (!this->_requests.take(requestId, h))
 						{
-							std::lock_guard<std::mutex> lock(_queue_mutex);
-							auto it = _parserMap.find(requestId);
-							if (it != _parserMap.cend()) {
-								h = it->second;
-								_parserMap.erase(it);
-							}
+							// Timed out or cancelled in the meantime
+							return;
 						}
 						try
 						{
@@ -125,41 +400,66 @@ namespace Keen
 						}
 						catch (const std::exception& e)
 						{
-							LOGERROR("%s", exception_detail(e, request).c_str());
+							LOGERROR("%s", exception_detail(e, requestId, response).c_str());
 
 							if (h.onError) {
-								Error error(response.code, response.status, response.reason);
 								(*h.onError)(requestId, e);
 							}
 						}
-
-						unregisterRequest(requestId);
 					});
 				};
 
-			ThreadPool::get_instance().enqueue(do_http_request);
+			ThreadPool::get_instance().post(std::move(do_http_request));
+		}
+
+		void Sender::expire()
+		{
+			this->_requests.expire(RequestTable::Clock::now(), [](RequestId requestId, HTTPResponseHandler& h) {
+				if (h.onFail)
+				{
+					(*h.onFail)(requestId, Error(0, 408, "request timed out"));
+				}
+			});
 		}
 
 		Response Sender::sync_request(const Request& request) noexcept {
 			Response response = _http_request(request, this->_url_base, this->_proxy_host, this->_proxy_port);
+			if (this->_observer)
+			{
+				this->_observer(response);
+			}
 
 			return response;
 		}
 
-		void Sender::cancel(const AString& requestId)
+		void Sender::set_response_observer(FnMut<void(const Response&)> observer)
+		{
+			this->_observer = std::move(observer);
+		}
+
+		void Sender::cancel(RequestId requestId)
+		{
+			HTTPResponseHandler h;
+			this->_requests.take(requestId, h);
+		}
+
+		void Sender::set_timeout(std::chrono::milliseconds timeout)
 		{
-			unregisterRequest(requestId);
+			this->_timeout = timeout;
 		}
 
 		Sender::Sender() noexcept
-			: _url_base(), _proxy_host(), _proxy_port(0) {
+			: _url_base(), _proxy_host(), _proxy_port(0)
+			, _requests(MAX_REQUESTS_IN_FLIGHT)
+			, _timeout(std::chrono::seconds(30))
+			, _expiring(false)
+		{
 
 		}
 
 		Sender::~Sender()
 		{
-			std::lock_guard<std::mutex> lock(_queue_mutex);
-			_parserMap.clear();
+			this->_expire_timer.cancel();
 		}
 
 		void Sender::init(
@@ -171,15 +471,5 @@ namespace Keen
 			this->_proxy_host = proxy_host;
 			this->_proxy_port = proxy_port;
 		}
-
-		void Sender::storeRequest(const AString& requestId, HTTPResponseHandler&& callbacks) {
-			std::lock_guard<std::mutex> lock(_queue_mutex);
-			_parserMap.emplace(requestId, std::move(callbacks));
-		}
-
-		void Sender::unregisterRequest(const AString& requestId) {
-			std::lock_guard<std::mutex> lock(_queue_mutex);
-			_parserMap.erase(requestId);
-		}
 	}
 }
@@ -8,6 +8,45 @@ namespace Keen
 	namespace api
 	{
 		class HTTPAbstractDoneHandler;
+
+		/** Callbacks of the requests in flight, in a fixed number of slots indexed by request id.
+		Insert, take and expire never lock: a slot is claimed and released with a CAS on its state, which holds
+		the id of the request in it, 0 when free, or BUSY while a thread fills or empties it. */
+		class RequestTable
+		{
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			/** The capacity is rounded up to a power of two. */
+			explicit RequestTable(size_t capacity);
+
+			/** Stores the callbacks under a new id. Returns 0 if every slot is in use. */
+			RequestId insert(HTTPResponseHandler&& callbacks, Clock::time_point deadline);
+
+			/** Removes the request's callbacks into callbacks. Returns false if it already completed, timed out or was cancelled. */
+			bool take(RequestId id, HTTPResponseHandler& callbacks);
+
+			/** Takes every request whose deadline has passed and hands it to on_expired. */
+			void expire(Clock::time_point now, const FnMut<void(RequestId, HTTPResponseHandler&)>& on_expired);
+
+			size_t size() const { return this->_size.load(std::memory_order_relaxed); }
+
+		private:
+			static constexpr UInt64 BUSY = ~static_cast<UInt64>(0);
+
+			struct alignas(64) Slot
+			{
+				std::atomic<UInt64> state = 0;
+				std::atomic<Clock::rep> deadline = 0;
+				HTTPResponseHandler callbacks;
+			};
+
+			std::unique_ptr<Slot[]> _slots;
+			size_t _mask;
+			std::atomic<UInt64> _next = 1;
+			std::atomic<size_t> _size = 0;
+		};
+
 		class KEEN_API_EXPORT Sender
 		{
 		public:
@@ -28,7 +67,7 @@ namespace Keen
 					DoneHandler(Callback handler) : _handler(std::move(handler))
 					{
 					}
-					void operator()([[maybe_unused]] const AString& requestId, const AString& data) override
+					void operator()([[maybe_unused]] RequestId requestId, const AString& data) override
 					{
 						auto handler = std::move(_handler);
 						auto result = Response(data);
@@ -52,7 +91,7 @@ namespace Keen
 						: _handler(std::move(handler))
 					{
 					}
-					void operator()([[maybe_unused]] const AString& requestId, const Error& error) override
+					void operator()([[maybe_unused]] RequestId requestId, const Error& error) override
 					{
 						if (_handler)
 						{
@@ -74,7 +113,7 @@ namespace Keen
 						: _handler(std::move(handler))
 					{
 					}
-					void operator()([[maybe_unused]] const AString& requestId, const std::exception& e) override
+					void operator()([[maybe_unused]] RequestId requestId, const std::exception& e) override
 					{
 						if (_handler)
 						{
@@ -96,7 +135,7 @@ namespace Keen
 						: _handler(std::move(handler))
 					{
 					}
-					void operator()([[maybe_unused]] const AString& requestId, const Process& error) override
+					void operator()([[maybe_unused]] RequestId requestId, const Process& error) override
 					{
 						if (_handler)
 						{
@@ -199,7 +238,7 @@ namespace Keen
 					return *this;
 				}
 
-				AString send()
+				RequestId send()
 				{
 					return sender()->send(
 						_request,
@@ -214,22 +253,25 @@ namespace Keen
 			};
 
 		public:
-			AString send(
+			/** Returns the request's id, or 0 if too many requests are in flight; onError has been called then. */
+			RequestId send(
 				const Request& request,
 				HTTPDoneHandlerPtr&& onDone,
 				HTTPProcessHandlerPtr&& onProcess = nullptr,
 				HTTPFailHandlerPtr&& onFail = nullptr,
-				HTTPErrorHandlerPtr&& OnError = nullptr)
-			{
-				AString requestStr = generateUuid();
-				sendRequest(requestStr, request, HTTPResponseHandler(std::move(onDone), std::move(onFail), std::move(OnError), std::move(onProcess)));
-				return requestStr;
-			}
+				HTTPErrorHandlerPtr&& OnError = nullptr);
+
+			/** Drops the request's callbacks; its response, if it still comes, is ignored. */
+			void cancel(RequestId requestId);
 
-			void cancel(const AString& requestId);
+			/** Timeout of requests that don't set their own. */
+			void set_timeout(std::chrono::milliseconds timeout);
 
 		private:
-			void sendRequest([[maybe_unused]] const AString& requestId, const Request& request, HTTPResponseHandler&& callbacks);
+			void sendRequest(RequestId requestId, const Request& request);
+
+			/** Fails the requests past their deadline, on the main loop. */
+			void expire();
 
 		public:
 			virtual ~Sender();
@@ -246,17 +288,19 @@ namespace Keen
 
 			[[nodiscard]] Response sync_request(const Request& request) noexcept;
 
-		private:
-			void storeRequest([[maybe_unused]] const AString& requestId, HTTPResponseHandler&& callbacks);
-			void unregisterRequest(const AString& requestId);
+			/** Called on the HTTP thread with every response, before its callbacks run. Set it before sending. */
+			void set_response_observer(FnMut<void(const Response&)> observer);
 
 		private:
 			AString _url_base;
 			AString _proxy_host;
 			uint16_t _proxy_port;
+			FnMut<void(const Response&)> _observer;
 
-			std::mutex _queue_mutex;
-			std::map<AString, HTTPResponseHandler> _parserMap;
+			RequestTable _requests;
+			std::chrono::milliseconds _timeout;
+			std::atomic<bool> _expiring;
+			TimerHandle _expire_timer;
 		};
 
 		template <typename Response>
@@ -265,6 +309,12 @@ namespace Keen
 			return AsyncRequestBuilder<Response>(this, request);
 		}
 
+		/** Sends the request over a kept-alive connection of the pool for url_base and proxy, shared by every Sender.
+		If it fails on a reused connection it is sent once more: a GET after any failure, other methods only when the
+		connection could not be made, so nothing of the first attempt reached the server. */
 		KEEN_API_EXPORT Response _http_request(const Request& request, const AString& url_base, const AString& proxy_host = AString(), uint16_t proxy_port = 0);
+
+		/** Limits of every HTTP connection pool: connections per url_base, and how long one may sit idle before it is closed. */
+		KEEN_API_EXPORT void set_http_pool_limits(size_t max_connections, std::chrono::seconds idle_timeout);
 	}
 }
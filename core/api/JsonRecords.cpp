@@ -0,0 +1,183 @@
+#include "Globals.h"
+#include "JsonRecords.h"
+
+namespace Keen
+{
+	namespace api
+	{
+		/** SAX handler behind ParseJsonRecords. Outside a record it only tracks the object keys leading to the
+		current position; inside one it builds the record's Json. */
+		class JsonRecordHandler : public nlohmann::json_sax<Json>
+		{
+		public:
+			JsonRecordHandler(
+				const std::vector<AString>& path,
+				const FnMut<void(Json&)>& on_record,
+				const FnMut<void(const AString&, const Json&)>& on_field)
+				: _path(path)
+				, _on_record(on_record)
+				, _on_field(on_field)
+			{
+			}
+
+			bool null() override { return this->_value(Json()); }
+			bool boolean(bool val) override { return this->_value(Json(val)); }
+			bool number_integer(number_integer_t val) override { return this->_value(Json(val)); }
+			bool number_unsigned(number_unsigned_t val) override { return this->_value(Json(val)); }
+			bool number_float(number_float_t val, const string_t&) override { return this->_value(Json(val)); }
+			bool string(string_t& val) override { return this->_value(Json(std::move(val))); }
+			bool binary(binary_t& val) override { return this->_value(Json::binary(std::move(val))); }
+
+			bool start_object(std::size_t) override { return this->_start(Json::object(), false); }
+			bool end_object() override { return this->_end(); }
+			bool start_array(std::size_t) override { return this->_start(Json::array(), true); }
+			bool end_array() override { return this->_end(); }
+
+			bool key(string_t& val) override
+			{
+				if (this->_building.empty())
+				{
+					this->_frames.back().key = val;
+				}
+				else
+				{
+					this->_key = std::move(val);
+				}
+				return true;
+			}
+
+			bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+			{
+				this->error = ex.what();
+				return false;
+			}
+
+			AString error;
+
+		private:
+			struct Frame
+			{
+				bool array;
+				bool records;    // the array whose elements are records
+				AString key;     // last key read, for objects
+			};
+
+			bool _in_records() const
+			{
+				return !this->_frames.empty() && this->_frames.back().records;
+			}
+
+			/** True if a container opened here sits at _path: every frame is an object entered through the next key. */
+			bool _at_path() const
+			{
+				if (this->_frames.size() != this->_path.size())
+				{
+					return false;
+				}
+				for (size_t i = 0; i < this->_frames.size(); ++i)
+				{
+					if (this->_frames[i].array || (this->_frames[i].key != this->_path[i]))
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			bool _value(Json&& value)
+			{
+				if (!this->_building.empty())
+				{
+					Json& top = *this->_building.back();
+					if (top.is_object())
+						top[this->_key] = std::move(value);
+					else
+						top.push_back(std::move(value));
+				}
+				else if (this->_in_records())
+				{
+					// An array of scalars: each one is a record
+					this->_on_record(value);
+				}
+				else if ((this->_frames.size() == 1) && !this->_frames[0].array && this->_on_field)
+				{
+					this->_on_field(this->_frames[0].key, value);
+				}
+				return true;
+			}
+
+			bool _start(Json&& container, bool array)
+			{
+				if (!this->_building.empty())
+				{
+					Json& top = *this->_building.back();
+					if (top.is_object())
+					{
+						Json& child = top[this->_key];
+						child = std::move(container);
+						this->_building.push_back(&child);
+					}
+					else
+					{
+						top.push_back(std::move(container));
+						this->_building.push_back(&top.back());
+					}
+				}
+				else if (this->_in_records())
+				{
+					this->_record = std::move(container);
+					this->_building.push_back(&this->_record);
+				}
+				else
+				{
+					this->_frames.push_back({ array, array && this->_at_path(), AString() });
+				}
+				return true;
+			}
+
+			bool _end()
+			{
+				if (!this->_building.empty())
+				{
+					this->_building.pop_back();
+					if (this->_building.empty())
+					{
+						this->_on_record(this->_record);
+						this->_record = Json();
+					}
+				}
+				else
+				{
+					this->_frames.pop_back();
+				}
+				return true;
+			}
+
+			const std::vector<AString>& _path;
+			const FnMut<void(Json&)>& _on_record;
+			const FnMut<void(const AString&, const Json&)>& _on_field;
+
+			std::vector<Frame> _frames;
+
+			Json _record;
+			std::vector<Json*> _building;
+			AString _key;
+		};
+
+		bool ParseJsonRecords(
+			const AString& body,
+			const std::vector<AString>& path,
+			const FnMut<void(Json& record)>& on_record,
+			const FnMut<void(const AString& key, const Json& value)>& on_field,
+			AString* error)
+		{
+			JsonRecordHandler handler(path, on_record, on_field);
+			bool ok = Json::sax_parse(body, &handler);
+			if (!ok && error)
+			{
+				*error = handler.error;
+			}
+			return ok;
+		}
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+namespace Keen
+{
+	namespace api
+	{
+		/** Parses a JSON document without building it as a whole.
+		Every element of the array found under path (object keys from the root, empty for a root array) is built on
+		its own and handed to on_record, then dropped, so a multi-MB reply such as an exchange's instrument list
+		never exists as one Json tree. Scalar fields of the root object (e.g. "code", "msg") go to on_field.
+		Returns false, with the reason in error if given, when the body is not valid JSON; records already handed
+		out stay handed out.
+		The body itself is still received whole: the pooled sender collects it before any callback runs, although
+		httplib could hand it over in pieces through a ContentReceiver. */
+		KEEN_API_EXPORT bool ParseJsonRecords(
+			const AString& body,
+			const std::vector<AString>& path,
+			const FnMut<void(Json& record)>& on_record,
+			const FnMut<void(const AString& key, const Json& value)>& on_field = nullptr,
+			AString* error = nullptr);
+	}
+}
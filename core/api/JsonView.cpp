@@ -0,0 +1,363 @@
+#include "Globals.h"
+#include "JsonView.h"
+
+#include <charconv>
+
+namespace Keen
+{
+	namespace api
+	{
+		static const char* SkipSpace(const char* p, const char* end)
+		{
+			while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')))
+			{
+				++p;
+			}
+			return p;
+		}
+
+		/** Past the closing quote of the string opening at p, nullptr if it isn't closed. */
+		static const char* SkipString(const char* p, const char* end)
+		{
+			for (++p; p < end; ++p)
+			{
+				if (*p == '\\')
+				{
+					++p;
+				}
+				else if (*p == '"')
+				{
+					return p + 1;
+				}
+			}
+			return nullptr;
+		}
+
+		/** Past the value starting at p, nullptr if it is cut short. */
+		static const char* SkipValue(const char* p, const char* end)
+		{
+			if (p >= end)
+			{
+				return nullptr;
+			}
+			if (*p == '"')
+			{
+				return SkipString(p, end);
+			}
+			if ((*p == '{') || (*p == '['))
+			{
+				int depth = 0;
+				while (p < end)
+				{
+					switch (*p)
+					{
+						case '"':
+						{
+							p = SkipString(p, end);
+							if (!p)
+							{
+								return nullptr;
+							}
+							continue;
+						}
+						case '{':
+						case '[':
+						{
+							++depth;
+							break;
+						}
+						case '}':
+						case ']':
+						{
+							if (--depth == 0)
+							{
+								return p + 1;
+							}
+							break;
+						}
+					}
+					++p;
+				}
+				return nullptr;
+			}
+			// Number or literal
+			while ((p < end) && (*p != ',') && (*p != '}') && (*p != ']')
+				&& (*p != ' ') && (*p != '\t') && (*p != '\n') && (*p != '\r'))
+			{
+				++p;
+			}
+			return p;
+		}
+
+		/** Number text from a number or a string holding one. */
+		static std::string_view NumberText(const JsonView& view)
+		{
+			return view.is_string() ? view.str() : view.raw();
+		}
+
+		static void AppendUtf8(AString& out, unsigned code)
+		{
+			if (code < 0x80)
+			{
+				out += static_cast<char>(code);
+			}
+			else if (code < 0x800)
+			{
+				out += static_cast<char>(0xc0 | (code >> 6));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			}
+			else if (code < 0x10000)
+			{
+				out += static_cast<char>(0xe0 | (code >> 12));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			}
+			else
+			{
+				out += static_cast<char>(0xf0 | (code >> 18));
+				out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			}
+		}
+
+		static bool ParseHex4(std::string_view text, size_t pos, unsigned& code)
+		{
+			if (pos + 4 > text.size())
+			{
+				return false;
+			}
+			auto res = std::from_chars(text.data() + pos, text.data() + pos + 4, code, 16);
+			return (res.ec == std::errc()) && (res.ptr == text.data() + pos + 4);
+		}
+
+		JsonView::JsonView(std::string_view text)
+		{
+			const char* begin = SkipSpace(text.data(), text.data() + text.size());
+			const char* end = SkipValue(begin, text.data() + text.size());
+			if (end)
+			{
+				this->_text = std::string_view(begin, static_cast<size_t>(end - begin));
+			}
+		}
+
+		bool JsonView::is_number() const
+		{
+			return !this->_text.empty() && ((this->_text[0] == '-') || ((this->_text[0] >= '0') && (this->_text[0] <= '9')));
+		}
+
+		bool JsonView::_next(size_t& pos, std::string_view& key, JsonView& value) const
+		{
+			const char* begin = this->_text.data();
+			const char* end = begin + this->_text.size() - 1;  // the closing bracket
+			const char* p = SkipSpace(begin + pos, end);
+			if ((p < end) && (*p == ',') && (pos > 1))
+			{
+				p = SkipSpace(p + 1, end);
+			}
+			if (p >= end)
+			{
+				return false;
+			}
+
+			if (this->is_object())
+			{
+				const char* key_end = (*p == '"') ? SkipString(p, end) : nullptr;
+				if (!key_end)
+				{
+					return false;
+				}
+				key = std::string_view(p + 1, static_cast<size_t>(key_end - p - 2));
+				p = SkipSpace(key_end, end);
+				if ((p >= end) || (*p != ':'))
+				{
+					return false;
+				}
+				p = SkipSpace(p + 1, end);
+			}
+
+			const char* value_end = SkipValue(p, end);
+			if (!value_end || (value_end == p))
+			{
+				return false;
+			}
+			value = JsonView(p, value_end);
+			pos = static_cast<size_t>(value_end - begin);
+			return true;
+		}
+
+		JsonView JsonView::operator[](std::string_view key) const
+		{
+			if (this->is_object())
+			{
+				for (auto it = this->begin(); it != this->end(); ++it)
+				{
+					if (it.key() == key)
+					{
+						return *it;
+					}
+				}
+			}
+			return JsonView();
+		}
+
+		JsonView JsonView::operator[](size_t index) const
+		{
+			if (this->is_array())
+			{
+				for (const JsonView& element : *this)
+				{
+					if (index-- == 0)
+					{
+						return element;
+					}
+				}
+			}
+			return JsonView();
+		}
+
+		size_t JsonView::size() const
+		{
+			size_t count = 0;
+			for (auto it = this->begin(); it != this->end(); ++it)
+			{
+				++count;
+			}
+			return count;
+		}
+
+		std::string_view JsonView::str() const
+		{
+			if (!this->is_string())
+			{
+				return std::string_view();
+			}
+			return this->_text.substr(1, this->_text.size() - 2);
+		}
+
+		AString JsonView::get_string() const
+		{
+			std::string_view text = this->str();
+			if (text.find('\\') == std::string_view::npos)
+			{
+				return AString(text);
+			}
+
+			AString out;
+			out.reserve(text.size());
+			for (size_t i = 0; i < text.size(); ++i)
+			{
+				if ((text[i] != '\\') || (i + 1 >= text.size()))
+				{
+					out += text[i];
+					continue;
+				}
+				char c = text[++i];
+				switch (c)
+				{
+					case 'b': out += '\b'; break;
+					case 'f': out += '\f'; break;
+					case 'n': out += '\n'; break;
+					case 'r': out += '\r'; break;
+					case 't': out += '\t'; break;
+					case 'u':
+					{
+						unsigned code;
+						if (!ParseHex4(text, i + 1, code))
+						{
+							out += c;
+							break;
+						}
+						i += 4;
+						// A surrogate pair spells one code point
+						unsigned low;
+						if ((code >= 0xd800) && (code < 0xdc00) && (i + 2 < text.size()) && (text[i + 1] == '\\')
+							&& (text[i + 2] == 'u') && ParseHex4(text, i + 3, low) && (low >= 0xdc00) && (low < 0xe000))
+						{
+							code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+							i += 6;
+						}
+						AppendUtf8(out, code);
+						break;
+					}
+					default: out += c; break;  // \" \\ \/
+				}
+			}
+			return out;
+		}
+
+		double JsonView::get_double(double fallback) const
+		{
+			std::string_view text = NumberText(*this);
+			if (text.empty())
+			{
+				return fallback;
+			}
+#if defined(__cpp_lib_to_chars)
+			double result;
+			auto res = std::from_chars(text.data(), text.data() + text.size(), result);
+			return (res.ec == std::errc()) ? result : fallback;
+#else
+			// No floating point from_chars in this library, strtod needs the text terminated
+			char buffer[64];
+			if (text.size() >= sizeof(buffer))
+			{
+				return fallback;
+			}
+			memcpy(buffer, text.data(), text.size());
+			buffer[text.size()] = 0;
+			char* parsed_end;
+			double result = std::strtod(buffer, &parsed_end);
+			return (parsed_end != buffer) ? result : fallback;
+#endif
+		}
+
+		long long JsonView::get_int(long long fallback) const
+		{
+			std::string_view text = NumberText(*this);
+			long long result;
+			auto res = std::from_chars(text.data(), text.data() + text.size(), result);
+			if (res.ec != std::errc())
+			{
+				return fallback;
+			}
+			if ((res.ptr != text.data() + text.size()) && ((*res.ptr == '.') || (*res.ptr == 'e') || (*res.ptr == 'E')))
+			{
+				// Written as a float, e.g. 1e3
+				return static_cast<long long>(this->get_double(static_cast<double>(fallback)));
+			}
+			return result;
+		}
+
+		bool JsonView::get_bool(bool fallback) const
+		{
+			if (this->_text == "true")
+			{
+				return true;
+			}
+			if (this->_text == "false")
+			{
+				return false;
+			}
+			return fallback;
+		}
+
+		AString JsonView::value(std::string_view key, const char* fallback) const
+		{
+			JsonView member = (*this)[key];
+			return member.is_string() ? member.get_string() : AString(fallback);
+		}
+
+		double JsonView::value(std::string_view key, double fallback) const
+		{
+			JsonView member = (*this)[key];
+			return member.is_number() ? member.get_double(fallback) : fallback;
+		}
+
+		long long JsonView::value(std::string_view key, long long fallback) const
+		{
+			JsonView member = (*this)[key];
+			return member.is_number() ? member.get_int(fallback) : fallback;
+		}
+	}
+}
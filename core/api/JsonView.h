@@ -0,0 +1,131 @@
+#pragma once
+
+namespace Keen
+{
+	namespace api
+	{
+		/** Read-only view of a JSON value inside a text, decoded on demand.
+		Nothing is parsed up front: a lookup walks the text from the start of the value, skipping over what it
+		doesn't need without building it, and numbers are only converted when asked for. Meant for hot message
+		handlers that read a handful of fields, where building a Json tree costs more than the fields themselves.
+		The text must outlive the view. Missing or malformed values come back as null views and fallbacks instead
+		of exceptions; values skipped over are not validated. */
+		class KEEN_API_EXPORT JsonView
+		{
+		public:
+			class iterator;
+
+			JsonView() = default;
+
+			/** A view of the whole document in text. */
+			explicit JsonView(std::string_view text);
+
+			bool is_null() const { return this->_text.empty() || (this->_text[0] == 'n'); }
+			bool is_object() const { return !this->_text.empty() && (this->_text[0] == '{'); }
+			bool is_array() const { return !this->_text.empty() && (this->_text[0] == '['); }
+			bool is_string() const { return !this->_text.empty() && (this->_text[0] == '"'); }
+			bool is_bool() const { return !this->_text.empty() && ((this->_text[0] == 't') || (this->_text[0] == 'f')); }
+			bool is_number() const;
+
+			/** The member of an object, a null view if there is none. */
+			JsonView operator[](std::string_view key) const;
+
+			/** The element of an array, a null view if there is none. */
+			JsonView operator[](size_t index) const;
+
+			bool contains(std::string_view key) const { return !(*this)[key]._text.empty(); }
+
+			/** Number of elements of an array or members of an object, walks the whole value. */
+			size_t size() const;
+
+			bool empty() const { return this->size() == 0; }
+
+			/** The value's text as it appears in the document. */
+			std::string_view raw() const { return this->_text; }
+
+			/** A string's contents without the quotes and with escapes left as they are; fine for ids, symbols and
+			numbers, use get_string for text that may carry escapes. Empty for anything but a string. */
+			std::string_view str() const;
+
+			/** A string with its escapes decoded. Empty for anything but a string. */
+			AString get_string() const;
+
+			/** A number, or a string holding one as exchanges send prices. fallback for anything else. */
+			double get_double(double fallback = 0) const;
+
+			/** An integer, or a string holding one. fallback for anything else. */
+			long long get_int(long long fallback = 0) const;
+
+			bool get_bool(bool fallback = false) const;
+
+			/** Member lookups with a fallback, in the manner of Json::value. */
+			AString value(std::string_view key, const char* fallback) const;
+			double value(std::string_view key, double fallback) const;
+			long long value(std::string_view key, long long fallback) const;
+
+			/** Iterates the elements of an array, or the members of an object with iterator::key. */
+			iterator begin() const;
+			iterator end() const;
+
+		private:
+			JsonView(const char* begin, const char* end)
+				: _text(begin, static_cast<size_t>(end - begin))
+			{
+			}
+
+			/** Steps to the next element or member from pos (an offset into _text), false past the last one. */
+			bool _next(size_t& pos, std::string_view& key, JsonView& value) const;
+
+			std::string_view _text;
+		};
+
+		class KEEN_API_EXPORT JsonView::iterator
+		{
+		public:
+			iterator() = default;
+
+			explicit iterator(const JsonView& parent)
+				: _parent(parent)
+				, _pos(1)
+			{
+				++(*this);
+			}
+
+			const JsonView& operator*() const { return this->_value; }
+			const JsonView* operator->() const { return &this->_value; }
+
+			/** The member's key as it appears in the document, empty for array elements. */
+			std::string_view key() const { return this->_key; }
+
+			iterator& operator++()
+			{
+				if ((this->_pos != END) && !this->_parent._next(this->_pos, this->_key, this->_value))
+				{
+					this->_pos = END;
+				}
+				return *this;
+			}
+
+			bool operator==(const iterator& other) const { return this->_pos == other._pos; }
+			bool operator!=(const iterator& other) const { return this->_pos != other._pos; }
+
+		private:
+			static constexpr size_t END = std::string_view::npos;
+
+			JsonView _parent;  // a copy, so iterating a temporary view is fine
+			size_t _pos = END;
+			std::string_view _key;
+			JsonView _value;
+		};
+
+		inline JsonView::iterator JsonView::begin() const
+		{
+			return (this->is_object() || this->is_array()) ? iterator(*this) : iterator();
+		}
+
+		inline JsonView::iterator JsonView::end() const
+		{
+			return iterator();
+		}
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+/** A bounded lock-free ring buffer (Dmitry Vyukov's bounded MPMC queue).
+Every cell carries a sequence number telling producers and consumers whose turn it is, so neither side takes a lock.
+Used with many producers and a single regular consumer; a producer may still call TryPop(), e.g. to evict the oldest item when full. */
+template <typename ItemType>
+class cLockFreeQueue
+{
+public:
+
+	/** Creates a queue holding at least a_Capacity items; the capacity is rounded up to a power of two. */
+	explicit cLockFreeQueue(size_t a_Capacity)
+	{
+		size_t Capacity = 2;
+		while (Capacity < a_Capacity)
+		{
+			Capacity <<= 1;
+		}
+		m_Mask = Capacity - 1;
+		m_Buffer.reset(new cCell[Capacity]);
+		for (size_t i = 0; i < Capacity; ++i)
+		{
+			m_Buffer[i].m_Sequence.store(i, std::memory_order_relaxed);
+		}
+		m_EnqueuePos.store(0, std::memory_order_relaxed);
+		m_DequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	/** Appends the item. Returns false, leaving a_Item untouched, if the queue is full. */
+	template <typename T>
+	bool TryPush(T && a_Item)
+	{
+		cCell * Cell;
+		size_t Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell = &m_Buffer[Pos & m_Mask];
+			size_t Seq = Cell->m_Sequence.load(std::memory_order_acquire);
+			intptr_t Diff = static_cast<intptr_t>(Seq) - static_cast<intptr_t>(Pos);
+			if (Diff == 0)
+			{
+				if (m_EnqueuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Pos = m_EnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		Cell->m_Data = std::forward<T>(a_Item);
+		Cell->m_Sequence.store(Pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Removes the oldest item into a_Item. Returns false if the queue is empty. */
+	bool TryPop(ItemType & a_Item)
+	{
+		cCell * Cell;
+		size_t Pos = m_DequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell = &m_Buffer[Pos & m_Mask];
+			size_t Seq = Cell->m_Sequence.load(std::memory_order_acquire);
+			intptr_t Diff = static_cast<intptr_t>(Seq) - static_cast<intptr_t>(Pos + 1);
+			if (Diff == 0)
+			{
+				if (m_DequeuePos.compare_exchange_weak(Pos, Pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (Diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				Pos = m_DequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		a_Item = std::move(Cell->m_Data);
+		Cell->m_Data = ItemType();  // Release whatever the item holds now rather than when the slot is reused
+		Cell->m_Sequence.store(Pos + m_Mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Returns the number of items in the queue. Only a snapshot while other threads push or pop. */
+	size_t SizeApprox(void) const
+	{
+		size_t Enqueue = m_EnqueuePos.load(std::memory_order_relaxed);
+		size_t Dequeue = m_DequeuePos.load(std::memory_order_relaxed);
+		return (Enqueue > Dequeue) ? (Enqueue - Dequeue) : 0;
+	}
+
+	bool IsEmptyApprox(void) const { return SizeApprox() == 0; }
+
+	size_t Capacity(void) const { return m_Mask + 1; }
+
+private:
+
+	struct cCell
+	{
+		std::atomic<size_t> m_Sequence;
+		ItemType m_Data;
+	};
+
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+
+	std::unique_ptr<cCell[]> m_Buffer;
+	size_t m_Mask;
+
+	/** The producer and consumer cursors live on separate cache lines so they don't false-share. */
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_EnqueuePos;
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_DequeuePos;
+
+	DISALLOW_COPY_AND_ASSIGN(cLockFreeQueue);
+};
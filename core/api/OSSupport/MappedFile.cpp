@@ -0,0 +1,185 @@
+#include "Globals.h"
+
+#include "MappedFile.h"
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif  // _WIN32
+
+cMappedFile::cMappedFile(void) :
+	m_Data(nullptr),
+	m_Size(0),
+	m_IsWritable(false),
+	#ifdef _WIN32
+		m_File(INVALID_HANDLE_VALUE),
+		m_Mapping(nullptr)
+	#else
+		m_File(-1)
+	#endif
+{
+}
+
+cMappedFile::~cMappedFile()
+{
+	Close();
+}
+
+bool cMappedFile::Create(const AString & a_FileName, size_t a_Size)
+{
+	ASSERT(!IsOpen());
+	ASSERT(a_Size > 0);
+
+	#ifdef _WIN32
+		m_File = CreateFileA(a_FileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		ULARGE_INTEGER Size;
+		Size.QuadPart = a_Size;
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READWRITE, Size.HighPart, Size.LowPart, nullptr);
+		if (m_Mapping == nullptr)
+		{
+			CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+			return false;
+		}
+		m_Data = static_cast<char *>(MapViewOfFile(m_Mapping, FILE_MAP_WRITE, 0, 0, a_Size));
+	#else
+		m_File = open(a_FileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_File < 0)
+		{
+			return false;
+		}
+		if (ftruncate(m_File, static_cast<off_t>(a_Size)) != 0)
+		{
+			close(m_File);
+			m_File = -1;
+			return false;
+		}
+		void * Data = mmap(nullptr, a_Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0);
+		m_Data = (Data == MAP_FAILED) ? nullptr : static_cast<char *>(Data);
+	#endif
+
+	m_Size = a_Size;
+	m_IsWritable = true;
+	m_FileName = a_FileName;
+	if (m_Data == nullptr)
+	{
+		Close(0);
+		return false;
+	}
+	return true;
+}
+
+bool cMappedFile::OpenRead(const AString & a_FileName)
+{
+	ASSERT(!IsOpen());
+
+	#ifdef _WIN32
+		m_File = CreateFileA(a_FileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER Size;
+		if (!GetFileSizeEx(m_File, &Size) || (Size.QuadPart == 0))
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<size_t>(Size.QuadPart);
+		m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_Mapping != nullptr)
+		{
+			m_Data = static_cast<char *>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	#else
+		m_File = open(a_FileName.c_str(), O_RDONLY);
+		if (m_File < 0)
+		{
+			return false;
+		}
+		struct stat Stat;
+		if ((fstat(m_File, &Stat) != 0) || (Stat.st_size == 0))
+		{
+			Close();
+			return false;
+		}
+		m_Size = static_cast<size_t>(Stat.st_size);
+		void * Data = mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, m_File, 0);
+		m_Data = (Data == MAP_FAILED) ? nullptr : static_cast<char *>(Data);
+	#endif
+
+	m_IsWritable = false;
+	m_FileName = a_FileName;
+	if (m_Data == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void cMappedFile::Close(size_t a_UsedSize)
+{
+	#ifdef _WIN32
+		if (m_Data != nullptr)
+		{
+			UnmapViewOfFile(m_Data);
+		}
+		if (m_Mapping != nullptr)
+		{
+			CloseHandle(m_Mapping);
+			m_Mapping = nullptr;
+		}
+		if (m_File != INVALID_HANDLE_VALUE)
+		{
+			if (m_IsWritable && (a_UsedSize < m_Size))
+			{
+				LARGE_INTEGER Size;
+				Size.QuadPart = static_cast<LONGLONG>(a_UsedSize);
+				SetFilePointerEx(m_File, Size, nullptr, FILE_BEGIN);
+				SetEndOfFile(m_File);
+			}
+			CloseHandle(m_File);
+			m_File = INVALID_HANDLE_VALUE;
+		}
+	#else
+		if (m_Data != nullptr)
+		{
+			munmap(m_Data, m_Size);
+		}
+		if (m_File >= 0)
+		{
+			if (m_IsWritable && (a_UsedSize < m_Size))
+			{
+				if (ftruncate(m_File, static_cast<off_t>(a_UsedSize)) != 0)
+				{
+					LOGWARNING("Cannot truncate mapped file \"%s\"", m_FileName.c_str());
+				}
+			}
+			close(m_File);
+			m_File = -1;
+		}
+	#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+	m_IsWritable = false;
+}
+
+void cMappedFile::Flush(void)
+{
+	if (!m_IsWritable || (m_Data == nullptr))
+	{
+		return;
+	}
+
+	#ifdef _WIN32
+		FlushViewOfFile(m_Data, 0);
+	#else
+		msync(m_Data, m_Size, MS_ASYNC);
+	#endif
+}
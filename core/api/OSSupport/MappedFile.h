@@ -0,0 +1,45 @@
+#pragma once
+
+/** A file mapped into memory, either created at a fixed size for writing or mapped read-only as it is. */
+class KEEN_API_EXPORT cMappedFile
+{
+public:
+
+	cMappedFile(void);
+
+	~cMappedFile();
+
+	/** Creates (or truncates) the file, grows it to a_Size bytes and maps it for writing. Returns false on failure. */
+	bool Create(const AString & a_FileName, size_t a_Size);
+
+	/** Maps an existing file read-only. Returns false on failure or if the file is empty. */
+	bool OpenRead(const AString & a_FileName);
+
+	/** Unmaps the file. A file opened with Create() is cut down to a_UsedSize bytes, unless that is larger than the mapping. */
+	void Close(size_t a_UsedSize = SIZE_MAX);
+
+	/** Asks the OS to write the dirty pages back to disk, without waiting for it. */
+	void Flush(void);
+
+	bool IsOpen(void) const { return (m_Data != nullptr); }
+
+	char * GetData(void) const { return m_Data; }
+
+	size_t GetSize(void) const { return m_Size; }
+
+private:
+
+	char * m_Data;
+	size_t m_Size;
+	bool m_IsWritable;
+	AString m_FileName;
+
+	#ifdef _WIN32
+		HANDLE m_File;
+		HANDLE m_Mapping;
+	#else
+		int m_File;
+	#endif
+
+	DISALLOW_COPY_AND_ASSIGN(cMappedFile);
+} ;
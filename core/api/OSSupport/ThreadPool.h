@@ -1,8 +1,10 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -11,52 +13,177 @@
 #include <functional>
 #include <stdexcept>
 #include "Singleton.h"
+#include "LockFreeQueue.h"
+#include "ThreadTopology.h"
 
+// Work-stealing pool: tasks posted from outside go through a lock-free injection queue,
+// tasks posted from a worker go to that worker's own deque, and idle workers steal from the others.
+// The per-worker deques are plain std::deque behind a mutex each, not lock-free Chase-Lev deques;
+// the owner and a thief only contend when they hit the same worker at once.
 class ThreadPool : public Singleton<ThreadPool>{
 public:
-    ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    using Task = FnMut<void()>;
+
+    // zero takes the worker count of the "http" thread role, or one worker per core
+    ThreadPool(size_t threads = 0);
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::invoke_result<F, Args...>::type>;
+    // fire-and-forget: no packaged_task, no future
+    template<class F>
+    void post(F&& f);
     ~ThreadPool();
 private:
+    // a worker's own tasks; the owner works from the back, thieves take from the front
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+    void submit(Task&& task);
+    bool take(size_t index, Task& task);
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< FnMut<void()> > tasks;
+    std::vector< std::unique_ptr<Worker> > queues;
+
+    // tasks posted from outside the pool, plus the rare overflow when that queue is full
+    cLockFreeQueue<Task> injection;
+    std::mutex overflow_mutex;
+    std::deque<Task> overflow;
+
+    // tasks posted but not yet taken, and workers parked waiting for one; pending is signed because a
+    // worker can take a task before its submitter counted it, which briefly drives it below zero
+    std::atomic<std::ptrdiff_t> pending;
+    std::atomic<size_t> sleepers;
 
-    // synchronization
+    // synchronization, only used to park and wake workers
     std::mutex queue_mutex;
     std::condition_variable condition;
-    bool stop;
+    std::atomic<bool> stop;
+
+    // the pool and worker index of the calling thread, if it is one of our workers
+    static inline thread_local ThreadPool* current_pool = nullptr;
+    static inline thread_local size_t current_index = 0;
 };
 
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false)
+    : injection(4096)
+    , pending(0)
+    , sleepers(0)
+    , stop(false)
 {
+    if (threads == 0)
+        threads = cThreadTopology::GetRole("http").m_Threads;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i)
+        queues.push_back(std::make_unique<Worker>());
     for (size_t i = 0; i < threads; ++i)
-        workers.emplace_back(
-            [this]
-            {
-                for (;;)
-                {
-                    FnMut<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this] { return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-
-                    task();
-                }
-            }
-            );
+        workers.emplace_back([this, i] { this->run(i); });
+}
+
+inline void ThreadPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    cThreadTopology::Apply("http", "kt-http-" + std::to_string(index));
+
+    for (;;)
+    {
+        Task task;
+        if (this->take(index, task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        this->sleepers.fetch_add(1);
+        this->condition.wait(lock,
+            [this] { return this->stop || this->pending.load() > 0; });
+        this->sleepers.fetch_sub(1);
+        if (this->stop && this->pending.load() <= 0)
+            return;
+    }
+}
+
+// own deque first (newest first, it is still warm), then the injection queue, then steal the oldest task of another worker
+inline bool ThreadPool::take(size_t index, Task& task)
+{
+    {
+        Worker& own = *this->queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            this->pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    if (this->injection.TryPop(task))
+    {
+        this->pending.fetch_sub(1);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->overflow_mutex);
+        if (!this->overflow.empty())
+        {
+            task = std::move(this->overflow.front());
+            this->overflow.pop_front();
+            this->pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < this->queues.size(); ++i)
+    {
+        Worker& victim = *this->queues[(index + i) % this->queues.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            this->pending.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ThreadPool::submit(Task&& task)
+{
+    // don't allow enqueueing after stopping the pool
+    if (this->stop)
+        throw std::runtime_error("submit on stopped ThreadPool");
+
+    if (current_pool == this)
+    {
+        Worker& own = *this->queues[current_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.tasks.push_back(std::move(task));
+    }
+    else if (!this->injection.TryPush(std::move(task)))
+    {
+        std::lock_guard<std::mutex> lock(this->overflow_mutex);
+        this->overflow.push_back(std::move(task));
+    }
+
+    // pending is raised after the task is visible, a worker parking right now either sees it or is woken
+    this->pending.fetch_add(1);
+    if (this->sleepers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(this->queue_mutex);
+        this->condition.notify_one();
+    }
 }
 
 // add new work item to the pool
@@ -71,20 +198,18 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     );
 
     std::future<return_type> res = task->get_future();
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-
-        // don't allow enqueueing after stopping the pool
-        if (stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
-
-        tasks.emplace([task]() { (*task)(); });
-    }
-    condition.notify_one();
+    submit([task]() { (*task)(); });
     return res;
 }
 
-// the destructor joins all threads
+// add new work item to the pool, nobody waits for its result
+template<class F>
+void ThreadPool::post(F&& f)
+{
+    submit(Task(std::forward<F>(f)));
+}
+
+// the destructor runs what is left, then joins all threads
 inline ThreadPool::~ThreadPool()
 {
     {
@@ -96,4 +221,4 @@ inline ThreadPool::~ThreadPool()
         worker.join();
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,178 @@
+#include "Globals.h"
+#include "ThreadTopology.h"
+
+#ifndef _WIN32
+	#include <pthread.h>
+	#include <sched.h>
+	#include <sys/resource.h>
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+
+
+
+
+namespace
+{
+	struct cRoleRegistry
+	{
+		std::mutex m_Mutex;
+		std::map<AString, cThreadRole> m_Roles;
+	};
+
+	cRoleRegistry & GetRegistry(void)
+	{
+		static cRoleRegistry Registry;
+		return Registry;
+	}
+
+
+
+
+
+	void SetName(const AString & a_ThreadName)
+	{
+#if defined(_WIN32)
+		std::wstring Name(a_ThreadName.begin(), a_ThreadName.end());
+		SetThreadDescription(GetCurrentThread(), Name.c_str());
+#elif defined(__APPLE__)
+		pthread_setname_np(a_ThreadName.c_str());
+#else
+		// Linux limits thread names to 15 characters
+		pthread_setname_np(pthread_self(), a_ThreadName.substr(0, 15).c_str());
+#endif
+	}
+
+
+
+
+
+	bool SetAffinity(const std::vector<int> & a_Cpus)
+	{
+#if defined(_WIN32)
+		DWORD_PTR Mask = 0;
+		for (int Cpu : a_Cpus)
+		{
+			if (Cpu < static_cast<int>(sizeof(DWORD_PTR) * 8))
+			{
+				Mask |= static_cast<DWORD_PTR>(1) << Cpu;
+			}
+		}
+		return (Mask != 0) && (SetThreadAffinityMask(GetCurrentThread(), Mask) != 0);
+#elif defined(__linux__)
+		cpu_set_t Set;
+		CPU_ZERO(&Set);
+		for (int Cpu : a_Cpus)
+		{
+			if (Cpu < CPU_SETSIZE)
+			{
+				CPU_SET(Cpu, &Set);
+			}
+		}
+		return pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set) == 0;
+#else
+		// No thread affinity API on this platform
+		return false;
+#endif
+	}
+
+
+
+
+
+	bool SetPriority(int a_Priority)
+	{
+#if defined(_WIN32)
+		return SetThreadPriority(GetCurrentThread(), (a_Priority > 0) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_LOWEST) != 0;
+#else
+		if (a_Priority > 0)
+		{
+			sched_param Param{};
+			Param.sched_priority = std::clamp(a_Priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+			return pthread_setschedparam(pthread_self(), SCHED_FIFO, &Param) == 0;
+		}
+	#ifdef __linux__
+		// The nice value of a Linux thread is set through its own thread id
+		return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), std::min(-a_Priority, 19)) == 0;
+	#else
+		return false;
+	#endif
+#endif
+	}
+}
+
+
+
+
+
+void cThreadTopology::SetRole(const AString & a_Role, const cThreadRole & a_Config)
+{
+	auto & Registry = GetRegistry();
+	std::lock_guard<std::mutex> Lock(Registry.m_Mutex);
+	Registry.m_Roles[a_Role] = a_Config;
+}
+
+
+
+
+
+cThreadRole cThreadTopology::GetRole(const AString & a_Role)
+{
+	auto & Registry = GetRegistry();
+	std::lock_guard<std::mutex> Lock(Registry.m_Mutex);
+	auto itr = Registry.m_Roles.find(a_Role);
+	return (itr != Registry.m_Roles.end()) ? itr->second : cThreadRole();
+}
+
+
+
+
+
+void cThreadTopology::Apply(const AString & a_Role, const AString & a_ThreadName)
+{
+	SetName(a_ThreadName);
+
+	cThreadRole Role = GetRole(a_Role);
+	if (!Role.m_Cpus.empty() && !SetAffinity(Role.m_Cpus))
+	{
+		LOGWARNING("Could not pin thread %s to the CPUs of role %s", a_ThreadName.c_str(), a_Role.c_str());
+	}
+	if ((Role.m_Priority != 0) && !SetPriority(Role.m_Priority))
+	{
+		LOGWARNING("Could not set priority %d for thread %s", Role.m_Priority, a_ThreadName.c_str());
+	}
+}
+
+
+
+
+
+std::vector<int> cThreadTopology::ParseCpuList(const AString & a_List)
+{
+	std::vector<int> Cpus;
+	for (const auto & Item : StringSplitAndTrim(a_List, ","))
+	{
+		auto Dash = Item.find('-');
+		int First, Last;
+		if (Dash == AString::npos)
+		{
+			if (!StringToInteger(Item, First))
+			{
+				continue;
+			}
+			Last = First;
+		}
+		else if (!StringToInteger(TrimString(Item.substr(0, Dash)), First) || !StringToInteger(TrimString(Item.substr(Dash + 1)), Last))
+		{
+			continue;
+		}
+
+		for (int Cpu = std::max(First, 0); Cpu <= Last; ++Cpu)
+		{
+			Cpus.push_back(Cpu);
+		}
+	}
+	return Cpus;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/** Where the internal threads of a role run.
+Roles group threads by purpose, e.g. "dispatcher", "network" or "background", so latency-critical threads
+can be kept on their own cores, away from HTTP polling and email. */
+struct cThreadRole
+{
+	/** CPUs the threads may run on, empty leaves them unpinned. */
+	std::vector<int> m_Cpus;
+
+	/** Above zero a real-time (SCHED_FIFO / time-critical) priority, below zero lowers the priority (-5 is nice 5), zero leaves it unchanged. */
+	int m_Priority = 0;
+
+	/** Worker count for a pool of this role, zero keeps the pool's own default. */
+	size_t m_Threads = 0;
+};
+
+class KEEN_API_EXPORT cThreadTopology
+{
+public:
+
+	/** Configures a role. Threads pick up the configuration when they start, so call this before starting them. */
+	static void SetRole(const AString & a_Role, const cThreadRole & a_Config);
+
+	/** Returns the role's configuration, or a default one if the role was never configured. */
+	static cThreadRole GetRole(const AString & a_Role);
+
+	/** Names the calling thread and applies its role's CPU set and priority.
+	Failures (e.g. no permission for real-time priority) are logged and the thread keeps running as it was. */
+	static void Apply(const AString & a_Role, const AString & a_ThreadName);
+
+	/** Parses a CPU list such as "2", "0-3" or "0-1,6". Invalid entries are skipped. */
+	static std::vector<int> ParseCpuList(const AString & a_List);
+};
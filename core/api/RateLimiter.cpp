@@ -0,0 +1,399 @@
+#include "Globals.h"
+#include "RateLimiter.h"
+
+#include <future>
+
+namespace Keen
+{
+	namespace api
+	{
+		// A 429 without Retry-After holds requests this long; a 418 means the IP is already banned
+		const std::chrono::seconds DEFAULT_RETRY_AFTER_429 = std::chrono::seconds(1);
+		const std::chrono::seconds DEFAULT_RETRY_AFTER_418 = std::chrono::seconds(60);
+
+		class RateLimiter::Impl : public std::enable_shared_from_this<RateLimiter::Impl>
+		{
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			struct Bucket
+			{
+				double capacity = 0;
+				double tokens = 0;
+				double per_ms = 0;  // refill rate
+			};
+
+			struct Rule
+			{
+				AString method;
+				AString prefix;
+				AString bucket;
+				UInt32 weight;
+				RequestPriority priority;
+			};
+
+			using Costs = std::vector<std::pair<Bucket*, double>>;
+
+			struct Waiting
+			{
+				Costs costs;
+				FnMut<void()> send;
+			};
+
+			/** The rule of the bucket with the longest prefix matching the request, nullptr if none matches. */
+			const Rule* rule_of(const AString& bucket, const AString& method, const AString& path) const
+			{
+				const Rule* best = nullptr;
+				for (const Rule& rule : this->rules)
+				{
+					if ((rule.bucket == bucket)
+						&& (rule.method.empty() || (rule.method == method))
+						&& (path.compare(0, rule.prefix.size(), rule.prefix) == 0)
+						&& (!best || (rule.prefix.size() > best->prefix.size())))
+					{
+						best = &rule;
+					}
+				}
+				return best;
+			}
+
+			Costs costs_of(const AString& method, const AString& path)
+			{
+				Costs costs;
+				for (auto& [name, bucket] : this->buckets)
+				{
+					const Rule* rule = this->rule_of(name, method, path);
+					if (rule && (rule->weight > 0))
+					{
+						costs.emplace_back(&bucket, rule->weight);
+					}
+				}
+				return costs;
+			}
+
+			RequestPriority priority_of(const AString& method, const AString& path) const
+			{
+				for (auto& [name, bucket] : this->buckets)
+				{
+					const Rule* rule = this->rule_of(name, method, path);
+					if (rule && (rule->priority == RequestPriority::ORDER))
+					{
+						return RequestPriority::ORDER;
+					}
+				}
+				return RequestPriority::QUERY;
+			}
+
+			void refill(Clock::time_point now)
+			{
+				double elapsed = std::chrono::duration<double, std::milli>(now - this->last_refill).count();
+				this->last_refill = now;
+				for (auto& [name, bucket] : this->buckets)
+				{
+					bucket.tokens = std::min(bucket.capacity, bucket.tokens + elapsed * bucket.per_ms);
+				}
+			}
+
+			/** Tokens the request needs in the bucket, including what queries leave for orders. */
+			double needed(const Bucket& bucket, double cost, RequestPriority priority) const
+			{
+				double floor = (priority == RequestPriority::QUERY) ? this->reserve * bucket.capacity : 0;
+				// A request bigger than the bucket goes once the bucket is full
+				return std::min(cost + floor, bucket.capacity);
+			}
+
+			/** Time until the request fits, zero if it fits now. */
+			Clock::duration wait_for(const Costs& costs, RequestPriority priority, Clock::time_point now) const
+			{
+				if (now < this->blocked_until)
+				{
+					return this->blocked_until - now;
+				}
+
+				double wait_ms = 0;
+				for (auto& [bucket, cost] : costs)
+				{
+					double missing = this->needed(*bucket, cost, priority) - bucket->tokens;
+					if (missing > 0)
+					{
+						wait_ms = std::max(wait_ms, missing / bucket->per_ms);
+					}
+				}
+				return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(wait_ms));
+			}
+
+			bool try_take(const Costs& costs, RequestPriority priority, Clock::time_point now)
+			{
+				if (this->wait_for(costs, priority, now) > Clock::duration::zero())
+				{
+					return false;
+				}
+				this->take(costs);
+				return true;
+			}
+
+			/** Charges the request, even past what the buckets hold; later requests wait for the debt to refill. */
+			void take(const Costs& costs)
+			{
+				for (auto& [bucket, cost] : costs)
+				{
+					bucket->tokens -= cost;
+				}
+			}
+
+			/** True if the query can go ahead of the order: it uses none of the buckets the order is waiting for. */
+			bool may_overtake(const Costs& query, const Costs& order) const
+			{
+				for (auto& [bucket, cost] : order)
+				{
+					if (bucket->tokens >= this->needed(*bucket, cost, RequestPriority::ORDER))
+					{
+						continue;
+					}
+					for (auto& [other, other_cost] : query)
+					{
+						if (other == bucket)
+						{
+							return false;
+						}
+					}
+				}
+				return true;
+			}
+
+			/** Takes every waiting request that fits now, in priority order, and arms the timer for the rest. */
+			std::vector<FnMut<void()>> take_ready(Clock::time_point now)
+			{
+				std::vector<FnMut<void()>> ready;
+				auto& orders = this->waiting[static_cast<size_t>(RequestPriority::ORDER)];
+				auto& queries = this->waiting[static_cast<size_t>(RequestPriority::QUERY)];
+
+				while (!orders.empty() && this->try_take(orders.front().costs, RequestPriority::ORDER, now))
+				{
+					ready.push_back(std::move(orders.front().send));
+					orders.pop_front();
+				}
+				while (!queries.empty()
+					&& (orders.empty() || this->may_overtake(queries.front().costs, orders.front().costs))
+					&& this->try_take(queries.front().costs, RequestPriority::QUERY, now))
+				{
+					ready.push_back(std::move(queries.front().send));
+					queries.pop_front();
+				}
+
+				if (!orders.empty() || !queries.empty())
+				{
+					auto wait = Clock::duration::max();
+					if (!orders.empty())
+					{
+						wait = std::min(wait, this->wait_for(orders.front().costs, RequestPriority::ORDER, now));
+					}
+					if (!queries.empty())
+					{
+						wait = std::min(wait, this->wait_for(queries.front().costs, RequestPriority::QUERY, now));
+					}
+					auto delay = std::max(std::chrono::ceil<std::chrono::milliseconds>(wait), std::chrono::milliseconds(1));
+					this->arm(now + delay, delay);
+				}
+				return ready;
+			}
+
+			/** Arms the drain timer to fire after delay, unless it already fires by deadline. An order queued behind a
+			query that waits for a long refill may need a much shorter one, so an earlier deadline replaces the armed timer. */
+			void arm(Clock::time_point deadline, std::chrono::milliseconds delay)
+			{
+				if (this->timer.is_valid() && (this->timer_deadline <= deadline + std::chrono::milliseconds(1)))
+				{
+					return;
+				}
+
+				this->timer.cancel();
+				this->timer_deadline = deadline;
+				UInt64 generation = ++this->timer_generation;
+				std::weak_ptr<Impl> weak = this->shared_from_this();
+				this->timer = DelayToQueue(delay, [weak, generation]() {
+					if (auto self = weak.lock())
+					{
+						self->drain(generation);
+					}
+				});
+			}
+
+			void set_used(const AString& bucket, UInt32 used)
+			{
+				auto b = this->buckets.find(bucket);
+				if (b != this->buckets.end())
+				{
+					// Only ever lower our count, requests still in flight aren't counted by the exchange yet
+					b->second.tokens = std::min(b->second.tokens, b->second.capacity - used);
+				}
+			}
+
+			void drain(UInt64 generation)
+			{
+				std::vector<FnMut<void()>> ready;
+				{
+					std::lock_guard<std::mutex> lock(this->mutex);
+					// A timer replaced after it had already fired leaves the armed one alone
+					if (generation == this->timer_generation)
+					{
+						this->timer = TimerHandle();
+					}
+					auto now = Clock::now();
+					this->refill(now);
+					ready = this->take_ready(now);
+				}
+				for (auto& send : ready)
+				{
+					send();
+				}
+			}
+
+			mutable std::mutex mutex;
+			std::map<AString, Bucket> buckets;
+			std::vector<Rule> rules;
+			std::vector<std::pair<AString, AString>> usage_headers;
+			double reserve = 0.1;
+			Clock::time_point last_refill = Clock::now();
+			Clock::time_point blocked_until;
+			std::deque<Waiting> waiting[2];
+			TimerHandle timer;                  // drain timer, empty when not armed
+			Clock::time_point timer_deadline;
+			UInt64 timer_generation = 0;
+		};
+
+		RateLimiter::RateLimiter()
+			: _impl(std::make_shared<Impl>())
+		{
+		}
+
+		RateLimiter::~RateLimiter()
+		{
+		}
+
+		void RateLimiter::add_bucket(const AString& bucket, UInt32 capacity, std::chrono::milliseconds interval)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			Impl::Bucket& b = this->_impl->buckets[bucket];
+			b.capacity = capacity;
+			b.tokens = capacity;
+			b.per_ms = capacity / static_cast<double>(std::max<Int64>(interval.count(), 1));
+		}
+
+		void RateLimiter::set_weight(const AString& method, const AString& path_prefix, const AString& bucket, UInt32 weight,
+			RequestPriority priority)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			this->_impl->rules.push_back({ method, path_prefix, bucket, weight, priority });
+		}
+
+		void RateLimiter::set_usage_header(const AString& header, const AString& bucket)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			this->_impl->usage_headers.emplace_back(header, bucket);
+		}
+
+		void RateLimiter::set_order_reserve(double share)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			this->_impl->reserve = std::clamp(share, 0.0, 1.0);
+		}
+
+		void RateLimiter::submit(const AString& method, const AString& path, RequestPriority priority, FnMut<void()> send)
+		{
+			std::vector<FnMut<void()>> ready;
+			{
+				std::lock_guard<std::mutex> lock(this->_impl->mutex);
+				auto now = Impl::Clock::now();
+				this->_impl->refill(now);
+
+				Impl::Costs costs = this->_impl->costs_of(method, path);
+				auto& orders = this->_impl->waiting[static_cast<size_t>(RequestPriority::ORDER)];
+				auto& queue = this->_impl->waiting[static_cast<size_t>(priority)];
+				// A request that uses no bucket never waits behind the ones that do
+				bool behind = !costs.empty() && (!queue.empty() || ((priority == RequestPriority::QUERY) && !orders.empty()));
+				if (behind || !this->_impl->try_take(costs, priority, now))
+				{
+					queue.push_back({ std::move(costs), std::move(send) });
+					ready = this->_impl->take_ready(now);
+				}
+				else
+				{
+					ready.push_back(std::move(send));
+				}
+			}
+			for (auto& item : ready)
+			{
+				item();
+			}
+		}
+
+		void RateLimiter::acquire(const AString& method, const AString& path, RequestPriority priority)
+		{
+			if (is_main_event_loop_thread())
+			{
+				// The waiting queue is drained from the main loop, so waiting here would never end
+				LOGERROR("Blocking %s %s on the main loop, sent without waiting for the rate limit; use async_request",
+					method.c_str(), path.c_str());
+				std::lock_guard<std::mutex> lock(this->_impl->mutex);
+				this->_impl->refill(Impl::Clock::now());
+				this->_impl->take(this->_impl->costs_of(method, path));
+				return;
+			}
+
+			// Queue up behind the requests already waiting, orders still go first
+			auto ready = std::make_shared<std::promise<void>>();
+			std::future<void> turn = ready->get_future();
+			this->submit(method, path, priority, [ready]() { ready->set_value(); });
+			turn.wait();
+		}
+
+		void RateLimiter::on_response(const Response& response)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			auto now = Impl::Clock::now();
+			this->_impl->refill(now);
+
+			for (auto& [header, bucket] : this->_impl->usage_headers)
+			{
+				for (auto& [name, value] : response.headers)
+				{
+					UInt32 used;
+					if ((NoCaseCompare(name, header) == 0) && StringToInteger(value, used))
+					{
+						this->_impl->set_used(bucket, used);
+					}
+				}
+			}
+
+			if ((response.status == 429) || (response.status == 418))
+			{
+				std::chrono::seconds retry_after = (response.status == 418) ? DEFAULT_RETRY_AFTER_418 : DEFAULT_RETRY_AFTER_429;
+				for (auto& [name, value] : response.headers)
+				{
+					int seconds;
+					if ((NoCaseCompare(name, "Retry-After") == 0) && StringToInteger(value, seconds))
+					{
+						retry_after = std::chrono::seconds(seconds);
+					}
+				}
+				this->_impl->blocked_until = std::max(this->_impl->blocked_until, now + retry_after);
+				LOGWARNING("Rate limit hit (HTTP %d), holding requests for %lld s",
+					response.status, static_cast<long long>(retry_after.count()));
+			}
+		}
+
+		void RateLimiter::set_used(const AString& bucket, UInt32 used)
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			this->_impl->refill(Impl::Clock::now());
+			this->_impl->set_used(bucket, used);
+		}
+
+		RequestPriority RateLimiter::priority_of(const AString& method, const AString& path) const
+		{
+			std::lock_guard<std::mutex> lock(this->_impl->mutex);
+			return this->_impl->priority_of(method, path);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "HttpClient/Model.h"
+
+namespace Keen
+{
+	namespace api
+	{
+		/** Which waiting request gets the tokens first. */
+		enum class RequestPriority {
+			ORDER,      // placing and cancelling orders
+			QUERY       // market data, history and account queries
+		};
+
+		/** Client-side token buckets for one exchange connection.
+		Each bucket mirrors one of the exchange's limits (e.g. request weight per minute, orders per 10 seconds) and
+		refills evenly over its interval. Weight rules say what a request costs in which bucket. Requests that don't
+		fit wait in the limiter; waiting orders go before waiting queries, and queries never take the tokens kept in
+		reserve for orders. */
+		class KEEN_API_EXPORT RateLimiter
+		{
+		public:
+			RateLimiter();
+			~RateLimiter();
+
+			/** Adds a bucket holding capacity tokens, refilled at capacity per interval. */
+			void add_bucket(const AString& bucket, UInt32 capacity, std::chrono::milliseconds interval);
+
+			/** Cost in the bucket of requests whose path starts with path_prefix. An empty method matches any method.
+			For each bucket the longest matching prefix applies; a request matching no rule of a bucket doesn't use it.
+			priority marks the endpoint as order entry, see priority_of. */
+			void set_weight(const AString& method, const AString& path_prefix, const AString& bucket, UInt32 weight,
+				RequestPriority priority = RequestPriority::QUERY);
+
+			/** Response header carrying the exchange's count of used tokens for the bucket, e.g. X-MBX-USED-WEIGHT-1M. */
+			void set_usage_header(const AString& header, const AString& bucket);
+
+			/** Share of every bucket queries leave for orders, 0.1 by default. */
+			void set_order_reserve(double share);
+
+			/** Runs send once the request fits its buckets: right away if it does, otherwise later on the main loop. */
+			void submit(const AString& method, const AString& path, RequestPriority priority, FnMut<void()> send);
+
+			/** Blocks the calling thread until the request's turn comes in the same queue as submit(). On the main loop,
+			which drains that queue, it can't wait: it logs an error and charges the buckets right away. */
+			void acquire(const AString& method, const AString& path, RequestPriority priority);
+
+			/** Takes the used counts from the usage headers, and on 429 or 418 holds every request until Retry-After. */
+			void on_response(const Response& response);
+
+			/** Syncs the bucket with the exchange's count of used tokens, e.g. from the rateLimits of a websocket reply. */
+			void set_used(const AString& bucket, UInt32 used);
+
+			/** ORDER if a weight rule the request goes by was set with ORDER, QUERY otherwise, whatever the method:
+			listen key, leverage and position mode requests are no orders. */
+			RequestPriority priority_of(const AString& method, const AString& path) const;
+
+		private:
+			class Impl;
+
+			std::shared_ptr<Impl> _impl;
+		};
+	}
+}
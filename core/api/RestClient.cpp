@@ -1,6 +1,7 @@
 #include "Globals.h"
 #include "RestClient.h"
 #include "HttpClient/Sender.h"
+#include "OSSupport/ThreadPool.h"
 
 namespace Keen
 {
@@ -9,6 +10,7 @@ namespace Keen
 		RestClient::RestClient()
 		{
 			_sender = new Sender();
+			this->set_rate_limiter(std::make_shared<RateLimiter>());
 		}
 
 		RestClient::~RestClient()
@@ -39,15 +41,33 @@ namespace Keen
 		{
 		}
 
+		void RestClient::set_rate_limiter(std::shared_ptr<RateLimiter> limiter)
+		{
+			_limiter = std::move(limiter);
+			_sender->set_response_observer([limiter = _limiter](const Response& response) {
+				limiter->on_response(response);
+			});
+		}
+
 		void RestClient::request(Request& request)
 		{
-			Response res;
+			// Signed when it is sent, so a request that waited for its rate limit carries a fresh timestamp
+			_limiter->submit(request.method, request.path, _limiter->priority_of(request.method, request.path), [this, request]() mutable {
+				this->_send(request);
+			});
+		}
+
+		void RestClient::_send(Request& request)
+		{
 			_sender->request<ResString>(this->sign(request))
 				.done([=, this](const ResString& response)
 				{
 					try
 					{
-						request.callback(Json::parse(response.serialize()), request);
+						if (request.body_callback)
+							request.body_callback(response.serialize(), request);
+						else
+							request.callback(Json::parse(response.serialize()), request);
 					}
 					catch (const std::exception& e)
 					{
@@ -89,11 +109,105 @@ namespace Keen
 				.data = data
 			};
 
+			_limiter->acquire(method, path, _limiter->priority_of(method, path));
 			Response response = _sender->sync_request(request);
 
 			return response;
 		}
 
+		RequestAwaiter RestClient::async_request(Request request)
+		{
+			return RequestAwaiter(this, std::move(request), true);
+		}
+
+		RequestAwaiter RestClient::async_request(
+			AString method,
+			AString path,
+			Params params,
+			Json data,
+			Headers headers
+		)
+		{
+			Request request = Request{
+				.method = method,
+				.path = path,
+				.params = params,
+				.headers = headers,
+				.data = data
+			};
+
+			return RequestAwaiter(this, std::move(request), false);
+		}
+
+		RequestAwaiter::RequestAwaiter(RestClient* client, Request request, bool sign)
+			: _state(std::make_shared<State>())
+		{
+			_state->client = client;
+			_state->request = std::move(request);
+			_state->sign = sign;
+		}
+
+		RequestAwaiter::~RequestAwaiter()
+		{
+			if (!_state)
+				return;
+
+			// The limiter and the Sender keep the state alive, but nothing may resume the coroutine any more
+			_state->cancelled = true;
+			RequestId id = _state->id.load();
+			if (id != 0)
+				_state->client->_sender->cancel(id);
+		}
+
+		void RequestAwaiter::await_suspend(std::coroutine_handle<> handle)
+		{
+			_state->handle = handle;
+
+			// Like request(), it is signed when it is sent, so a request that waited for its rate limit carries a fresh timestamp
+			RateLimiter* limiter = _state->client->_limiter.get();
+			const Request& request = _state->request;
+			limiter->submit(request.method, request.path, limiter->priority_of(request.method, request.path), [state = _state]() {
+				_send(state);
+			});
+		}
+
+		void RequestAwaiter::_send(const std::shared_ptr<State>& state)
+		{
+			if (state->cancelled)
+				return;
+
+			if (state->sign)
+				state->client->sign(state->request);
+
+			Sender* sender = state->client->_sender;
+			RequestId id = sender->request<ResString>(state->request)
+				.done([state](const ResString& result) {
+					_complete(state, Response{ .code = 0, .status = 200, .body = result.serialize() });
+				})
+				.fail([state](const Error& error) {
+					_complete(state, Response{ .code = error.code(), .status = error.status(), .body = error.errorData() });
+				})
+				.error([state](const std::exception& e) {
+					_complete(state, Response{ .code = -1, .body = e.what() });
+				})
+				.send();
+
+			state->id = id;
+			// The coroutine went away while the request was being sent
+			if ((id != 0) && state->cancelled)
+				sender->cancel(id);
+		}
+
+		void RequestAwaiter::_complete(const std::shared_ptr<State>& state, Response response)
+		{
+			state->response = std::move(response);
+			// Never from inside await_suspend, even when the Sender fails the request right away
+			InvokeToQueue([state]() {
+				if (!state->cancelled)
+					state->handle.resume();
+			});
+		}
+
 		Request& RestClient::sign(Request& request)
 		{
 			return request;
@@ -1,11 +1,55 @@
 #pragma once
 
 #include "HttpClient/Sender.h"
+#include "RateLimiter.h"
 
 namespace Keen
 {
 	namespace api
 	{
+		class RestClient;
+
+		/** Result of RestClient::async_request(). The request is sent through the client's Sender and the awaiting
+		coroutine resumes on the main loop with the response, whatever its status; a request that times out comes
+		back with status 408, and one that could not be sent with code -1. Response headers are not kept.
+		Destroying the awaiting coroutine cancels the request, whether it still waits for its rate limit or is in flight. */
+		class KEEN_API_EXPORT RequestAwaiter
+		{
+		public:
+			RequestAwaiter(RestClient* client, Request request, bool sign);
+
+			RequestAwaiter(RequestAwaiter&& other) = default;
+			RequestAwaiter(const RequestAwaiter& other) = delete;
+			RequestAwaiter& operator=(const RequestAwaiter& other) = delete;
+
+			~RequestAwaiter();
+
+			bool await_ready() const noexcept { return false; }
+
+			void await_suspend(std::coroutine_handle<> handle);
+
+			Response await_resume() { return std::move(_state->response); }
+
+		private:
+			/** Shared with the rate limiter and the Sender's callbacks, which may outlive the coroutine frame. */
+			struct State
+			{
+				RestClient* client;
+				Request request;
+				bool sign;
+				Response response;
+				std::coroutine_handle<> handle;
+				std::atomic<RequestId> id = 0;
+				std::atomic<bool> cancelled = false;
+			};
+
+			static void _send(const std::shared_ptr<State>& state);
+
+			static void _complete(const std::shared_ptr<State>& state, Response response);
+
+			std::shared_ptr<State> _state;
+		};
+
 		class KEEN_API_EXPORT RestClient
 		{
 		public:
@@ -32,16 +76,39 @@ namespace Keen
 				Json data = Json(),
 				Headers headers = Headers());
 
+			/** Awaitable form of request(Request&); like it, the request is signed once its rate limit lets it go. */
+			[[nodiscard]] RequestAwaiter async_request(Request request);
+
+			/** Awaitable form of the blocking request(); like it, the request is not signed. */
+			[[nodiscard]] RequestAwaiter async_request(
+				AString method,
+				AString path,
+				Params params = Params(),
+				Json data = Json(),
+				Headers headers = Headers());
+
 			virtual Request &sign(Request &request);
 
+			/** Every request waits here for its rate limits; a client can share its limiter with another, e.g. the
+			websocket that sends orders on the same account. */
+			const std::shared_ptr<RateLimiter>& get_rate_limiter() const { return _limiter; }
+
+			void set_rate_limiter(std::shared_ptr<RateLimiter> limiter);
+
 			virtual void on_failed(const Error& error, const Request &request);
 
 			virtual void on_error(const std::exception &ex, const Request &request);
 
 			AString exception_detail(const std::exception &ex, const Request &request);
 
+		protected:
+			friend class RequestAwaiter;
+
+			void _send(Request &request);
+
 		protected:
 			Sender *_sender;
+			std::shared_ptr<RateLimiter> _limiter;
 		};
 	}
 }
@@ -0,0 +1,200 @@
+#include "Globals.h" // NOTE: MSVC stupidness requires this to be the same across all modules
+#include "TimerWheel.h"
+
+namespace Keen
+{
+	namespace api
+	{
+		bool TimerHandle::cancel()
+		{
+			if ((this->_wheel == nullptr) || (this->_id == 0))
+			{
+				return false;
+			}
+
+			bool cancelled = this->_wheel->cancel(this->_id);
+			this->_id = 0;
+			return cancelled;
+		}
+
+
+		TimerWheel::TimerWheel()
+			: _epoch(Clock::now())
+		{
+		}
+
+		UInt64 TimerWheel::schedule(std::chrono::milliseconds delay, std::chrono::milliseconds period, Callback callback)
+		{
+			UInt64 now = this->_ticks(Clock::now());
+
+			cCSLock Lock(m_CS);
+
+			// Nothing to fire in between, skip the driver's idle gap instead of walking it tick by tick
+			if (this->_timers.empty())
+			{
+				this->_current = std::max(this->_current, now);
+			}
+
+			UInt64 id = this->_next_id++;
+			UInt64 due = std::max<UInt64>(now + std::max<Int64>(delay.count(), 0), this->_current + 1);
+			this->_timers.emplace(id, Timer{ due, static_cast<UInt64>(std::max<Int64>(period.count(), 0)),
+				std::make_shared<Callback>(std::move(callback)) });
+			this->_place(id, due);
+			return id;
+		}
+
+		bool TimerWheel::cancel(UInt64 id)
+		{
+			cCSLock Lock(m_CS);
+			return this->_timers.erase(id) > 0;
+		}
+
+		void TimerWheel::advance(Clock::time_point now)
+		{
+			UInt64 target = this->_ticks(now);
+
+			{
+				cCSLock Lock(m_CS);
+				if (this->_timers.empty())
+				{
+					this->_current = std::max(this->_current, target);
+					return;
+				}
+
+				while (this->_current < target)
+				{
+					++this->_current;
+
+					// Move the timers of each upper level slot that comes round into the levels below
+					for (size_t level = 1; level < LEVELS; ++level)
+					{
+						if ((this->_current & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+						{
+							break;
+						}
+
+						std::vector<UInt64>& slot = this->_slots[level][(this->_current >> (SLOT_BITS * level)) & (SLOTS - 1)];
+						this->_expired.swap(slot);
+						for (UInt64 id : this->_expired)
+						{
+							auto it = this->_timers.find(id);
+							if (it != this->_timers.end())
+							{
+								this->_place(id, it->second.due);
+							}
+						}
+						this->_expired.clear();
+					}
+
+					this->_expired.swap(this->_slots[0][this->_current & (SLOTS - 1)]);
+					for (UInt64 id : this->_expired)
+					{
+						auto it = this->_timers.find(id);
+						if (it == this->_timers.end())
+						{
+							continue;  // cancelled
+						}
+
+						Timer& timer = it->second;
+						if (timer.due > this->_current)
+						{
+							this->_place(id, timer.due);  // parked on the last level, not due yet
+							continue;
+						}
+
+						// A one-shot timer stays in _timers until it runs, so a callback before it can still cancel it
+						this->_fired.emplace_back(id, timer.callback);
+						if (timer.period == 0)
+						{
+							continue;
+						}
+
+						// Keep the period's phase, but skip the beats missed while the driver was late
+						timer.due += timer.period;
+						if (timer.due <= target)
+						{
+							timer.due = target + timer.period;
+						}
+						this->_place(id, timer.due);
+					}
+					this->_expired.clear();
+				}
+			}
+
+			for (auto& [id, callback] : this->_fired)
+			{
+				{
+					cCSLock Lock(m_CS);
+					auto it = this->_timers.find(id);
+					if (it == this->_timers.end())
+					{
+						continue;  // cancelled by a callback that ran before it
+					}
+					if (it->second.period == 0)
+					{
+						this->_timers.erase(it);
+					}
+				}
+				(*callback)();
+			}
+			this->_fired.clear();
+		}
+
+		TimerWheel::Clock::time_point TimerWheel::next_deadline() const
+		{
+			cCSLock Lock(m_CS);
+			if (this->_timers.empty())
+			{
+				return Clock::time_point::max();
+			}
+
+			// Timers in the upper levels cannot come due before the first level wraps around
+			UInt64 wrap = (this->_current | (SLOTS - 1)) + 1;
+			for (UInt64 tick = this->_current + 1; tick < wrap; ++tick)
+			{
+				if (!this->_slots[0][tick & (SLOTS - 1)].empty())
+				{
+					return this->_epoch + std::chrono::milliseconds(tick);
+				}
+			}
+			return this->_epoch + std::chrono::milliseconds(wrap);
+		}
+
+		size_t TimerWheel::size() const
+		{
+			cCSLock Lock(m_CS);
+			return this->_timers.size();
+		}
+
+		UInt64 TimerWheel::_ticks(Clock::time_point time) const
+		{
+			if (time <= this->_epoch)
+			{
+				return 0;
+			}
+			return static_cast<UInt64>(std::chrono::duration_cast<std::chrono::milliseconds>(time - this->_epoch).count());
+		}
+
+		void TimerWheel::_place(UInt64 id, UInt64 due)
+		{
+			// Called with m_CS held. A timer due at the current tick goes into the slot advance() is about to process.
+			due = std::max(due, this->_current);
+			UInt64 delta = due - this->_current;
+
+			size_t level = 0;
+			while ((level + 1 < LEVELS) && (delta >= (1ULL << (SLOT_BITS * (level + 1)))))
+			{
+				++level;
+			}
+
+			// Beyond the wheel's range, park it on the furthest slot and re-place it when that slot comes round
+			UInt64 range = 1ULL << (SLOT_BITS * LEVELS);
+			if (delta >= range)
+			{
+				due = this->_current + range - 1;
+			}
+
+			this->_slots[level][(due >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(id);
+		}
+	}
+}
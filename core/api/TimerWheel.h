@@ -0,0 +1,88 @@
+#pragma once
+
+namespace Keen
+{
+	namespace api
+	{
+		class TimerWheel;
+
+		/** Refers to a timer scheduled on a TimerWheel so it can be cancelled. A default constructed handle refers to nothing. */
+		class KEEN_API_EXPORT TimerHandle
+		{
+		public:
+			TimerHandle() = default;
+
+			TimerHandle(TimerWheel* wheel, UInt64 id)
+				: _wheel(wheel)
+				, _id(id)
+			{
+			}
+
+			/** Stops the timer. Returns false if it already fired (one-shot), was cancelled or the handle is empty. */
+			bool cancel();
+
+			bool is_valid() const { return this->_id != 0; }
+
+			UInt64 id() const { return this->_id; }
+
+		private:
+			TimerWheel* _wheel = nullptr;
+			UInt64 _id = 0;
+		};
+
+		/** Hierarchical timing wheel with millisecond resolution.
+		Four levels of 256 slots cover about 49 days; longer delays are parked on the last level and re-placed when it
+		comes round. Scheduling and cancelling are O(1) and thread-safe, cancelled timers are dropped lazily when their
+		slot is reached. advance() is meant to be called by a single driver thread. */
+		class KEEN_API_EXPORT TimerWheel
+		{
+		public:
+			using Clock = std::chrono::steady_clock;
+			using Callback = FnMut<void()>;
+
+			TimerWheel();
+
+			/** Schedules the callback to run after delay, and then every period if period is not zero. Returns the timer id. */
+			UInt64 schedule(std::chrono::milliseconds delay, std::chrono::milliseconds period, Callback callback);
+
+			/** Returns false if the timer already fired (one-shot) or was cancelled. */
+			bool cancel(UInt64 id);
+
+			/** Fires every timer due by now. Callbacks run on the calling thread after the lock has been released,
+			so they may schedule or cancel timers themselves; a timer cancelled by an earlier callback of the same
+			call doesn't run. */
+			void advance(Clock::time_point now);
+
+			/** The next time advance() may have work to do, Clock::time_point::max() if no timer is scheduled. */
+			Clock::time_point next_deadline() const;
+
+			size_t size() const;
+
+		protected:
+			static constexpr size_t LEVELS = 4;
+			static constexpr size_t SLOT_BITS = 8;
+			static constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+			struct Timer
+			{
+				UInt64 due;
+				UInt64 period;
+				std::shared_ptr<Callback> callback;
+			};
+
+			UInt64 _ticks(Clock::time_point time) const;
+
+			void _place(UInt64 id, UInt64 due);
+
+			mutable cCriticalSection m_CS;
+			Clock::time_point _epoch;
+			UInt64 _current = 0;   // last tick advance() has processed, in ms since _epoch
+			UInt64 _next_id = 1;
+			std::unordered_map<UInt64, Timer> _timers;
+			std::vector<UInt64> _slots[LEVELS][SLOTS];
+
+			std::vector<std::pair<UInt64, std::shared_ptr<Callback>>> _fired;   // reused by advance()
+			std::vector<UInt64> _expired;
+		};
+	}
+}
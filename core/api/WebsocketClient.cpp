@@ -8,15 +8,60 @@
 
 #include <asio.hpp>
 #include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <websocketpp/client.hpp>
 
+/** permessage-deflate that counts the compressed bytes it inflates, for WebsocketClient::get_stats.
+Inflating goes through the extension's own buffer, which it keeps for the life of the connection. */
+template <typename config>
+class counting_deflate : public websocketpp::extensions::permessage_deflate::enabled<config>
+{
+public:
+	typedef websocketpp::extensions::permessage_deflate::enabled<config> base;
+
+	websocketpp::lib::error_code decompress(uint8_t const * buf, size_t len, std::string & out)
+	{
+		m_inflated_from += len;
+		t_last = this;
+		return base::decompress(buf, len, out);
+	}
+
+	/** Compressed bytes of the message just completed on this thread, see on_message. */
+	static size_t take_compressed_bytes()
+	{
+		if (t_last == nullptr)
+		{
+			return 0;
+		}
+		size_t bytes = t_last->m_inflated_from;
+		t_last->m_inflated_from = 0;
+		return bytes;
+	}
+
+private:
+	size_t m_inflated_from = 0;
+
+	// The last frame of a compressed message is inflated right before its message handler runs, on the same thread
+	static inline thread_local counting_deflate * t_last = nullptr;
+};
+
+struct deflate_tls_client_config : public websocketpp::config::asio_tls_client
+{
+	typedef deflate_tls_client_config type;
+
+	struct permessage_deflate_config {};
+
+	typedef counting_deflate<permessage_deflate_config> permessage_deflate_type;
+};
+
 typedef websocketpp::client<websocketpp::config::asio_tls_client> client;
+typedef websocketpp::client<deflate_tls_client_config> deflate_client;
 
 using websocketpp::lib::bind;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 
-// pull out the type of messages sent by our config
+// pull out the type of messages sent by our config, the deflate one shares it
 typedef websocketpp::config::asio_tls_client::message_type::ptr message_ptr;
 typedef websocketpp::lib::shared_ptr<asio::ssl::context> context_ptr;
 typedef client::connection_ptr connection_ptr;
@@ -24,33 +69,86 @@ typedef client::connection_ptr connection_ptr;
 
 #define BUFLEN 65536
 
+// Bytes websocketpp may still be writing before queued messages wait for it; orders never wait
+static const size_t SEND_LOW_WATER = 16 * 1024;
+static const std::chrono::milliseconds SEND_RETRY = std::chrono::milliseconds(1);
+
+/** Serializes into a buffer kept per thread, so sending allocates nothing once the buffer has grown. */
+static const std::string& SerializePacket(const Json& packet)
+{
+	struct Buffer
+	{
+		std::string text;
+		nlohmann::detail::serializer<Json> serializer{ nlohmann::detail::output_adapter<char>(text), ' ' };
+	};
+	static thread_local Buffer buffer;
+
+	buffer.text.clear();
+	buffer.serializer.dump(packet, false, false, 0);
+	return buffer.text;
+}
+
+/** True if the requests differ only in list_key and "id", so their lists can go out as one request. */
+static bool SameRequest(const Json& a, const Json& b, const std::string& list_key)
+{
+	if (!a.is_object() || !b.is_object())
+	{
+		return false;
+	}
+
+	size_t compared = 0;
+	for (auto it = a.begin(); it != a.end(); ++it)
+	{
+		if ((it.key() == list_key) || (it.key() == "id"))
+		{
+			continue;
+		}
+		auto other = b.find(it.key());
+		if ((other == b.end()) || (*other != *it))
+		{
+			return false;
+		}
+		++compared;
+	}
+	// Equal members counted, so b has no others if the counts match
+	size_t members = b.size() - b.count(list_key) - b.count("id");
+	return members == compared;
+}
+
 namespace Keen
 {
 	namespace api
 	{
+		/** websocketpp connection plus its ping and reconnect timers.
+		When it runs on the network pool, socket work and JSON parsing happen on the pool's threads and every
+		callback into the WebsocketClient is handed to the main loop, so exchange code stays single threaded. */
 		class WebsocketClient::WebsocketClientImpl
 		{
 		public:
 			typedef WebsocketClientImpl type;
 
-			WebsocketClientImpl(asio::io_service* io_service, const std::string& uri, int m_ping_interval, const std::string& proxy_uri = "", WebsocketClient* client = nullptr)
-				: m_uri(uri), m_proxy_uri(proxy_uri), m_ping_interval(m_ping_interval), m_io_service(io_service), m_reconnect_timer(*io_service), m_stopped(false), m_callback(client)
+			WebsocketClientImpl(asio::io_service* io_service, const std::string& uri, int m_ping_interval, const std::string& proxy_uri = "", WebsocketClient* client = nullptr, bool compression = false)
+				: m_uri(uri), m_proxy_uri(proxy_uri), m_ping_interval(m_ping_interval), m_io_service(io_service), m_strand(io_service->get_executor()), m_reconnect_timer(m_strand), m_flush_timer(m_strand), m_stopped(false), m_compression(compression), m_callback(client)
 			{
-				m_client.set_access_channels(websocketpp::log::alevel::none);
-				m_client.set_error_channels(websocketpp::log::elevel::none);
-
-				// Initialize ASIO
-				m_client.init_asio(m_io_service);
-				m_client.start_perpetual();
-
-				// Register our handlers
-				m_client.set_socket_init_handler(bind(&type::on_socket_init, this, ::_1));
-				m_client.set_tls_init_handler(bind(&type::on_tls_init, this, ::_1));
-				m_client.set_message_handler(bind(&type::on_message, this, ::_1, ::_2));
-				m_client.set_open_handler(bind(&type::on_open, this, ::_1));
-				m_client.set_pong_handler(bind(&type::on_pong, this, ::_1, ::_2));
-				m_client.set_close_handler(bind(&type::on_close, this, ::_1));
-				m_client.set_fail_handler(bind(&type::on_fail, this, ::_1));
+				m_on_main_loop = (io_service == get_main_event_loop());
+
+				with_client([this](auto& endpoint) {
+					endpoint.set_access_channels(websocketpp::log::alevel::none);
+					endpoint.set_error_channels(websocketpp::log::elevel::none);
+
+					// Initialize ASIO
+					endpoint.init_asio(m_io_service);
+					endpoint.start_perpetual();
+
+					// Register our handlers
+					endpoint.set_socket_init_handler(bind(&type::on_socket_init, this, ::_1));
+					endpoint.set_tls_init_handler(bind(&type::on_tls_init, this, ::_1));
+					endpoint.set_message_handler(bind(&type::on_message, this, ::_1, ::_2));
+					endpoint.set_open_handler(bind(&type::on_open, this, ::_1));
+					endpoint.set_pong_handler(bind(&type::on_pong, this, ::_1, ::_2));
+					endpoint.set_close_handler(bind(&type::on_close, this, ::_1));
+					endpoint.set_fail_handler(bind(&type::on_fail, this, ::_1));
+				});
 			}
 
 			~WebsocketClientImpl()
@@ -58,6 +156,20 @@ namespace Keen
 				stop();
 			}
 
+			/** Runs f where the WebsocketClient callbacks belong: inline on the main loop, posted to it otherwise. */
+			template <class FunctorT>
+			void deliver(FunctorT&& f)
+			{
+				if (m_on_main_loop)
+				{
+					f();
+				}
+				else
+				{
+					InvokeToQueue(std::forward<FunctorT>(f));
+				}
+			}
+
 		private:
 			void on_socket_init(websocketpp::connection_hdl hdl)
 			{
@@ -87,28 +199,53 @@ namespace Keen
 			{
 				if (m_callback)
 				{
-					m_callback->on_fail();
+					deliver([this]() { m_callback->on_fail(); });
 				}
 			}
 
 			void on_open(websocketpp::connection_hdl hdl)
 			{
-				m_hdl = hdl;
-				start_ping();
+				{
+					std::lock_guard<std::mutex> lock(m_hdl_mutex);
+					m_hdl = hdl;
+				}
+
+				bool negotiated = false;
+				if (m_compression)
+				{
+					websocketpp::lib::error_code ec;
+					auto con = m_deflate_client.get_con_from_hdl(hdl, ec);
+					negotiated = !ec && (con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != std::string::npos);
+				}
+				m_negotiated = negotiated;
+				m_messages = 0;
+				m_raw_bytes = 0;
+				m_wire_bytes = 0;
+
+				asio::post(m_strand, [this]() { start_ping(); });
 
 				if (m_callback)
 				{
-					m_callback->on_connected();
+					deliver([this]() { m_callback->on_connected(); });
 				}
 			}
 
 			void on_message(websocketpp::connection_hdl, message_ptr msg)
 			{
-				std::string message = msg->get_payload();
+				size_t raw = msg->get_payload().size();
+				size_t wire = raw;
+				if (m_compression && msg->get_compressed())
+				{
+					wire = deflate_tls_client_config::permessage_deflate_type::take_compressed_bytes();
+				}
+				m_messages.fetch_add(1, std::memory_order_relaxed);
+				m_raw_bytes.fetch_add(raw, std::memory_order_relaxed);
+				m_wire_bytes.fetch_add(wire, std::memory_order_relaxed);
 
 				if (m_callback)
 				{
-					m_callback->on_text(message);
+					// Shares the message instead of copying its payload; websocketpp allocates a new message per frame
+					m_callback->on_text(std::shared_ptr<const std::string>(msg, &msg->get_payload()));
 				}
 			}
 
@@ -121,46 +258,82 @@ namespace Keen
 			{
 				if (m_callback)
 				{
-					m_callback->on_disconnected();
-					if (!m_stopped)
-					{
-						m_callback->reconnect();
-					}
+					deliver([this]() {
+						m_callback->on_disconnected();
+						if (!m_stopped)
+						{
+							m_callback->reconnect();
+						}
+					});
 				}
 			}
 
 		public:
 			void start()
 			{
-				connect();
+				asio::post(m_strand, [this]() { connect(); });
 			}
 
-			void send(const std::string& message)
+			/** Writes the packet now, or queues it behind what websocketpp is still writing, see SendPriority. */
+			void send(const Json& packet, SendPriority priority, const std::string& list_key = "")
 			{
-				if (m_hdl.lock())
+				if (priority == SendPriority::SUBSCRIPTION)
 				{
-					m_client.send(m_hdl, message, websocketpp::frame::opcode::text);
+					{
+						std::lock_guard<std::mutex> lock(m_send_mutex);
+						enqueue_subscription(packet, list_key);
+					}
+					schedule_flush(m_batch_window);
+					return;
 				}
-				else
+
+				if (priority == SendPriority::NORMAL)
 				{
-					LOGERROR("Connection not open, cannot send message.");
+					// Written under the lock, so it can't overtake one flush has just taken off the queue
+					std::unique_lock<std::mutex> lock(m_send_mutex);
+					if (m_normal.empty() && (buffered_amount() < SEND_LOW_WATER))
+					{
+						write(packet);
+						return;
+					}
+					m_normal.push_back(packet);
+					lock.unlock();
+					schedule_flush(SEND_RETRY);
+					return;
 				}
+
+				write(packet);
+			}
+
+			void set_subscription_batch(size_t max_items, std::chrono::milliseconds window)
+			{
+				m_batch_items = max_items;
+				m_batch_window = window;
+			}
+
+			AString last_sent()
+			{
+				std::lock_guard<std::mutex> lock(m_last_sent_mutex);
+				return m_last_sent;
 			}
 
 			void stop()
 			{
 				m_stopped = true;
-				if (m_hdl.lock())
+				websocketpp::connection_hdl hdl = get_hdl();
+				if (hdl.lock())
 				{
 					websocketpp::lib::error_code ec;
-					m_client.close(m_hdl, websocketpp::close::status::going_away, "", ec);
+					with_client([&](auto& endpoint) {
+						endpoint.close(hdl, websocketpp::close::status::going_away, "", ec);
+					});
 					if (ec)
 					{
 						LOGERROR("Error closing connection: %s", ec.message().c_str());
 					}
 				}
 
-				m_client.stop_perpetual();
+				with_client([](auto& endpoint) { endpoint.stop_perpetual(); });
 			}
 
 			bool is_stopped() const
@@ -168,27 +341,182 @@ namespace Keen
 				return m_stopped;
 			}
 
+			WebsocketStats get_stats() const
+			{
+				WebsocketStats stats;
+				stats.compression = m_negotiated;
+				stats.messages = m_messages.load(std::memory_order_relaxed);
+				stats.raw_bytes = m_raw_bytes.load(std::memory_order_relaxed);
+				stats.wire_bytes = m_wire_bytes.load(std::memory_order_relaxed);
+				return stats;
+			}
+
 		private:
-			void connect()
+			struct Subscription
+			{
+				Json packet;
+				std::string list_key;
+			};
+
+			/** Merges the packet into the last queued subscription when only their lists differ. Under m_send_mutex. */
+			void enqueue_subscription(const Json& packet, const std::string& list_key)
 			{
+				if (!m_subscriptions.empty() && !list_key.empty())
+				{
+					Json& last = m_subscriptions.back().packet;
+					auto items = packet.find(list_key);
+					auto last_items = last.find(list_key);
+					if ((m_subscriptions.back().list_key == list_key)
+						&& (items != packet.end()) && items->is_array()
+						&& (last_items != last.end()) && last_items->is_array()
+						&& (last_items->size() + items->size() <= m_batch_items)
+						&& SameRequest(last, packet, list_key))
+					{
+						// The merged request keeps the first one's id
+						last_items->insert(last_items->end(), items->begin(), items->end());
+						return;
+					}
+				}
+				m_subscriptions.push_back({ packet, list_key });
+			}
+
+			/** Arms the flush timer for delay from now, unless it already fires sooner. */
+			void schedule_flush(std::chrono::milliseconds delay)
+			{
+				asio::post(m_strand, [this, delay]() {
+					auto when = std::chrono::steady_clock::now() + delay;
+					if (m_flush_armed && (m_flush_timer.expiry() <= when))
+					{
+						return;
+					}
+					m_flush_armed = true;
+					// Cancels a later wait, whose handler then sees operation_aborted
+					m_flush_timer.expires_at(when);
+					m_flush_timer.async_wait([this](const asio::error_code& ec) {
+						if (!ec)
+						{
+							m_flush_armed = false;
+							flush();
+						}
+					});
+				});
+			}
+
+			/** Writes queued messages, normal ones first, for as long as websocketpp keeps up. On the strand. */
+			void flush()
+			{
+				std::unique_lock<std::mutex> lock(m_send_mutex);
 				if (m_stopped)
+				{
+					m_normal.clear();
+					m_subscriptions.clear();
 					return;
+				}
+				while (!m_normal.empty() || !m_subscriptions.empty())
+				{
+					if (buffered_amount() >= SEND_LOW_WATER)
+					{
+						lock.unlock();
+						schedule_flush(SEND_RETRY);
+						return;
+					}
+					if (!m_normal.empty())
+					{
+						write(m_normal.front());
+						m_normal.pop_front();
+					}
+					else
+					{
+						write(m_subscriptions.front().packet);
+						m_subscriptions.pop_front();
+					}
+				}
+			}
 
-				websocketpp::lib::error_code ec;
-				client::connection_ptr con = m_client.get_connection(m_uri, ec);
+			/** Bytes handed to websocketpp and not yet written to the socket. */
+			size_t buffered_amount()
+			{
+				websocketpp::connection_hdl hdl = get_hdl();
+				size_t amount = 0;
+				with_client([&](auto& endpoint) {
+					websocketpp::lib::error_code ec;
+					auto con = endpoint.get_con_from_hdl(hdl, ec);
+					if (!ec)
+					{
+						amount = con->get_buffered_amount();
+					}
+				});
+				return amount;
+			}
 
-				if (!m_proxy_uri.empty())
+			void write(const Json& packet)
+			{
+				const std::string& text = SerializePacket(packet);
 				{
-					con->set_proxy(m_proxy_uri);
+					std::lock_guard<std::mutex> lock(m_last_sent_mutex);
+					m_last_sent.assign(text);
 				}
 
-				if (ec)
+				websocketpp::connection_hdl hdl = get_hdl();
+				if (hdl.lock())
 				{
-					std::cerr << "Connect initialization error: " << ec.message() << std::endl;
-					return;
+					websocketpp::lib::error_code ec;
+					with_client([&](auto& endpoint) {
+						endpoint.send(hdl, text.data(), text.size(), websocketpp::frame::opcode::text, ec);
+					});
+					if (ec)
+					{
+						LOGERROR("Error sending message: %s", ec.message().c_str());
+					}
 				}
+				else
+				{
+					LOGERROR("Connection not open, cannot send message.");
+				}
+			}
 
-				m_client.connect(con);
+			/** Runs f with the endpoint this connection uses: the permessage-deflate one if compression was asked for. */
+			template <class F>
+			void with_client(F&& f)
+			{
+				if (m_compression)
+				{
+					f(m_deflate_client);
+				}
+				else
+				{
+					f(m_client);
+				}
+			}
+
+			websocketpp::connection_hdl get_hdl()
+			{
+				std::lock_guard<std::mutex> lock(m_hdl_mutex);
+				return m_hdl;
+			}
+
+			void connect()
+			{
+				if (m_stopped)
+					return;
+
+				with_client([this](auto& endpoint) {
+					websocketpp::lib::error_code ec;
+					auto con = endpoint.get_connection(m_uri, ec);
+
+					if (ec)
+					{
+						std::cerr << "Connect initialization error: " << ec.message() << std::endl;
+						return;
+					}
+
+					if (!m_proxy_uri.empty())
+					{
+						con->set_proxy(m_proxy_uri);
+					}
+
+					endpoint.connect(con);
+				});
 			}
 
 			void start_ping()
@@ -196,15 +524,16 @@ namespace Keen
 				if (m_stopped)
 					return;
 
-				m_ping_timer = std::make_shared<asio::steady_timer>(*m_io_service, m_ping_interval);
+				m_ping_timer = std::make_shared<asio::steady_timer>(m_strand, m_ping_interval);
 				m_ping_timer->async_wait([this](const asio::error_code& ec)
 					{
 						if (!ec)
 						{
-							if (m_hdl.lock())
+							websocketpp::connection_hdl hdl = get_hdl();
+							if (hdl.lock())
 							{
 								websocketpp::lib::error_code ec;
-								m_client.ping(m_hdl, "ping", ec);
+								with_client([&](auto& endpoint) { endpoint.ping(hdl, "ping", ec); });
 								if (ec)
 								{
 									LOGERROR("Ping failed with exception: %d -- %s", ec.value(), ec.message().c_str());
@@ -225,12 +554,15 @@ namespace Keen
 
 				LOGWARN("Connection closed, attempting to reconnect after 5 seconds...");
 
-				m_reconnect_timer.expires_after(5s);
-				m_reconnect_timer.async_wait([this](const asio::error_code& ec)
-				{
-					if (!ec) {
-						connect();
-					} 
+				// The timer belongs to the connection's strand, which may be on another thread
+				asio::post(m_strand, [this]() {
+					m_reconnect_timer.expires_after(5s);
+					m_reconnect_timer.async_wait([this](const asio::error_code& ec)
+					{
+						if (!ec) {
+							connect();
+						}
+					});
 				});
 			}
 
@@ -239,16 +571,35 @@ namespace Keen
 			std::string m_proxy_uri;
 			std::chrono::seconds m_ping_interval;
 			client m_client;
+			deflate_client m_deflate_client;
 			asio::io_service* m_io_service;
+			asio::strand<asio::io_context::executor_type> m_strand;  // connect, ping, reconnect and flushing queued sends
 			asio::steady_timer m_reconnect_timer;
+			asio::steady_timer m_flush_timer;  // on m_strand
+			bool m_flush_armed = false;         // only touched on m_strand
+			std::mutex m_send_mutex;
+			std::deque<Json> m_normal;
+			std::deque<Subscription> m_subscriptions;
+			size_t m_batch_items = 100;
+			std::chrono::milliseconds m_batch_window = std::chrono::milliseconds(5);
+			std::mutex m_last_sent_mutex;
+			std::string m_last_sent;            // keeps its capacity, so recording a send rarely allocates
+			std::mutex m_hdl_mutex;
 			websocketpp::connection_hdl m_hdl;
 			std::shared_ptr<asio::steady_timer> m_ping_timer;
 			std::atomic<bool> m_stopped;
+			bool m_compression;  // offer permessage-deflate, picks m_deflate_client over m_client
+			std::atomic<bool> m_negotiated = false;
+			std::atomic<UInt64> m_messages = 0;
+			std::atomic<UInt64> m_raw_bytes = 0;
+			std::atomic<UInt64> m_wire_bytes = 0;
+			bool m_on_main_loop;
 			WebsocketClient* m_callback;
 		};
 
 		WebsocketClient::WebsocketClient()
 			: m_ping_interval(10)
+			, _limiter(std::make_shared<RateLimiter>())
 		{
 			this->m_uri = "";
 			this->_ws = nullptr;
@@ -275,8 +626,9 @@ namespace Keen
 
 		void WebsocketClient::start()
 		{
-			auto event_loop = get_main_event_loop();
-			this->_ws.reset(new WebsocketClientImpl((asio::io_service*)event_loop, m_uri, m_ping_interval, m_proxy_uri, this));
+			auto event_loop = get_network_event_loop(this->_channel);
+			this->_ws.reset(new WebsocketClientImpl((asio::io_service*)event_loop, m_uri, m_ping_interval, m_proxy_uri, this, this->_compression));
+			this->_ws->set_subscription_batch(this->_batch_items, this->_batch_window);
 			this->_ws->start();
 		}
 
@@ -301,17 +653,55 @@ namespace Keen
 			return this->_ws && !this->_ws->is_stopped();
 		}
 
-		void WebsocketClient::send_packet(const Json& packet)
+		WebsocketStats WebsocketClient::get_stats() const
 		{
-			AString text = packet.dump();
-			this->_last_sent_text = text;
+			return this->_ws ? this->_ws->get_stats() : WebsocketStats();
+		}
 
+		void WebsocketClient::send_packet(const Json& packet, SendPriority priority)
+		{
 			if (this->_ws)
 			{
-				this->_ws->send(text);
+				this->_ws->send(packet, priority);
 			}
 		}
 
+		void WebsocketClient::send_packet(const Json& packet, const AString& endpoint)
+		{
+			RequestPriority priority = this->_limiter->priority_of("WS", endpoint);
+			this->_limiter->submit("WS", endpoint, priority, [this, packet, priority]() {
+				this->send_packet(packet, (priority == RequestPriority::ORDER) ? SendPriority::ORDER : SendPriority::NORMAL);
+			});
+		}
+
+		void WebsocketClient::send_subscription(const Json& packet, const AString& list_key)
+		{
+			if (this->_ws)
+			{
+				this->_ws->send(packet, SendPriority::SUBSCRIPTION, list_key);
+			}
+		}
+
+		void WebsocketClient::set_subscription_batch(size_t max_items, std::chrono::milliseconds window)
+		{
+			this->_batch_items = max_items;
+			this->_batch_window = window;
+		}
+
+		void WebsocketClient::set_received_history(size_t count)
+		{
+			std::lock_guard<std::mutex> lock(this->_received_mutex);
+			this->_received.assign(count, nullptr);
+			this->_received_next = 0;
+			this->_keep_received.store(count != 0, std::memory_order_relaxed);
+		}
+
+		bool WebsocketClient::on_frame(std::string_view frame)
+		{
+			(void)frame;
+			return false;
+		}
+
 		Json WebsocketClient::unpack_data(const AString& data)
 		{
 			return Json::parse(data);
@@ -347,32 +737,81 @@ namespace Keen
 		{
 			AString text = Printf("[%s]: Unhandled WebSocket Error:%s\n",
 				DateTimeToString(currentDateTime()).c_str(), typeid(ex).name());
-			text += Printf("LastSentText:\n%s\n", this->_last_sent_text.c_str());
-			text += Printf("LastReceivedText:\n%s\n", this->_last_received_text.c_str());
+			text += Printf("LastSentText:\n%s\n", this->_ws ? this->_ws->last_sent().c_str() : "");
+			{
+				// Oldest first
+				std::lock_guard<std::mutex> lock(this->_received_mutex);
+				for (size_t i = 0; i < this->_received.size(); ++i)
+				{
+					const auto& frame = this->_received[(this->_received_next + i) % this->_received.size()];
+					if (frame)
+					{
+						text += Printf("LastReceivedText:\n%s\n", frame->c_str());
+					}
+				}
+			}
 			text += "Exception trace: \n";
 			text += ex.what();
 			text += " \n\n";
 			return text;
 		}
 
-		void WebsocketClient::on_text(const AString& text)
+		void WebsocketClient::on_text(std::shared_ptr<const AString> frame)
 		{
-			this->_last_received_text = text;
+			if (this->_keep_received.load(std::memory_order_relaxed))
+			{
+				std::lock_guard<std::mutex> lock(this->_received_mutex);
+				if (!this->_received.empty())
+				{
+					this->_received[this->_received_next] = frame;
+					this->_received_next = (this->_received_next + 1) % this->_received.size();
+				}
+			}
 
+			if (this->on_frame(*frame))
+			{
+				return;
+			}
+
+			// Parse on the connection's thread, only on_packet joins the main loop
+			Json data;
+			std::exception_ptr error;
 			try
 			{
-				Json data = this->unpack_data(text);
-				if (data.is_null())
+				data = this->unpack_data(*frame);
+			}
+			catch (const std::exception&)
+			{
+				error = std::current_exception();
+			}
+
+			if (!error && data.is_null())
+			{
+				return;
+			}
+
+			this->_ws->deliver([this, frame = std::move(frame), data = std::move(data), error]() {
+				try
 				{
-					return;
+					if (error)
+					{
+						std::rethrow_exception(error);
+					}
+					this->on_packet(data);
 				}
+				catch (const std::exception& e)
+				{
+					LOGERROR(Printf("wss error with text: %s", frame->c_str()));
+					this->on_error(e);
+				}
+			});
+		}
 
-				this->on_packet(data);
-			}
-			catch (const std::exception& e)
+		void WebsocketClient::deliver(FnMut<void()> fn)
+		{
+			if (this->_ws)
 			{
-				LOGERROR(Printf("wss error with text: %s", text.c_str()));
-				this->on_error(e);
+				this->_ws->deliver(std::move(fn));
 			}
 		}
 	}
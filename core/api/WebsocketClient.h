@@ -1,9 +1,28 @@
 #pragma once
 
+#include "RateLimiter.h"
+
 namespace Keen
 {
 	namespace api
-	{		
+	{
+		/** Traffic received on a websocket connection since it last opened. */
+		struct WebsocketStats
+		{
+			bool compression = false;   // permessage-deflate was negotiated
+			UInt64 messages = 0;
+			UInt64 raw_bytes = 0;       // payloads as handed to on_frame
+			UInt64 wire_bytes = 0;      // payloads as received, compressed for compressed messages
+		};
+
+		/** How an outgoing message may wait behind others on the same connection. */
+		enum class SendPriority
+		{
+			ORDER,          // written at once, never queued
+			NORMAL,         // written at once unless the connection is backed up, then ahead of subscriptions
+			SUBSCRIPTION,   // held for the batch window and merged with other subscriptions, see send_subscription
+		};
+
 		class KEEN_API_EXPORT WebsocketClient
 		{
 		public:
@@ -17,6 +36,13 @@ namespace Keen
 				uint16_t proxy_port = 0,
 				int ping_interval = 60);
 
+			/** Pool the connection runs on, MARKET_DATA by default. Set before start. */
+			void set_network_channel(NetworkChannel channel) { _channel = channel; }
+
+			/** Offers permessage-deflate when connecting, off by default; the server may still decline, see get_stats.
+			Worth it for wide market data subscriptions, not for order entry. Set before start. */
+			void set_compression(bool enabled) { _compression = enabled; }
+
 			void start();
 
 			void stop();
@@ -25,8 +51,37 @@ namespace Keen
 
 			bool is_active() const;
 
-			void send_packet(const Json& packet);
+			WebsocketStats get_stats() const;
+
+			void send_packet(const Json& packet, SendPriority priority = SendPriority::NORMAL);
+
+			/** Sends the packet once the rate limits of endpoint (e.g. "order.place") allow it, with the priority the
+			limiter's weight rules give the endpoint under method "WS". */
+			void send_packet(const Json& packet, const AString& endpoint);
+
+			/** Queues a subscribe request whose channels are the array under list_key ("params", "args"). Requests
+			queued within the batch window that differ only in that array and "id" go out as one, keeping the first id. */
+			void send_subscription(const Json& packet, const AString& list_key);
 
+			/** At most max_items channels per merged subscribe request, held for window before sending. Set before start. */
+			void set_subscription_batch(size_t max_items, std::chrono::milliseconds window);
+
+			const std::shared_ptr<RateLimiter>& get_rate_limiter() const { return _limiter; }
+
+			/** Shares a limiter, e.g. the one of the REST client on the same account. */
+			void set_rate_limiter(std::shared_ptr<RateLimiter> limiter) { _limiter = std::move(limiter); }
+
+			/** Keeps the last count received frames for exception_detail, none by default: the frame a handler threw
+			on is logged anyway, and keeping frames costs a lock per frame. Frames are kept by reference to the
+			received message, not copied. */
+			void set_received_history(size_t count);
+
+			/** Runs on the connection's thread with the frame as received, before it is copied or parsed; the view is
+			only valid during the call. Return true when the frame is handled, e.g. decoded in place and handed to the
+			main loop with deliver. The default returns false and the frame goes through unpack_data and on_packet. */
+			virtual bool on_frame(std::string_view frame);
+
+			/** Runs on the connection's thread, see on_text. Every other callback runs on the main loop. */
 			virtual Json unpack_data(const AString& data);
 
 			virtual void on_connected();
@@ -42,7 +97,11 @@ namespace Keen
 			AString exception_detail(const std::exception& ex);
 
 		protected:
-			void on_text(const AString& data);
+			/** Called on the connection's thread with the received frame; on_frame and unpack_data run there too. */
+			void on_text(std::shared_ptr<const AString> frame);
+
+			/** Runs fn on the main loop, where on_packet and the other callbacks run. */
+			void deliver(FnMut<void()> fn);
 
 		protected:
 			class WebsocketClientImpl;
@@ -55,8 +114,20 @@ namespace Keen
 
 			int m_ping_interval;
 
-			AString _last_sent_text;
-			AString _last_received_text;
+			NetworkChannel _channel = NetworkChannel::MARKET_DATA;
+
+			bool _compression = false;
+
+			std::shared_ptr<RateLimiter> _limiter;
+
+			size_t _batch_items = 100;
+
+			std::chrono::milliseconds _batch_window = std::chrono::milliseconds(5);
+
+			std::mutex _received_mutex;
+			std::vector<std::shared_ptr<const AString>> _received;  // ring of the last received frames
+			size_t _received_next = 0;
+			std::atomic<bool> _keep_received = false;               // lets on_text skip the mutex while the ring is off
 		};
 	}
 }
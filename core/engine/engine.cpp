@@ -1,6 +1,7 @@
 #include <api/Globals.h>
 #include "engine.h"
 #include <api/LoggerListeners.h>
+#include <api/OSSupport/ThreadTopology.h>
 #include  <api/HttpClient/Sender.h>
 #include "engine/app.h"
 #include "engine/exchange.h"
@@ -8,6 +9,7 @@
 #include "engine/utility.h"
 #include "engine/settings.h"
 #include "engine/converter.h"
+#include "engine/journal.h"
 
 using namespace std::placeholders;
 
@@ -18,10 +20,67 @@ namespace Keen
 	{
 		std::vector<cLogger::cAttachment> g_logger_attachments;
 
+		static std::map<AString, OverflowPolicy> OVERFLOW_POLICY_MAP = {
+			{"block", OverflowPolicy::BLOCK},
+			{"drop_oldest", OverflowPolicy::DROP_OLDEST},
+			{"fail", OverflowPolicy::FAIL}
+		};
+
+		static std::map<AString, WaitStrategy> WAIT_STRATEGY_MAP = {
+			{"blocking", WaitStrategy::BLOCKING},
+			{"spin_yield", WaitStrategy::SPIN_YIELD},
+			{"busy_spin", WaitStrategy::BUSY_SPIN}
+		};
+
+		// Thread roles configurable through "thread.<role>.*" settings
+		const char* const THREAD_ROLES[] = { "main", "network", "order", "dispatcher", "shard", "http", "background", "replay" };
+
 		TradeEngine::TradeEngine(EventEmitter* event_emitter)
 			: event_emitter(event_emitter)
 		{
-			this->event_emitter->start();
+			// Threads read their role when they start, so configure the roles before starting any
+			for (const char* role : THREAD_ROLES)
+			{
+				AString prefix = AString("thread.") + role;
+				cThreadRole config;
+				config.m_Cpus = cThreadTopology::ParseCpuList(SETTINGS.value(prefix + ".cpus", ""));
+				config.m_Priority = SETTINGS.value(prefix + ".priority", 0);
+				config.m_Threads = SETTINGS.value(prefix + ".threads", 0);
+				cThreadTopology::SetRole(role, config);
+			}
+
+			size_t queue_capacity = SETTINGS.value("event.queue_capacity", 65536);
+			AString overflow_policy = SETTINGS.value("event.overflow_policy", "block");
+			this->event_emitter->set_queue(queue_capacity,
+				GetWithDefault(OVERFLOW_POLICY_MAP, overflow_policy, OverflowPolicy::BLOCK));
+			this->event_emitter->set_batch_drain(
+				SETTINGS.value("event.batch_drain", false),
+				SETTINGS.value("event.max_batch_size", 1024));
+			this->event_emitter->set_shards(SETTINGS.value("event.shards", 0));
+			this->event_emitter->set_tick_conflation(SETTINGS.value("event.conflate_ticks", false));
+			this->event_emitter->set_starvation_limit(SETTINGS.value("event.starvation_limit", 64));
+			// The main loop runs the handlers, so it waits the same way or a spinning dispatcher saves nothing
+			AString wait_strategy = SETTINGS.value("event.wait_strategy", "blocking");
+			WaitStrategy strategy = GetWithDefault(WAIT_STRATEGY_MAP, wait_strategy, WaitStrategy::BLOCKING);
+			std::chrono::microseconds spin_budget(SETTINGS.value("event.spin_budget_us", 0));
+			this->event_emitter->set_wait_strategy(strategy, spin_budget);
+			api::set_main_event_loop_wait(strategy, spin_budget);
+			if (!SETTINGS.value("event.priority_lanes", true))
+			{
+				// Dispatch strictly in put() order, e.g. when replaying a journal
+				for (const char* type : { EVENT_TIMER, EVENT_TICK, EVENT_TRADE, EVENT_ORDER, EVENT_POSITION,
+					EVENT_ACCOUNT, EVENT_QUOTE, EVENT_CONTRACT, EVENT_LOG })
+				{
+					this->event_emitter->set_priority(type, EventPriority::MARKET_DATA);
+				}
+			}
+
+			this->event_emitter->start(std::chrono::milliseconds(SETTINGS.value("event.timer_interval_ms", 1000)));
+			api::start_network_threads(SETTINGS.value("io.network_threads", 0));
+			api::start_network_threads(SETTINGS.value("io.order_network_threads", 0), api::NetworkChannel::ORDER);
+			api::set_http_pool_limits(
+				SETTINGS.value("io.http_connections", 8),
+				std::chrono::seconds(SETTINGS.value("io.http_idle_timeout_s", 30)));
 
 			//os.chdir(TRADER_DIR);    // Change working directory
 			this->init_engines();
@@ -52,6 +111,14 @@ namespace Keen
 			exchanges.clear();
 		}
 
+		BaseExchange* TradeEngine::add_exchange(BaseExchange* exchange)
+		{
+			if (!exchange) return nullptr;
+
+			this->exchanges[exchange->exchange_name] = exchange;
+			return exchange;
+		}
+
 		BaseEngine* TradeEngine::add_engine(BaseEngine* engine)
 		{
 			if (!engine) return nullptr;
@@ -70,6 +137,11 @@ namespace Keen
 			this->add_engine(new EmailEngine(this, this->event_emitter));
 			this->add_engine(new NoticelEngine(this, this->event_emitter));
 
+			if (SETTINGS.value("journal.active", false))
+			{
+				this->add_engine(new JournalEngine(this, this->event_emitter));
+			}
+
 			this->send_order = [=, this](const OrderRequest& req, AString exchange_name)->AString
 				{
 					auto exchange = this->get_exchange(exchange_name);
@@ -201,6 +273,15 @@ namespace Keen
 				return {};
 		}
 
+		api::Task<std::list<BarData>> TradeEngine::query_history_async(HistoryRequest req, AString exchange_name)
+		{
+			auto exchange = this->get_exchange(exchange_name);
+			if (exchange)
+				co_return co_await exchange->query_history_async(std::move(req));
+			else
+				co_return std::list<BarData>();
+		}
+
 		void TradeEngine::close()
 		{
 			this->event_emitter->stop();
@@ -307,7 +388,7 @@ namespace Keen
 
 		void LogEngine::process_log_event(const Event& event)
 		{
-			const LogData& log = std::any_cast<const LogData&>(event.data);
+			const LogData& log = event.get<LogData>();
 			cLogger::GetInstance().LogSimple(log.msg, /*log.level*/eLogLevel::Info);
 		}
 
@@ -362,13 +443,13 @@ namespace Keen
 
 		void OmsEngine::process_tick_event(const Event& event)
 		{
-			const TickData& tick = std::any_cast<const TickData&>(event.data);
+			const TickData& tick = event.get<TickData>();
 			this->ticks[tick.kt_symbol] = tick;
 		}
 
 		void OmsEngine::process_order_event(const Event& event)
 		{
-			const OrderData& order = std::any_cast<const OrderData&>(event.data);
+			const OrderData& order = event.get<OrderData>();
 			this->orders[order.kt_orderid] = order;
 
 			if (order.is_active())
@@ -388,7 +469,7 @@ namespace Keen
 
 		void OmsEngine::process_trade_event(const Event& event)
 		{
-			const TradeData& trade = std::any_cast<const TradeData&>(event.data);
+			const TradeData& trade = event.get<TradeData>();
 			this->trades[trade.kt_tradeid] = trade;
 
 			// Update to offset converter
@@ -399,7 +480,7 @@ namespace Keen
 
 		void OmsEngine::process_position_event(const Event& event)
 		{
-			const PositionData& position = std::any_cast<const PositionData&>(event.data);
+			const PositionData& position = event.get<PositionData>();
 			this->positions[position.kt_positionid] = position;
 
 			// Update to offset converter
@@ -410,13 +491,13 @@ namespace Keen
 
 		void OmsEngine::process_account_event(const Event& event)
 		{
-			const AccountData& account = std::any_cast<const AccountData&>(event.data);
+			const AccountData& account = event.get<AccountData>();
 			this->accounts[account.kt_accountid] = account;
 		}
 
 		void OmsEngine::process_contract_event(const Event& event)
 		{
-			const ContractData& contract = std::any_cast<const ContractData&>(event.data);
+			const ContractData& contract = event.get<ContractData>();
 			this->contracts[contract.kt_symbol] = contract;
 
 			// Initialize offset converter for each exchange
@@ -427,7 +508,7 @@ namespace Keen
 
 		void OmsEngine::process_quote_event(const Event& event)
 		{
-			const QuoteData& quote = std::any_cast<const QuoteData&>(event.data);
+			const QuoteData& quote = event.get<QuoteData>();
 			this->quotes[quote.kt_quoteid] = quote;
 
 			// If quote is active, then update data in dict.
@@ -601,6 +682,8 @@ namespace Keen
 
 		void EmailEngine::run()
 		{
+			cThreadTopology::Apply("background", "kt-email");
+
 			for (;;)
 			{
 				cCSLock Lock(m_CS);
@@ -709,6 +792,8 @@ namespace Keen
 
 		void NoticelEngine::run()
 		{
+			cThreadTopology::Apply("background", "kt-notice");
+
 			for (;;)
 			{
 				cCSLock Lock(m_CS);
@@ -36,6 +36,9 @@ namespace Keen
 				return exchange;
 			}
 
+			/** Registers an exchange created elsewhere, e.g. a replay stub. The TradeEngine takes ownership. */
+			BaseExchange* add_exchange(BaseExchange* exchange);
+
 			template<class T = BaseApp>
 			BaseEngine* add_app() {
 
@@ -74,6 +77,8 @@ namespace Keen
 
 			std::list<BarData> query_history(const HistoryRequest& req, AString exchange_name);
 
+			api::Task<std::list<BarData>> query_history_async(HistoryRequest req, AString exchange_name);
+
 			void close();
 
 		public:
@@ -15,6 +15,12 @@ namespace Keen
 		{
 			this->event_emitter = event_emitter;
 			this->exchange_name = exchange_name;
+
+			this->tick_channel = std::make_unique<Channel<TickData>>();
+			this->order_channel = std::make_unique<Channel<OrderData>>(1024);
+			this->trade_channel = std::make_unique<Channel<TradeData>>(1024);
+			this->position_channel = std::make_unique<Channel<PositionData>>(1024);
+			this->account_channel = std::make_unique<Channel<AccountData>>(1024);
 		}
 
 		BaseExchange::~BaseExchange()
@@ -30,38 +36,45 @@ namespace Keen
 
 		void BaseExchange::on_tick(const TickData& tick)
 		{
-			this->on_event(EVENT_TICK, tick);
-			this->on_event(EVENT_TICK + tick.kt_symbol, tick);
+			UInt32 key = this->event_emitter->find_key(EVENT_TICK, tick.kt_symbol);
+			UInt32 route = this->event_emitter->route_of(tick.kt_symbol);
+			this->tick_channel->publish(this->event_emitter, EVENT_TICK, tick, key, route);
 		}
 
 		void BaseExchange::on_trade(const TradeData& trade)
 		{
-			this->on_event(EVENT_TRADE, trade);
-			this->on_event(EVENT_TRADE + trade.kt_symbol, trade);
+			UInt32 key = this->event_emitter->find_key(EVENT_TRADE, trade.kt_symbol);
+			UInt32 route = this->event_emitter->route_of(trade.kt_symbol);
+			this->trade_channel->publish(this->event_emitter, EVENT_TRADE, trade, key, route);
 		}
 
 		void BaseExchange::on_order(const OrderData& order)
 		{
-			this->on_event(EVENT_ORDER, order);
-			this->on_event(EVENT_ORDER + order.kt_orderid, order);
+			UInt32 key = this->event_emitter->find_key(EVENT_ORDER, order.kt_orderid);
+			UInt32 route = this->event_emitter->route_of(order.kt_symbol);
+			this->order_channel->publish(this->event_emitter, EVENT_ORDER, order, key, route);
 		}
 
 		void BaseExchange::on_position(const PositionData& position)
 		{
-			this->on_event(EVENT_POSITION, position);
-			this->on_event(EVENT_POSITION + position.kt_symbol, position);
+			UInt32 key = this->event_emitter->find_key(EVENT_POSITION, position.kt_symbol);
+			UInt32 route = this->event_emitter->route_of(position.kt_symbol);
+			this->position_channel->publish(this->event_emitter, EVENT_POSITION, position, key, route);
 		}
 
 		void BaseExchange::on_account(const AccountData& account)
 		{
-			this->on_event(EVENT_ACCOUNT, account);
-			this->on_event(EVENT_ACCOUNT + account.kt_accountid, account);
+			UInt32 key = this->event_emitter->find_key(EVENT_ACCOUNT, account.kt_accountid);
+			UInt32 route = this->event_emitter->route_of(account.kt_accountid);
+			this->account_channel->publish(this->event_emitter, EVENT_ACCOUNT, account, key, route);
 		}
 
 		void BaseExchange::on_quote(const QuoteData& quote)
 		{
-			this->on_event(EVENT_QUOTE, quote);
-			this->on_event(EVENT_QUOTE + quote.kt_symbol, quote);
+			Event event = Event(EVENT_QUOTE, quote);
+			event.key = this->event_emitter->find_key(EVENT_QUOTE, quote.kt_symbol);
+			event.route = this->event_emitter->route_of(quote.kt_symbol);
+			this->event_emitter->put(event);
 		}
 
 		void BaseExchange::on_log(const LogData& log)
@@ -106,6 +119,11 @@ namespace Keen
 			return {};
 		}
 
+		api::Task<std::list<BarData>> BaseExchange::query_history_async(HistoryRequest req)
+		{
+			co_return this->query_history(req);
+		}
+
 		const Json& BaseExchange::get_default_setting() const
 		{
 			return this->default_setting;
@@ -8,6 +8,7 @@ namespace Keen
 	{
 		class Event;
 		class EventEmitter;
+		template <class T> class Channel;
 
 		class KEEN_ENGINE_EXPORT BaseExchange
 		{
@@ -56,6 +57,10 @@ namespace Keen
 
 			virtual std::list<BarData> query_history(const HistoryRequest& req);
 
+			/** Non-blocking query_history, resumes the awaiting coroutine on the main loop.
+			The default falls back to the blocking query. */
+			virtual api::Task<std::list<BarData>> query_history_async(HistoryRequest req);
+
 			virtual const Json& get_default_setting() const;
 
 			AString get_exchange_name() const { return this->exchange_name; }
@@ -67,6 +72,12 @@ namespace Keen
 
 			EventEmitter* event_emitter;
 			AString exchange_name;
+
+			std::unique_ptr<Channel<TickData>> tick_channel;
+			std::unique_ptr<Channel<OrderData>> order_channel;
+			std::unique_ptr<Channel<TradeData>> trade_channel;
+			std::unique_ptr<Channel<PositionData>> position_channel;
+			std::unique_ptr<Channel<AccountData>> account_channel;
 		};
 	}
 }
@@ -0,0 +1,699 @@
+#include <api/Globals.h>
+#include <api/OSSupport/ThreadTopology.h>
+#include "journal.h"
+#include "event/event.h"
+#include "engine/utility.h"
+#include "engine/settings.h"
+
+namespace Keen
+{
+	namespace engine
+	{
+		const char JOURNAL_MAGIC[4] = { 'K', 'T', 'J', '1' };
+		const UInt32 JOURNAL_VERSION = 1;
+
+		// How long the writer sleeps when there is nothing to write
+		const unsigned JOURNAL_IDLE_WAIT_MS = 10;
+
+		// Buffers returned by the writer for the bus handler to reuse
+		const size_t JOURNAL_BUFFER_POOL_SIZE = 4096;
+
+		static Int64 monotonic_ns(std::chrono::steady_clock::time_point time)
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+		}
+
+		template <class T>
+		static void put_value(AString& out, const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		static void put_string(AString& out, const AString& value)
+		{
+			put_value<UInt16>(out, static_cast<UInt16>(std::min<size_t>(value.size(), UINT16_MAX)));
+			out.append(value.data(), std::min<size_t>(value.size(), UINT16_MAX));
+		}
+
+		template <class E>
+		static void put_enum(AString& out, E value)
+		{
+			put_value<Int32>(out, static_cast<Int32>(value));
+		}
+
+		static void put_datetime(AString& out, const DateTime& value)
+		{
+			put_value<Int64>(out, value.time_since_epoch().count());
+		}
+
+		// Payloads are written field by field in declaration order; kt_* ids are left out as __post_init__ rebuilds them
+
+		static void encode(AString& out, const TickData& tick)
+		{
+			put_string(out, tick.symbol);
+			put_enum(out, tick.exchange);
+			put_string(out, tick.name);
+			put_datetime(out, tick.datetime);
+			put_string(out, tick.exchange_name);
+
+			const float fields[] = {
+				tick.volume, tick.turnover, tick.open_interest, tick.last_price, tick.last_volume,
+				tick.limit_up, tick.limit_down, tick.open_price, tick.high_price, tick.low_price, tick.pre_close,
+				tick.bid_price_1, tick.bid_price_2, tick.bid_price_3, tick.bid_price_4, tick.bid_price_5,
+				tick.ask_price_1, tick.ask_price_2, tick.ask_price_3, tick.ask_price_4, tick.ask_price_5,
+				tick.bid_volume_1, tick.bid_volume_2, tick.bid_volume_3, tick.bid_volume_4, tick.bid_volume_5,
+				tick.ask_volume_1, tick.ask_volume_2, tick.ask_volume_3, tick.ask_volume_4, tick.ask_volume_5
+			};
+			out.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+		}
+
+		static void encode(AString& out, const OrderData& order)
+		{
+			put_string(out, order.symbol);
+			put_enum(out, order.exchange);
+			put_string(out, order.orderid);
+			put_enum(out, order.type);
+			put_enum(out, order.direction);
+			put_enum(out, order.offset);
+			put_value(out, order.price);
+			put_value(out, order.volume);
+			put_value(out, order.traded);
+			put_enum(out, order.status);
+			put_datetime(out, order.datetime);
+			put_string(out, order.reference);
+			put_string(out, order.exchange_name);
+		}
+
+		static void encode(AString& out, const TradeData& trade)
+		{
+			put_string(out, trade.symbol);
+			put_enum(out, trade.exchange);
+			put_string(out, trade.orderid);
+			put_string(out, trade.tradeid);
+			put_enum(out, trade.direction);
+			put_enum(out, trade.offset);
+			put_value(out, trade.price);
+			put_value(out, trade.volume);
+			put_datetime(out, trade.datetime);
+			put_string(out, trade.exchange_name);
+		}
+
+		static void encode(AString& out, const PositionData& position)
+		{
+			put_string(out, position.symbol);
+			put_enum(out, position.exchange);
+			put_enum(out, position.direction);
+			put_value(out, position.volume);
+			put_value(out, position.frozen);
+			put_value(out, position.price);
+			put_value(out, position.pnl);
+			put_value(out, position.yd_volume);
+			put_string(out, position.exchange_name);
+		}
+
+		static void encode(AString& out, const AccountData& account)
+		{
+			put_string(out, account.accountid);
+			put_value(out, account.balance);
+			put_value(out, account.frozen);
+			put_string(out, account.exchange_name);
+		}
+
+		static void encode(AString& out, const ContractData& contract)
+		{
+			put_string(out, contract.symbol);
+			put_enum(out, contract.exchange);
+			put_string(out, contract.name);
+			put_value(out, contract.instIdCode);
+			put_enum(out, contract.product);
+			put_value(out, contract.size);
+			put_value(out, contract.pricetick);
+			put_value(out, contract.min_volume);
+			put_value(out, contract.max_volume);
+			put_value(out, contract.stop_supported);
+			put_value(out, contract.history_data);
+			put_value(out, contract.net_position);
+			put_value(out, contract.option_strike);
+			put_string(out, contract.option_underlying);
+			put_enum(out, contract.option_type);
+			put_value(out, contract.option_listed);
+			put_value(out, contract.option_expiry);
+			put_string(out, contract.option_portfolio);
+			put_string(out, contract.option_index);
+			put_string(out, contract.exchange_name);
+		}
+
+		static JournalPayload encode_payload(AString& out, const Event& event)
+		{
+			const std::type_info& type = event.channel ? event.channel->payload_type() : event.data.type();
+			if (type == typeid(TickData))
+			{
+				encode(out, event.get<TickData>());
+				return JournalPayload::TICK;
+			}
+			if (type == typeid(OrderData))
+			{
+				encode(out, event.get<OrderData>());
+				return JournalPayload::ORDER;
+			}
+			if (type == typeid(TradeData))
+			{
+				encode(out, event.get<TradeData>());
+				return JournalPayload::TRADE;
+			}
+			if (type == typeid(PositionData))
+			{
+				encode(out, event.get<PositionData>());
+				return JournalPayload::POSITION;
+			}
+			if (type == typeid(AccountData))
+			{
+				encode(out, event.get<AccountData>());
+				return JournalPayload::ACCOUNT;
+			}
+			if (type == typeid(ContractData))
+			{
+				encode(out, event.get<ContractData>());
+				return JournalPayload::CONTRACT;
+			}
+			return JournalPayload::NONE;
+		}
+
+
+		/** Bounds-checked reads mirroring the put_* helpers above. Once a read runs past the end every later one fails. */
+		class JournalCursor
+		{
+		public:
+			JournalCursor(const char* data, size_t size)
+				: _data(data)
+				, _end(data + size)
+			{
+			}
+
+			template <class T>
+			bool get_value(T& value)
+			{
+				if (!this->_take(sizeof(T)))
+					return false;
+				memcpy(&value, this->_data - sizeof(T), sizeof(T));
+				return true;
+			}
+
+			bool get_string(AString& value)
+			{
+				UInt16 size;
+				if (!this->get_value(size) || !this->_take(size))
+					return false;
+				value.assign(this->_data - size, size);
+				return true;
+			}
+
+			template <class E>
+			bool get_enum(E& value)
+			{
+				Int32 raw;
+				if (!this->get_value(raw))
+					return false;
+				value = static_cast<E>(raw);
+				return true;
+			}
+
+			bool get_datetime(DateTime& value)
+			{
+				Int64 raw;
+				if (!this->get_value(raw))
+					return false;
+				value = DateTime(std::chrono::milliseconds(raw));
+				return true;
+			}
+
+		private:
+			bool _take(size_t size)
+			{
+				if (static_cast<size_t>(this->_end - this->_data) < size)
+				{
+					this->_data = this->_end;
+					return false;
+				}
+				this->_data += size;
+				return true;
+			}
+
+			const char* _data;
+			const char* _end;
+		};
+
+		static bool decode(JournalCursor& in, TickData& tick)
+		{
+			in.get_string(tick.symbol);
+			in.get_enum(tick.exchange);
+			in.get_string(tick.name);
+			in.get_datetime(tick.datetime);
+			in.get_string(tick.exchange_name);
+
+			float* fields[] = {
+				&tick.volume, &tick.turnover, &tick.open_interest, &tick.last_price, &tick.last_volume,
+				&tick.limit_up, &tick.limit_down, &tick.open_price, &tick.high_price, &tick.low_price, &tick.pre_close,
+				&tick.bid_price_1, &tick.bid_price_2, &tick.bid_price_3, &tick.bid_price_4, &tick.bid_price_5,
+				&tick.ask_price_1, &tick.ask_price_2, &tick.ask_price_3, &tick.ask_price_4, &tick.ask_price_5,
+				&tick.bid_volume_1, &tick.bid_volume_2, &tick.bid_volume_3, &tick.bid_volume_4, &tick.bid_volume_5,
+				&tick.ask_volume_1, &tick.ask_volume_2, &tick.ask_volume_3, &tick.ask_volume_4, &tick.ask_volume_5
+			};
+			bool ok = true;
+			for (float* field : fields)
+			{
+				ok = in.get_value(*field);
+			}
+			tick.__post_init__();
+			return ok;
+		}
+
+		static bool decode(JournalCursor& in, OrderData& order)
+		{
+			in.get_string(order.symbol);
+			in.get_enum(order.exchange);
+			in.get_string(order.orderid);
+			in.get_enum(order.type);
+			in.get_enum(order.direction);
+			in.get_enum(order.offset);
+			in.get_value(order.price);
+			in.get_value(order.volume);
+			in.get_value(order.traded);
+			in.get_enum(order.status);
+			in.get_datetime(order.datetime);
+			in.get_string(order.reference);
+			bool ok = in.get_string(order.exchange_name);
+			order.__post_init__();
+			return ok;
+		}
+
+		static bool decode(JournalCursor& in, TradeData& trade)
+		{
+			in.get_string(trade.symbol);
+			in.get_enum(trade.exchange);
+			in.get_string(trade.orderid);
+			in.get_string(trade.tradeid);
+			in.get_enum(trade.direction);
+			in.get_enum(trade.offset);
+			in.get_value(trade.price);
+			in.get_value(trade.volume);
+			in.get_datetime(trade.datetime);
+			bool ok = in.get_string(trade.exchange_name);
+			trade.__post_init__();
+			return ok;
+		}
+
+		static bool decode(JournalCursor& in, PositionData& position)
+		{
+			in.get_string(position.symbol);
+			in.get_enum(position.exchange);
+			in.get_enum(position.direction);
+			in.get_value(position.volume);
+			in.get_value(position.frozen);
+			in.get_value(position.price);
+			in.get_value(position.pnl);
+			in.get_value(position.yd_volume);
+			bool ok = in.get_string(position.exchange_name);
+			position.__post_init__();
+			return ok;
+		}
+
+		static bool decode(JournalCursor& in, AccountData& account)
+		{
+			in.get_string(account.accountid);
+			in.get_value(account.balance);
+			in.get_value(account.frozen);
+			bool ok = in.get_string(account.exchange_name);
+			account.__post_init__();
+			return ok;
+		}
+
+		static bool decode(JournalCursor& in, ContractData& contract)
+		{
+			in.get_string(contract.symbol);
+			in.get_enum(contract.exchange);
+			in.get_string(contract.name);
+			in.get_value(contract.instIdCode);
+			in.get_enum(contract.product);
+			in.get_value(contract.size);
+			in.get_value(contract.pricetick);
+			in.get_value(contract.min_volume);
+			in.get_value(contract.max_volume);
+			in.get_value(contract.stop_supported);
+			in.get_value(contract.history_data);
+			in.get_value(contract.net_position);
+			in.get_value(contract.option_strike);
+			in.get_string(contract.option_underlying);
+			in.get_enum(contract.option_type);
+			in.get_value(contract.option_listed);
+			in.get_value(contract.option_expiry);
+			in.get_string(contract.option_portfolio);
+			in.get_string(contract.option_index);
+			bool ok = in.get_string(contract.exchange_name);
+			contract.__post_init__();
+			return ok;
+		}
+
+
+		bool JournalReader::open(const AString& path)
+		{
+			this->close();
+
+			if (fs::is_directory(path))
+			{
+				for (const auto& entry : fs::directory_iterator(path))
+				{
+					if (entry.is_regular_file() && (entry.path().extension() == ".journal"))
+					{
+						this->_files.push_back(entry.path().string());
+					}
+				}
+			}
+			else if (fs::exists(path))
+			{
+				this->_files.push_back(path);
+			}
+
+			// Order segments by the wall clock time in their headers, file names are only unique per second
+			std::vector<std::pair<Int64, AString>> segments;
+			for (const AString& file : this->_files)
+			{
+				cMappedFile segment;
+				if (!segment.OpenRead(file) || (segment.GetSize() < sizeof(JournalSegmentHeader)))
+					continue;
+
+				JournalSegmentHeader header;
+				memcpy(&header, segment.GetData(), sizeof(header));
+				if ((memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0) || (header.version != JOURNAL_VERSION))
+					continue;
+
+				segments.emplace_back(header.created_wall_ns, file);
+			}
+			std::sort(segments.begin(), segments.end());
+
+			this->_files.clear();
+			for (auto& [created, file] : segments)
+			{
+				this->_files.push_back(file);
+			}
+
+			this->rewind();
+			return !this->_files.empty();
+		}
+
+		void JournalReader::close()
+		{
+			this->_segment.Close();
+			this->_files.clear();
+			this->_file_index = 0;
+			this->_offset = 0;
+		}
+
+		void JournalReader::rewind()
+		{
+			this->_segment.Close();
+			this->_file_index = 0;
+			this->_offset = 0;
+		}
+
+		bool JournalReader::next()
+		{
+			for (;;)
+			{
+				if (!this->_segment.IsOpen())
+				{
+					if (!this->_open_segment(this->_file_index))
+						return false;
+				}
+
+				size_t size = this->_segment.GetSize();
+				const char* data = this->_segment.GetData();
+				UInt32 record_size = 0;
+				if (this->_offset + sizeof(UInt32) <= size)
+				{
+					memcpy(&record_size, data + this->_offset, sizeof(UInt32));
+				}
+
+				// A zero size ends the segment; a size that does not fit means the writer was cut off mid-record
+				if ((record_size < sizeof(JournalRecordHeader)) || (this->_offset + record_size > size))
+				{
+					this->_segment.Close();
+					++this->_file_index;
+					continue;
+				}
+
+				const char* record = data + this->_offset;
+				this->_offset += record_size;
+				if (this->_decode(record, record_size))
+					return true;
+
+				LOGWARNING("Skipping malformed journal record in %s", this->_files[this->_file_index].c_str());
+			}
+		}
+
+		bool JournalReader::_open_segment(size_t index)
+		{
+			while (index < this->_files.size())
+			{
+				if (this->_segment.OpenRead(this->_files[index]) && (this->_segment.GetSize() >= sizeof(JournalSegmentHeader)))
+				{
+					this->_file_index = index;
+					this->_offset = sizeof(JournalSegmentHeader);
+					return true;
+				}
+				this->_segment.Close();
+				++index;
+			}
+			this->_file_index = index;
+			return false;
+		}
+
+		bool JournalReader::_decode(const char* data, size_t size)
+		{
+			JournalRecordHeader header;
+			memcpy(&header, data, sizeof(header));
+			if (sizeof(header) + header.type_size > size)
+				return false;
+
+			this->_record.type.assign(data + sizeof(header), header.type_size);
+			this->_record.timestamp = header.timestamp;
+			this->_record.payload = header.payload;
+
+			JournalCursor in(data + sizeof(header) + header.type_size, size - sizeof(header) - header.type_size);
+			switch (header.payload)
+			{
+			case JournalPayload::NONE: return true;
+			case JournalPayload::TICK: return decode(in, this->tick);
+			case JournalPayload::ORDER: return decode(in, this->order);
+			case JournalPayload::TRADE: return decode(in, this->trade);
+			case JournalPayload::POSITION: return decode(in, this->position);
+			case JournalPayload::ACCOUNT: return decode(in, this->account);
+			case JournalPayload::CONTRACT: return decode(in, this->contract);
+			}
+			return false;
+		}
+
+
+		JournalEngine::JournalEngine(TradeEngine* trade_engine, EventEmitter* event_emitter, const AString& folder)
+			: BaseEngine(trade_engine, event_emitter, "journal")
+			, _active(false)
+			, _folder(folder)
+			, _segment_size(static_cast<size_t>(SETTINGS.value("journal.segment_size_mb", 64)) << 20)
+			, _rotate_interval(SETTINGS.value("journal.rotate_minutes", 60))
+			, _queue(SETTINGS.value("journal.queue_capacity", 65536))
+			, _free_buffers(JOURNAL_BUFFER_POOL_SIZE)
+			, _offset(0)
+			, _segment_seq(0)
+			, _recorded(0)
+			, _dropped(0)
+			, _written(0)
+			, _bytes(0)
+			, _segments(0)
+		{
+			if (this->_folder.empty())
+			{
+				this->_folder = get_folder_path("journal");
+			}
+
+			this->start();
+			this->register_event();
+		}
+
+		JournalEngine::~JournalEngine()
+		{
+			this->close();
+		}
+
+		void JournalEngine::register_event()
+		{
+			this->event_emitter->register_general(std::bind(&JournalEngine::process_event, this, std::placeholders::_1));
+		}
+
+		void JournalEngine::process_event(const Event& event)
+		{
+			/*
+			* Runs on the dispatch path: encode into a pooled buffer and hand it to the writer, never wait.
+			*/
+			if (!this->_active)
+				return;
+
+			AString record;
+			this->_free_buffers.TryPop(record);
+			record.resize(sizeof(JournalRecordHeader));
+
+			UInt16 type_size = static_cast<UInt16>(std::min<size_t>(event.type.size(), UINT16_MAX));
+			record.append(event.type.data(), type_size);
+
+			JournalRecordHeader header;
+			header.payload = encode_payload(record, event);
+			header.reserved = 0;
+			header.type_size = type_size;
+			header.timestamp = monotonic_ns(std::chrono::steady_clock::now());
+
+			record.append((8 - record.size() % 8) % 8, '\0');
+			header.size = static_cast<UInt32>(record.size());
+			memcpy(record.data(), &header, sizeof(header));
+
+			++this->_recorded;
+			if (!this->_queue.TryPush(std::move(record)))
+			{
+				++this->_dropped;
+			}
+		}
+
+		void JournalEngine::start()
+		{
+			this->_active = true;
+			this->_thread = std::thread(&JournalEngine::run, this);
+		}
+
+		void JournalEngine::close()
+		{
+			if (!this->_active)
+				return;
+
+			this->event_emitter->unregister_general(std::bind(&JournalEngine::process_event, this, std::placeholders::_1));
+
+			this->_active = false;
+			m_Wakeup.Set();
+			if (this->_thread.joinable())
+			{
+				this->_thread.join();
+			}
+		}
+
+		JournalStats JournalEngine::get_stats() const
+		{
+			JournalStats stats;
+			stats.recorded = this->_recorded.load(std::memory_order_relaxed);
+			stats.dropped = this->_dropped.load(std::memory_order_relaxed);
+			stats.written = this->_written.load(std::memory_order_relaxed);
+			stats.bytes = this->_bytes.load(std::memory_order_relaxed);
+			stats.segments = this->_segments.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+		void JournalEngine::run()
+		{
+			cThreadTopology::Apply("background", "kt-journal");
+
+			AString record;
+			for (;;)
+			{
+				if (!this->_queue.TryPop(record))
+				{
+					if (!this->_active)
+					{
+						break;
+					}
+
+					// Idle: let the OS start writing back, and rotate an old segment even if nothing new arrives
+					this->_segment.Flush();
+					if (this->_segment.IsOpen() && (std::chrono::steady_clock::now() >= this->_segment_deadline))
+					{
+						this->_close_segment();
+					}
+					m_Wakeup.Wait(JOURNAL_IDLE_WAIT_MS);
+					continue;
+				}
+
+				this->_write(record);
+
+				record.clear();
+				this->_free_buffers.TryPush(std::move(record));
+			}
+
+			this->_close_segment();
+		}
+
+		void JournalEngine::_write(const AString& record)
+		{
+			// Always leave room for the zero size that ends the segment
+			size_t needed = record.size() + sizeof(UInt32);
+			if (needed + sizeof(JournalSegmentHeader) > this->_segment_size)
+			{
+				++this->_dropped;
+				return;
+			}
+
+			if (this->_segment.IsOpen() &&
+				((this->_offset + needed > this->_segment.GetSize()) || (std::chrono::steady_clock::now() >= this->_segment_deadline)))
+			{
+				this->_close_segment();
+			}
+
+			if (!this->_segment.IsOpen() && !this->_open_segment())
+			{
+				++this->_dropped;
+				return;
+			}
+
+			// Body first, size last: a reader never sees a size whose record is not complete
+			char* dest = this->_segment.GetData() + this->_offset;
+			memcpy(dest + sizeof(UInt32), record.data() + sizeof(UInt32), record.size() - sizeof(UInt32));
+			std::atomic_thread_fence(std::memory_order_release);
+			memcpy(dest, record.data(), sizeof(UInt32));
+
+			this->_offset += record.size();
+			++this->_written;
+			this->_bytes += record.size();
+		}
+
+		bool JournalEngine::_open_segment()
+		{
+			AString filename = Printf("kt_%s_%llu.journal",
+				DateTimeToString(currentDateTime(), "%Y%m%d_%H%M%S").c_str(), this->_segment_seq++);
+			AString path = this->_folder + cFile::PathSeparator() + filename;
+			if (!this->_segment.Create(path, this->_segment_size))
+			{
+				this->trade_engine->write_log("Failed to create journal segment " + path);
+				return false;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			JournalSegmentHeader header;
+			memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+			header.version = JOURNAL_VERSION;
+			header.created_wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			header.created_mono_ns = monotonic_ns(now);
+			header.reserved = 0;
+			memcpy(this->_segment.GetData(), &header, sizeof(header));
+
+			this->_offset = sizeof(header);
+			this->_segment_deadline = now + this->_rotate_interval;
+			++this->_segments;
+			return true;
+		}
+
+		void JournalEngine::_close_segment()
+		{
+			if (!this->_segment.IsOpen())
+				return;
+
+			// Keep the end marker, then give back the unused tail of the segment
+			this->_segment.Close(this->_offset + sizeof(UInt32));
+			this->_offset = 0;
+		}
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <engine/engine.h>
+#include <api/OSSupport/LockFreeQueue.h>
+
+namespace Keen
+{
+	namespace engine
+	{
+		/** Which payload follows a journal record's type string. */
+		enum class JournalPayload : UInt8 {
+			NONE,
+			TICK,
+			ORDER,
+			TRADE,
+			POSITION,
+			ACCOUNT,
+			CONTRACT
+		};
+
+		/** Start of every journal segment file. Records follow it back to back until one with size 0. */
+		struct JournalSegmentHeader
+		{
+			char magic[4];              // "KTJ1"
+			UInt32 version;
+			Int64 created_wall_ns;      // system_clock when the segment was opened
+			Int64 created_mono_ns;      // steady_clock at the same moment, to map record timestamps to wall time
+			UInt64 reserved;
+		};
+
+		/** Precedes each record. The type string and the payload follow it, padded to 8 bytes. */
+		struct JournalRecordHeader
+		{
+			UInt32 size;                // whole record including this header, 0 marks the end of the segment
+			JournalPayload payload;
+			UInt8 reserved;
+			UInt16 type_size;
+			Int64 timestamp;            // steady_clock nanoseconds when the event was dispatched
+		};
+
+		static_assert(sizeof(JournalSegmentHeader) == 32, "Journal segment header must stay 32 bytes");
+		static_assert(sizeof(JournalRecordHeader) == 16, "Journal record header must stay 16 bytes");
+
+		class JournalStats
+		{
+		public:
+			UInt64 recorded = 0;    // events encoded by the bus handler
+			UInt64 dropped = 0;     // events lost because the writer fell behind
+			UInt64 written = 0;     // records written to segments
+			UInt64 bytes = 0;
+			UInt64 segments = 0;
+		};
+
+		/** One decoded journal record. The payload, if any, is in the JournalReader member matching payload. */
+		class JournalRecord
+		{
+		public:
+			AString type;
+			Int64 timestamp = 0;
+			JournalPayload payload = JournalPayload::NONE;
+		};
+
+		/** Reads journal segments back in the order they were written.
+		Payloads are decoded into the reader's members, which are reused from record to record. */
+		class KEEN_ENGINE_EXPORT JournalReader
+		{
+		public:
+			/** Opens a single segment file, or every segment in a journal folder. Returns false if there is none. */
+			bool open(const AString& path);
+
+			void close();
+
+			/** Moves back to the first record of the first segment. */
+			void rewind();
+
+			/** Reads the next record. Returns false at the end of the journal. */
+			bool next();
+
+			const JournalRecord& record() const { return this->_record; }
+
+		public:
+			TickData tick;
+			OrderData order;
+			TradeData trade;
+			PositionData position;
+			AccountData account;
+			ContractData contract;
+
+		protected:
+			bool _open_segment(size_t index);
+
+			bool _decode(const char* data, size_t size);
+
+			std::vector<AString> _files;
+			size_t _file_index = 0;
+			cMappedFile _segment;
+			size_t _offset = 0;
+			JournalRecord _record;
+		};
+
+		/** Appends every event seen on the bus to memory-mapped segment files.
+		The bus handler only encodes the event into a pooled buffer and queues it; a writer thread copies the records
+		into the current segment and rotates segments by size and age. If the writer falls behind, records are dropped
+		rather than holding up dispatch. Segments go to folder, or to the trader's journal folder when it is empty. */
+		class KEEN_ENGINE_EXPORT JournalEngine : public BaseEngine
+		{
+		public:
+			JournalEngine(TradeEngine* trade_engine, EventEmitter* event_emitter, const AString& folder = "");
+			~JournalEngine();
+
+			void register_event();
+
+			void process_event(const Event& event);
+
+			void start();
+
+			void close() override;
+
+			JournalStats get_stats() const;
+
+		protected:
+			void run();
+
+			void _write(const AString& record);
+
+			bool _open_segment();
+
+			void _close_segment();
+
+			std::atomic<bool> _active;
+			AString _folder;
+			size_t _segment_size;
+			std::chrono::minutes _rotate_interval;
+
+			cLockFreeQueue<AString> _queue;
+			cLockFreeQueue<AString> _free_buffers;
+			cEvent m_Wakeup;
+			std::thread _thread;
+
+			cMappedFile _segment;
+			size_t _offset;
+			UInt64 _segment_seq;
+			std::chrono::steady_clock::time_point _segment_deadline;
+
+			std::atomic<UInt64> _recorded;
+			std::atomic<UInt64> _dropped;
+			std::atomic<UInt64> _written;
+			std::atomic<UInt64> _bytes;
+			std::atomic<UInt64> _segments;
+		};
+	}
+}
@@ -0,0 +1,276 @@
+#include <api/Globals.h>
+#include <api/OSSupport/ThreadTopology.h>
+#include "replay.h"
+#include "event/event.h"
+#include "engine/utility.h"
+#include "engine/settings.h"
+
+namespace Keen
+{
+	namespace engine
+	{
+		ReplayExchange::ReplayExchange(EventEmitter* event_emitter, AString exchange_name)
+			: BaseExchange(event_emitter, exchange_name)
+		{
+		}
+
+		void ReplayExchange::connect([[maybe_unused]] const Json& setting)
+		{
+		}
+
+		void ReplayExchange::close()
+		{
+		}
+
+		void ReplayExchange::subscribe([[maybe_unused]] const SubscribeRequest& req)
+		{
+		}
+
+		AString ReplayExchange::send_order(const OrderRequest& req)
+		{
+			this->order_requests.push_back(req);
+
+			// Hand out the live id of the next recorded order, as long as the strategy still does what it did live
+			if (!this->_recorded_orders.empty())
+			{
+				const OrderData& recorded = this->_recorded_orders.front();
+				if ((recorded.symbol == req.symbol) && (recorded.direction == req.direction))
+				{
+					AString kt_orderid = recorded.kt_orderid;
+					this->_recorded_orders.pop_front();
+					return kt_orderid;
+				}
+
+				this->write_log(Printf("Replay diverged: order %s %s does not match the recorded %s",
+					req.symbol.c_str(), str_direction(req.direction).c_str(), recorded.kt_orderid.c_str()));
+				this->_recorded_orders.clear();
+			}
+
+			OrderData order = req.create_order_data(Printf("replay%llu", ++this->_order_count), this->exchange_name);
+			order.status = Status::NOTTRADED;
+			this->_local_orderids.insert(order.orderid);
+			this->on_order(order);
+			return order.kt_orderid;
+		}
+
+		void ReplayExchange::cancel_order(const CancelRequest& req)
+		{
+			this->cancel_requests.push_back(req);
+
+			// Recorded orders get their cancellation from the journal
+			if (!this->_local_orderids.count(req.orderid))
+				return;
+
+			OrderData order;
+			order.symbol = req.symbol;
+			order.exchange = req.exchange;
+			order.orderid = req.orderid;
+			order.exchange_name = this->exchange_name;
+			order.status = Status::CANCELLED;
+			order.__post_init__();
+			this->_local_orderids.erase(req.orderid);
+			this->on_order(order);
+		}
+
+		void ReplayExchange::query_account()
+		{
+		}
+
+		void ReplayExchange::query_position()
+		{
+		}
+
+		void ReplayExchange::add_recorded_order(const OrderData& order)
+		{
+			this->_recorded_orders.push_back(order);
+		}
+
+
+		ReplayEngine::ReplayEngine(TradeEngine* trade_engine, EventEmitter* event_emitter)
+			: BaseEngine(trade_engine, event_emitter, "replay")
+			, _speed(0)
+			, _active(false)
+			, _finished(false)
+			, _replayed(0)
+			, _skipped(0)
+		{
+			if (SETTINGS.value("event.priority_lanes", true) || SETTINGS.value("event.conflate_ticks", false) ||
+				(SETTINGS.value("event.timer_interval_ms", 1000) != 0) || (SETTINGS.value("event.overflow_policy", "block") != "block"))
+			{
+				this->trade_engine->write_log("Replay: the event settings reorder or drop events, handlers may not see the recorded sequence");
+			}
+		}
+
+		ReplayEngine::~ReplayEngine()
+		{
+			this->close();
+		}
+
+		void ReplayEngine::use_replay_settings()
+		{
+			SETTINGS["event.priority_lanes"] = false;
+			SETTINGS["event.conflate_ticks"] = false;
+			SETTINGS["event.timer_interval_ms"] = 0;
+			SETTINGS["event.overflow_policy"] = "block";
+			SETTINGS["journal.active"] = false;
+		}
+
+		bool ReplayEngine::load(const AString& path)
+		{
+			if (!this->_reader.open(path))
+			{
+				this->trade_engine->write_log("Replay: no journal found at " + path);
+				return false;
+			}
+
+			// Register the stub exchanges and collect the order ids the live exchanges handed out, in order
+			std::set<AString> seen_orders;
+			while (this->_reader.next())
+			{
+				const JournalRecord& record = this->_reader.record();
+				switch (record.payload)
+				{
+				case JournalPayload::TICK: this->_exchange_for(this->_reader.tick.exchange_name); break;
+				case JournalPayload::TRADE: this->_exchange_for(this->_reader.trade.exchange_name); break;
+				case JournalPayload::POSITION: this->_exchange_for(this->_reader.position.exchange_name); break;
+				case JournalPayload::ACCOUNT: this->_exchange_for(this->_reader.account.exchange_name); break;
+				case JournalPayload::CONTRACT: this->_exchange_for(this->_reader.contract.exchange_name); break;
+				case JournalPayload::ORDER:
+					if (seen_orders.insert(this->_reader.order.kt_orderid).second)
+					{
+						this->_exchange_for(this->_reader.order.exchange_name)->add_recorded_order(this->_reader.order);
+					}
+					break;
+				case JournalPayload::NONE:
+					break;
+				}
+			}
+			this->_reader.rewind();
+			return true;
+		}
+
+		void ReplayEngine::set_speed(double speed)
+		{
+			ASSERT(!this->_active);
+
+			this->_speed = std::max(speed, 0.0);
+		}
+
+		void ReplayEngine::start()
+		{
+			this->_active = true;
+			this->_finished = false;
+			this->_started = std::chrono::steady_clock::now();
+			this->_thread = std::thread(&ReplayEngine::run, this);
+		}
+
+		void ReplayEngine::join()
+		{
+			if (this->_thread.joinable())
+			{
+				this->_thread.join();
+			}
+		}
+
+		void ReplayEngine::close()
+		{
+			this->_active = false;
+			this->join();
+		}
+
+		ReplayStats ReplayEngine::get_stats() const
+		{
+			ReplayStats stats;
+			stats.replayed = this->_replayed.load(std::memory_order_relaxed);
+			stats.skipped = this->_skipped.load(std::memory_order_relaxed);
+			stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->_started).count();
+			return stats;
+		}
+
+		ReplayExchange* ReplayEngine::get_exchange(const AString& exchange_name)
+		{
+			return GetWithNull(this->_exchanges, exchange_name);
+		}
+
+		void ReplayEngine::run()
+		{
+			cThreadTopology::Apply("replay", "kt-replay");
+
+			Int64 first_timestamp = 0;
+			bool first = true;
+
+			while (this->_active && this->_reader.next())
+			{
+				if (this->_speed > 0)
+				{
+					// Sleep until the record's offset from the first one, scaled by speed, has passed
+					Int64 timestamp = this->_reader.record().timestamp;
+					if (first)
+					{
+						first_timestamp = timestamp;
+						first = false;
+					}
+					auto offset = std::chrono::nanoseconds(static_cast<Int64>((timestamp - first_timestamp) / this->_speed));
+					std::this_thread::sleep_until(this->_started + offset);
+				}
+
+				if (this->_replay_record())
+					++this->_replayed;
+				else
+					++this->_skipped;
+			}
+
+			this->_finished = true;
+			this->trade_engine->write_log(Printf("Replay finished: %llu events replayed, %llu skipped",
+				this->_replayed.load(), this->_skipped.load()));
+		}
+
+		bool ReplayEngine::_replay_record()
+		{
+			const JournalRecord& record = this->_reader.record();
+			switch (record.payload)
+			{
+			case JournalPayload::TICK:
+				this->_exchange_for(this->_reader.tick.exchange_name)->on_tick(this->_reader.tick);
+				return true;
+			case JournalPayload::ORDER:
+				this->_exchange_for(this->_reader.order.exchange_name)->on_order(this->_reader.order);
+				return true;
+			case JournalPayload::TRADE:
+				this->_exchange_for(this->_reader.trade.exchange_name)->on_trade(this->_reader.trade);
+				return true;
+			case JournalPayload::POSITION:
+				this->_exchange_for(this->_reader.position.exchange_name)->on_position(this->_reader.position);
+				return true;
+			case JournalPayload::ACCOUNT:
+				this->_exchange_for(this->_reader.account.exchange_name)->on_account(this->_reader.account);
+				return true;
+			case JournalPayload::CONTRACT:
+				this->_exchange_for(this->_reader.contract.exchange_name)->on_contract(this->_reader.contract);
+				return true;
+			case JournalPayload::NONE:
+				break;
+			}
+
+			// Logs and app events are produced again by the engines themselves
+			if (record.type == EVENT_TIMER)
+			{
+				this->event_emitter->put(Event(EVENT_TIMER));
+				return true;
+			}
+			return false;
+		}
+
+		ReplayExchange* ReplayEngine::_exchange_for(const AString& exchange_name)
+		{
+			ReplayExchange* exchange = GetWithNull(this->_exchanges, exchange_name);
+			if (exchange == nullptr)
+			{
+				exchange = new ReplayExchange(this->event_emitter, exchange_name);
+				this->_exchanges[exchange_name] = exchange;
+				this->trade_engine->add_exchange(exchange);
+			}
+			return exchange;
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <engine/exchange.h>
+#include <engine/journal.h>
+
+namespace Keen
+{
+	namespace engine
+	{
+		/** Stands in for a live exchange while a journal is replayed.
+		Orders get the ids the live exchange gave them, in the order they were sent, so the recorded order and trade
+		events that follow reach the strategies that sent them. Once the strategies send more orders than were recorded,
+		orders get local ids and are acknowledged (and cancelled) by the stub itself. Every request is kept. */
+		class KEEN_ENGINE_EXPORT ReplayExchange : public BaseExchange
+		{
+		public:
+			ReplayExchange(EventEmitter* event_emitter, AString exchange_name);
+
+			void connect(const Json& setting) override;
+
+			void close() override;
+
+			void subscribe(const SubscribeRequest& req) override;
+
+			AString send_order(const OrderRequest& req) override;
+
+			void cancel_order(const CancelRequest& req) override;
+
+			void query_account() override;
+
+			void query_position() override;
+
+			/** Queues the id of an order the live exchange reported, see the class comment. */
+			void add_recorded_order(const OrderData& order);
+
+		public:
+			std::list<OrderRequest> order_requests;
+			std::list<CancelRequest> cancel_requests;
+
+		protected:
+			std::deque<OrderData> _recorded_orders;
+			std::set<AString> _local_orderids;
+			UInt64 _order_count = 0;
+		};
+
+		class ReplayStats
+		{
+		public:
+			UInt64 replayed = 0;    // events put on the bus
+			UInt64 skipped = 0;     // records that engines produce themselves during replay (logs, app events)
+			double elapsed = 0;     // seconds since start()
+		};
+
+		/** Feeds a recorded journal into the event bus, as fast as possible or at a multiple of the recorded pace.
+		Ticks, orders, trades, positions, accounts and contracts go through ReplayExchange stubs registered under the
+		recorded exchange names, so they are published exactly like live ones; EVENT_TIMER is replayed as recorded.
+
+		Handlers only see the recorded sequence if the emitter dispatches in put() order. Before the TradeEngine is
+		created call use_replay_settings(), or set event.priority_lanes and event.conflate_ticks to false,
+		event.timer_interval_ms to 0 and keep event.overflow_policy at "block". */
+		class KEEN_ENGINE_EXPORT ReplayEngine : public BaseEngine
+		{
+		public:
+			ReplayEngine(TradeEngine* trade_engine, EventEmitter* event_emitter);
+			~ReplayEngine();
+
+			/** Switches the settings read by the TradeEngine constructor to in-order dispatch and turns the journal
+			off, so a replay is not recorded again. */
+			static void use_replay_settings();
+
+			/** Opens a journal folder or segment and registers a ReplayExchange for every exchange it mentions. */
+			bool load(const AString& path);
+
+			/** 0 replays as fast as possible, otherwise the recorded pace is multiplied by speed. Call before start(). */
+			void set_speed(double speed);
+
+			void start();
+
+			/** Returns once every record has been put on the bus; dispatch may still be catching up. */
+			void join();
+
+			void close() override;
+
+			bool is_finished() const { return this->_finished; }
+
+			ReplayStats get_stats() const;
+
+			ReplayExchange* get_exchange(const AString& exchange_name);
+
+		protected:
+			void run();
+
+			bool _replay_record();
+
+			ReplayExchange* _exchange_for(const AString& exchange_name);
+
+			JournalReader _reader;
+			std::map<AString, ReplayExchange*> _exchanges;
+			double _speed;
+
+			std::atomic<bool> _active;
+			std::atomic<bool> _finished;
+			std::thread _thread;
+
+			std::atomic<UInt64> _replayed;
+			std::atomic<UInt64> _skipped;
+			std::chrono::steady_clock::time_point _started;
+		};
+	}
+}
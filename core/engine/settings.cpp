@@ -11,6 +11,49 @@ namespace Keen
 			{ "log.console", true },
 			{ "log.file", true },
 
+			{ "event.queue_capacity", 65536 },
+			{ "event.overflow_policy", "block" },  // block, drop_oldest or fail; orders and trades always block
+			{ "event.batch_drain", false },  // opt in to posting pending events to the main loop in batches
+			{ "event.max_batch_size", 1024 },
+			{ "event.shards", 0 },  // worker threads for handlers registered with register_sharded; none of the engines registers one
+			{ "event.conflate_ticks", false },  // keep only the latest queued tick per symbol
+			{ "event.priority_lanes", true },  // false dispatches every event in put() order
+			{ "event.starvation_limit", 64 },  // higher priority events dispatched before a waiting lower lane gets a turn
+			{ "event.wait_strategy", "blocking" },  // blocking, spin_yield or busy_spin, for the dispatcher and the main loop
+			{ "event.spin_budget_us", 0 },  // spinning before the dispatcher or main loop parks, 0 spins forever
+			{ "event.timer_interval_ms", 1000 },  // period of EVENT_TIMER, 0 turns it off
+
+			{ "io.network_threads", 0 },  // threads for websocket I/O and parsing, 0 keeps it on the main loop
+			{ "io.order_network_threads", 0 },  // threads for order entry connections only, 0 shares io.network_threads
+			{ "io.http_connections", 8 },  // kept-alive REST connections per server
+			{ "io.http_idle_timeout_s", 30 },  // an idle REST connection is closed after this long
+
+			// Thread roles: cpus is a CPU list such as "2" or "0-1,4" (empty leaves the threads unpinned),
+			// priority > 0 is a real-time priority, < 0 lowers it (-5 is nice 5) and 0 leaves it unchanged.
+			// Keep main, order, network and dispatcher on cores that http and background never get.
+			{ "thread.main.cpus", "" },  // the main loop: handlers, strategies and the order path
+			{ "thread.main.priority", 0 },
+			{ "thread.network.cpus", "" },  // io.network_threads: market data and websocket I/O
+			{ "thread.network.priority", 0 },
+			{ "thread.order.cpus", "" },  // io.order_network_threads: order entry and order updates
+			{ "thread.order.priority", 0 },
+			{ "thread.dispatcher.cpus", "" },  // the event dispatcher
+			{ "thread.dispatcher.priority", 0 },
+			{ "thread.shard.cpus", "" },  // event.shards workers
+			{ "thread.shard.priority", 0 },
+			{ "thread.http.cpus", "" },  // REST requests and polling
+			{ "thread.http.priority", 0 },
+			{ "thread.http.threads", 0 },  // 0 for one per core
+			{ "thread.background.cpus", "" },  // email, notices and the journal writer
+			{ "thread.background.priority", 0 },
+			{ "thread.replay.cpus", "" },  // the replay engine's reader
+			{ "thread.replay.priority", 0 },
+
+			{ "journal.active", false },  // record all bus traffic to .keen_trader/journal
+			{ "journal.segment_size_mb", 64 },
+			{ "journal.rotate_minutes", 60 },
+			{ "journal.queue_capacity", 65536 },
+
 			{ "email.server", "" },
 			{ "email.port", 465 },
 			{ "email.username", "" },
@@ -1,8 +1,9 @@
 #include <api/Globals.h>
 #include "event.h"
-#define ASIO_STANDALONE 1
-
-#include <asio.hpp>
+#include <api/OSSupport/ThreadTopology.h>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#include <immintrin.h>
+#endif
 
 namespace Keen
 {
@@ -18,23 +19,431 @@ namespace Keen
 		const char* EVENT_CONTRACT = "eContract.";
 		const char* EVENT_LOG = "eLog.";
 
+		const size_t DEFAULT_QUEUE_CAPACITY = 65536;
+		const size_t DEFAULT_MAX_BATCH_SIZE = 1024;
+		const size_t DEFAULT_STARVATION_LIMIT = 64;
+
+		const size_t LANE_COUNT = 3;  // one per EventPriority
+
+		// Events posted to the main loop but not handled yet, when not batch draining (one batch otherwise)
+		const size_t DISPATCH_WINDOW = 256;
+
+		// Number of drained batches kept around for reuse by the dispatcher
+		const size_t BATCH_POOL_SIZE = 64;
+
+		using EventBatch = std::vector<Event>;
+
+		// Placeholder queued for a conflated tick, the tick itself waits in the emitter's pending table
+		const char* EVENT_CONFLATED_TICK = "eConflatedTick.";
+
+
+		// Pause instructions between clock reads while busy spinning
+		const size_t SPIN_CHECK_INTERVAL = 64;
+
+		// Pause instructions before a spin-then-yield wait starts yielding
+		const size_t SPIN_BEFORE_YIELD = 128;
+
+		/** Tells the core we are in a spin loop, so a sibling hyperthread gets the execution units. */
+		static inline void cpu_relax()
+		{
+		#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+			_mm_pause();
+		#else
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		#endif
+		}
+
+
+		/** Wakes a parked consumer thread, paying for the condition variable only when it is actually asleep.
+		With a spinning strategy the consumer polls before parking, and producers skip the kernel entirely
+		as long as it is still polling. */
+		class WakeSignal
+		{
+		public:
+			void set_strategy(WaitStrategy strategy, std::chrono::microseconds spin_budget)
+			{
+				this->_strategy = strategy;
+				this->_spin_budget = spin_budget;
+			}
+
+			void notify()
+			{
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (this->_sleeping.load(std::memory_order_relaxed))
+				{
+					this->_event.Set();
+				}
+			}
+
+			/** Unconditionally wakes the consumer, used on shutdown. */
+			void wake()
+			{
+				this->_event.Set();
+			}
+
+			template <class Pred>
+			void wait(Pred ready)
+			{
+				auto now = std::chrono::steady_clock::now();
+				this->_add(this->_busy_ns, now - this->_woken);
+
+				bool done = (this->_strategy != WaitStrategy::BLOCKING) && this->_spin(ready, now);
+				if (!done)
+				{
+					this->_park(ready);
+				}
+				this->_woken = std::chrono::steady_clock::now();
+			}
+
+			/** Starts the busy clock, called by the consumer thread before its first wait. */
+			void begin()
+			{
+				this->_woken = std::chrono::steady_clock::now();
+			}
+
+			UInt64 get_busy_ns() const { return this->_busy_ns.load(std::memory_order_relaxed); }
+
+			UInt64 get_spin_ns() const { return this->_spin_ns.load(std::memory_order_relaxed); }
+
+			UInt64 get_parks() const { return this->_parks.load(std::memory_order_relaxed); }
+
+		private:
+			/** Polls until ready or until the spin budget is used up. Returns true if it became ready. */
+			template <class Pred>
+			bool _spin(Pred& ready, std::chrono::steady_clock::time_point start)
+			{
+				auto deadline = start + this->_spin_budget;
+				bool bounded = (this->_spin_budget.count() > 0);
+				bool result = false;
+
+				for (size_t i = 1; ; ++i)
+				{
+					if (ready())
+					{
+						result = true;
+						break;
+					}
+
+					if ((this->_strategy == WaitStrategy::SPIN_YIELD) && (i > SPIN_BEFORE_YIELD))
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						cpu_relax();
+						if ((i % SPIN_CHECK_INTERVAL) != 0)
+						{
+							continue;
+						}
+					}
+
+					if (bounded && (std::chrono::steady_clock::now() >= deadline))
+					{
+						break;
+					}
+				}
+
+				this->_add(this->_spin_ns, std::chrono::steady_clock::now() - start);
+				return result;
+			}
+
+			template <class Pred>
+			void _park(Pred& ready)
+			{
+				this->_sleeping.store(true, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				// Re-check after announcing we are about to sleep, a producer may have pushed in between
+				if (!ready())
+				{
+					++this->_parks;
+					this->_event.Wait();
+				}
+
+				this->_sleeping.store(false, std::memory_order_relaxed);
+			}
+
+			/** Only the consumer thread writes the counters, so a relaxed load and store is enough. */
+			static void _add(std::atomic<UInt64>& counter, std::chrono::steady_clock::duration elapsed)
+			{
+				UInt64 ns = static_cast<UInt64>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+				counter.store(counter.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+			}
+
+			std::atomic<bool> _sleeping = false;
+			cEvent _event;
+
+			WaitStrategy _strategy = WaitStrategy::BLOCKING;
+			std::chrono::microseconds _spin_budget = std::chrono::microseconds(0);
+
+			std::chrono::steady_clock::time_point _woken;
+			std::atomic<UInt64> _busy_ns = 0;
+			std::atomic<UInt64> _spin_ns = 0;
+			std::atomic<UInt64> _parks = 0;
+		};
+
+
+		/** Insert-only hash index of (type, key) pairs that readers probe without a lock. Entries never move once
+		added; when the slot array gets half full it is rebuilt at twice the size and published, and the replaced
+		arrays are kept since a reader may still be probing one. Together they stay smaller than the current array,
+		so memory grows linearly with the number of keys. insert() must be serialized by the caller. */
+		class KeyIndex
+		{
+		public:
+			KeyIndex()
+			{
+				this->_grow(16);
+			}
+
+			/** Id stored for the pair, 0 if there is none. */
+			UInt32 find(const AString& type, const AString& key) const
+			{
+				size_t hash = _hash(type, key);
+				const Slots* slots = this->_slots.load(std::memory_order_acquire);
+				for (size_t i = hash & slots->mask; ; i = (i + 1) & slots->mask)
+				{
+					const Entry* entry = slots->entries[i].load(std::memory_order_acquire);
+					if (entry == nullptr)
+					{
+						return 0;
+					}
+					if ((entry->hash == hash) && (entry->key == key) && (entry->type == type))
+					{
+						return entry->id;
+					}
+				}
+			}
+
+			/** Adds a pair that find() does not know yet. */
+			void insert(const AString& type, const AString& key, UInt32 id)
+			{
+				const Slots* slots = this->_slots.load(std::memory_order_relaxed);
+				if ((this->_entries.size() + 1) * 2 > slots->mask + 1)
+				{
+					this->_grow((slots->mask + 1) * 2);
+					slots = this->_slots.load(std::memory_order_relaxed);
+				}
+
+				const Entry& entry = this->_entries.emplace_back(Entry{ type, key, id, _hash(type, key) });
+				_place(*slots, &entry);
+			}
+
+		private:
+			struct Entry
+			{
+				AString type;
+				AString key;
+				UInt32 id;
+				size_t hash;
+			};
+
+			struct Slots
+			{
+				size_t mask;
+				std::unique_ptr<std::atomic<const Entry*>[]> entries;
+			};
+
+			static size_t _hash(const AString& type, const AString& key)
+			{
+				return std::hash<AString>()(key) ^ (std::hash<AString>()(type) * 0x9E3779B97F4A7C15ull);
+			}
+
+			static void _place(const Slots& slots, const Entry* entry)
+			{
+				size_t i = entry->hash & slots.mask;
+				while (slots.entries[i].load(std::memory_order_relaxed) != nullptr)
+				{
+					i = (i + 1) & slots.mask;
+				}
+				slots.entries[i].store(entry, std::memory_order_release);
+			}
+
+			void _grow(size_t size)
+			{
+				auto next = std::make_unique<Slots>();
+				next->mask = size - 1;
+				next->entries.reset(new std::atomic<const Entry*>[size]);
+				for (size_t i = 0; i < size; ++i)
+				{
+					next->entries[i].store(nullptr, std::memory_order_relaxed);
+				}
+				for (const Entry& entry : this->_entries)
+				{
+					_place(*next, &entry);
+				}
+				this->_slots.store(next.get(), std::memory_order_release);
+				this->_versions.push_back(std::move(next));
+			}
+
+			std::deque<Entry> _entries;  // never moves an entry on push_back
+			std::atomic<const Slots*> _slots;  // latest of _versions
+			std::vector<std::unique_ptr<const Slots>> _versions;
+		};
+
+
+		/** Worker thread running shard-safe handlers for the routes hashed onto it, in queue order. */
+		class EventShard
+		{
+		public:
+			using ProcessType = FnMut<void(const Event&)>;
+
+			EventShard(size_t index, size_t capacity, ProcessType process)
+				: _queue(capacity)
+				, _process(std::move(process))
+				, _index(index)
+			{
+			}
+
+			void start()
+			{
+				this->_active = true;
+				this->_thread = std::thread(&EventShard::_run, this);
+			}
+
+			void stop()
+			{
+				this->_active = false;
+				this->_signal.wake();
+				if (this->_thread.joinable())
+				{
+					this->_thread.join();
+				}
+			}
+
+			/** Blocks while the shard is full so that per-route ordering is never broken. */
+			bool put(const Event& event)
+			{
+				while (!this->_queue.TryPush(event))
+				{
+					if (!this->_active)
+					{
+						return false;
+					}
+					std::this_thread::yield();
+				}
+				this->_signal.notify();
+				return true;
+			}
+
+		private:
+			void _run()
+			{
+				cThreadTopology::Apply("shard", "kt-shard-" + std::to_string(this->_index));
+				for (;;)
+				{
+					if (!this->_active)
+					{
+						return;
+					}
+
+					Event event;
+					if (!this->_queue.TryPop(event))
+					{
+						this->_signal.wait([this]() { return !this->_active || !this->_queue.IsEmptyApprox(); });
+						continue;
+					}
+
+					this->_process(event);
+				}
+			}
+
+			cLockFreeQueue<Event> _queue;
+			ProcessType _process;
+			size_t _index;
+			WakeSignal _signal;
+			std::atomic<bool> _active = false;
+			std::thread _thread;
+		};
+
 
 		class EventEmitterImpl : public EventEmitter
 		{
 		public:
-			EventEmitterImpl(asio::io_service* io_service)
-				: _interval(1)
+			EventEmitterImpl()
+				: _interval(std::chrono::seconds(1))
+				, _starvation_limit(DEFAULT_STARVATION_LIMIT)
+				, _overflow_policy(OverflowPolicy::BLOCK)
+				, _batch_drain(false)
+				, _max_batch_size(DEFAULT_MAX_BATCH_SIZE)
+				, _free_batches(BATCH_POOL_SIZE)
 				, _active(false)
-				, _timer(*io_service)
 			{
+				this->_make_lanes(DEFAULT_QUEUE_CAPACITY);
+
+				this->_priorities[EVENT_ORDER] = EventPriority::EXECUTION;
+				this->_priorities[EVENT_TRADE] = EventPriority::EXECUTION;
+				this->_priorities[EVENT_POSITION] = EventPriority::EXECUTION;
+				this->_priorities[EVENT_ACCOUNT] = EventPriority::EXECUTION;
+				this->_priorities[EVENT_TIMER] = EventPriority::BACKGROUND;
+				this->_priorities[EVENT_LOG] = EventPriority::BACKGROUND;
+			}
+
+			~EventEmitterImpl()
+			{
+				EventBatch* batch;
+				while (this->_free_batches.TryPop(batch))
+				{
+					delete batch;
+				}
+			}
+
+			void set_queue(size_t capacity, OverflowPolicy policy = OverflowPolicy::BLOCK)
+			{
+				ASSERT(!this->_active);
+
+				this->_make_lanes(capacity);
+				this->_overflow_policy = policy;
+			}
+
+			void set_priority(const AString& type, EventPriority priority)
+			{
+				ASSERT(!this->_active);
+
+				this->_priorities[type] = priority;
+			}
+
+			void set_starvation_limit(size_t limit)
+			{
+				ASSERT(!this->_active);
 
+				this->_starvation_limit = std::max<size_t>(limit, 1);
 			}
 
-			void start(int interval = 1)
+			void set_batch_drain(bool enabled, size_t max_batch_size = DEFAULT_MAX_BATCH_SIZE)
+			{
+				ASSERT(!this->_active);
+
+				this->_batch_drain = enabled;
+				this->_max_batch_size = std::max<size_t>(max_batch_size, 1);
+			}
+
+			void set_tick_conflation(bool enabled)
+			{
+				ASSERT(!this->_active);
+
+				this->_conflate_ticks = enabled;
+			}
+
+			void set_wait_strategy(WaitStrategy strategy, std::chrono::microseconds spin_budget = std::chrono::microseconds(0))
+			{
+				ASSERT(!this->_active);
+
+				this->_signal.set_strategy(strategy, spin_budget);
+			}
+
+			void start(std::chrono::milliseconds interval = std::chrono::seconds(1))
 			{
 				this->_active = true;
 				this->_interval = interval;
 
+				for (size_t i = 0; i < this->_shard_count; ++i)
+				{
+					auto shard = std::make_unique<EventShard>(i, this->_lanes[0]->Capacity(),
+						[this, snapshot = ShardedSnapshot()](const Event& event) mutable { this->_process_sharded(event, snapshot); });
+					shard->start();
+					this->_shards.push_back(std::move(shard));
+				}
+
 				this->_thread = std::thread(&EventEmitterImpl::_run, this);
 
 				_run_timer();
@@ -43,49 +452,144 @@ namespace Keen
 			void stop()
 			{
 				this->_active = false;
-				m_QueueNonempty.Set();
+				this->_signal.wake();
 				this->_thread.join();
+				this->_timer.cancel();
+
+				for (auto& shard : this->_shards)
+				{
+					shard->stop();
+				}
+				this->_shards.clear();
+			}
+
+			bool put(const Event& event)
+			{
+				++this->_put_count;
+
+				if (this->_conflate_ticks && (event.route != 0) && (event.type == EVENT_TICK))
+				{
+					return this->_put_conflated(event);
+				}
+				return this->_push(event);
 			}
 
-			void put(const Event& event)
+			UInt32 find_key(const AString& type, const AString& key) const
 			{
+				if (this->_keyed_count.load(std::memory_order_acquire) == 0)
+				{
+					return 0;
+				}
+				return this->_keys.find(type, key);
+			}
+
+			UInt32 route_of(const AString& route_key)
+			{
+				if ((this->_shard_count == 0) && !this->_conflate_ticks)
+				{
+					return 0;
+				}
+
+				UInt32 route = this->_routes.find("", route_key);
+				if (route != 0)
+				{
+					return route;
+				}
+
 				cCSLock Lock(m_CS);
-				this->_queue.push_back(event);
-				m_QueueNonempty.Set();
+				route = this->_routes.find("", route_key);
+				if (route == 0)
+				{
+					route = ++this->_route_count;
+					this->_routes.insert("", route_key, route);
+				}
+				return route;
 			}
 
 			void Register(const AString& type, HandlerType handler)
 			{
 				cCSLock Lock(m_CS);
+				_add_handler(this->_handlers[type].handlers, handler);
+			}
 
-				bool bExisted = false;
-				for (auto pos = this->_handlers.equal_range(type); pos.first != pos.second; pos.first++)
+			void unRegister(const AString& type, HandlerType handler)
+			{
+				cCSLock Lock(m_CS);
+				auto it = this->_handlers.find(type);
+				if (it != this->_handlers.end())
 				{
-					if (pos.first->second.target_type().name() == handler.target_type().name())
-					{
-						bExisted = true;
-						break;
-					}
+					_remove_handler(it->second.handlers, handler);
 				}
+			}
 
-				if (!bExisted)
+			void register_keyed(const AString& type, const AString& key, HandlerType handler)
+			{
+				cCSLock Lock(m_CS);
+				UInt32 key_id = this->_add_key(type, key);
+				auto& keyed = this->_handlers[type].keyed;
+				if (keyed.size() <= key_id)
 				{
-					this->_handlers.insert(std::make_pair(type, handler));
+					keyed.resize(key_id + 1);
 				}
+				size_t before = keyed[key_id].size();
+				_add_handler(keyed[key_id], handler);
+				this->_keyed_count += keyed[key_id].size() - before;
 			}
 
-			void unRegister(const AString& type, HandlerType handler)
+			void unregister_keyed(const AString& type, const AString& key, HandlerType handler)
+			{
+				cCSLock Lock(m_CS);
+				UInt32 key_id = this->_keys.find(type, key);
+				auto it = this->_handlers.find(type);
+				if ((key_id != 0) && (it != this->_handlers.end()) && (key_id < it->second.keyed.size()))
+				{
+					size_t before = it->second.keyed[key_id].size();
+					_remove_handler(it->second.keyed[key_id], handler);
+					this->_keyed_count -= before - it->second.keyed[key_id].size();
+				}
+			}
+
+			void set_shards(size_t count)
+			{
+				ASSERT(!this->_active);
+
+				this->_shard_count = count;
+			}
+
+			void register_sharded(const AString& type, HandlerType handler)
 			{
+				if (this->_shard_count == 0)
+				{
+					this->Register(type, handler);
+					return;
+				}
+
 				cCSLock Lock(m_CS);
+				auto handlers = std::make_shared<ShardedHandlers>(*this->_sharded_handlers);
+				_add_handler((*handlers)[type], handler);
+				this->_publish_sharded(std::move(handlers));
+			}
+
+			void unregister_sharded(const AString& type, HandlerType handler)
+			{
+				if (this->_shard_count == 0)
+				{
+					this->unRegister(type, handler);
+					return;
+				}
 
-				for (auto pos = this->_handlers.equal_range(type); pos.first != pos.second; pos.first++)
+				cCSLock Lock(m_CS);
+				auto handlers = std::make_shared<ShardedHandlers>(*this->_sharded_handlers);
+				auto it = handlers->find(type);
+				if (it != handlers->end())
 				{
-					if (pos.first->second.target_type().name() == handler.target_type().name())
+					_remove_handler(it->second, handler);
+					if (it->second.empty())
 					{
-						this->_handlers.erase(pos.first);
-						break;
+						handlers->erase(it);
 					}
 				}
+				this->_publish_sharded(std::move(handlers));
 			}
 
 			void register_general(HandlerType handler)
@@ -121,46 +625,464 @@ namespace Keen
 				}
 			}
 
+			EventEmitterStats get_stats() const
+			{
+				EventEmitterStats stats;
+				stats.put = this->_put_count.load(std::memory_order_relaxed);
+				stats.dropped = this->_dropped_count.load(std::memory_order_relaxed);
+				stats.dispatched = this->_dispatched_count.load(std::memory_order_relaxed);
+				stats.batches = this->_batch_count.load(std::memory_order_relaxed);
+				stats.conflated = this->_conflated_count.load(std::memory_order_relaxed);
+				stats.starved = this->_starved_count.load(std::memory_order_relaxed);
+				stats.busy_ns = this->_signal.get_busy_ns();
+				stats.spin_ns = this->_signal.get_spin_ns();
+				stats.parks = this->_signal.get_parks();
+				api::MainLoopStats main_loop = api::get_main_event_loop_stats();
+				stats.main_spin_ns = main_loop.spin_ns;
+				stats.main_parks = main_loop.parks;
+				stats.overflowed = this->_overflowed_count.load(std::memory_order_relaxed);
+				for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+				{
+					stats.queue_size += this->_lanes[lane]->SizeApprox() + this->_overflow[lane].size.load(std::memory_order_relaxed);
+					stats.queue_capacity += this->_lanes[lane]->Capacity();
+				}
+				return stats;
+			}
+
 		protected:
 			void _run()
 			{
+				cThreadTopology::Apply("dispatcher", "kt-dispatch");
+				this->_signal.begin();
 				for (;;)
 				{
-					cCSLock Lock(m_CS);
-					while (this->_active && (this->_queue.size() == 0))
+					if (!this->_active)
 					{
-						cCSUnlock Unlock(Lock);
-						m_QueueNonempty.Wait();
+						return;
 					}
 
-					if (!this->_active)
+					// Keep the backlog in the lanes, where priorities apply, rather than on the main loop
+					size_t window = this->_batch_drain ? this->_max_batch_size : DISPATCH_WINDOW;
+					if (this->_in_flight.load(std::memory_order_acquire) >= window)
 					{
-						return;
+						this->_signal.wait([this, window]() {
+							return !this->_active || (this->_in_flight.load(std::memory_order_acquire) < window);
+						});
+						continue;
 					}
 
-					ASSERT(!this->_queue.empty());
+					Event event;
+					if (!this->_pop(event))
+					{
+						this->_signal.wait([this]() { return !this->_active || !this->_lanes_empty(); });
+						continue;
+					}
+
+					if (!this->_resolve(event))
+					{
+						continue;
+					}
 
-					Event event = this->_queue.front();
+					this->_route_to_shard(event);
 
-					this->_queue.pop_front();
-					Lock.Unlock();
+					if (!this->_batch_drain)
+					{
+						++this->_in_flight;
+						api::InvokeToQueue([this, event]() {
+							this->_process(event);
+							++this->_dispatched_count;
+							this->_complete(1);
+						});
+						continue;
+					}
 
-					api::InvokeToQueue([this, event]() {
-						this->_process(event);
+					// Take everything that is pending in one pass and hand it to the main strand as a single unit
+					EventBatch* batch = this->_acquire_batch();
+					batch->push_back(std::move(event));
+					size_t limit = window - this->_in_flight.load(std::memory_order_acquire);
+					while (batch->size() < limit && this->_pop(event))
+					{
+						if (!this->_resolve(event))
+						{
+							continue;
+						}
+						this->_route_to_shard(event);
+						batch->push_back(std::move(event));
+					}
+
+					++this->_batch_count;
+					this->_in_flight += batch->size();
+					api::InvokeToQueue([this, batch]() {
+						for (const Event& e : *batch)
+						{
+							this->_process(e);
+						}
+						size_t count = batch->size();
+						this->_dispatched_count += count;
+						this->_release_batch(batch);
+						this->_complete(count);
 					});
 				}
 			}
 
+			/** Called on the main loop once posted events have been handled, lets the dispatcher post more. */
+			void _complete(size_t count)
+			{
+				this->_in_flight -= count;
+				this->_signal.notify();
+			}
+
+			void _make_lanes(size_t capacity)
+			{
+				for (auto& lane : this->_lanes)
+				{
+					lane = std::make_unique<cLockFreeQueue<Event>>(capacity);
+				}
+			}
+
+			EventPriority _priority_of(const Event& event) const
+			{
+				// Conflation placeholders stand in for ticks
+				if (event.type == EVENT_CONFLATED_TICK)
+				{
+					return EventPriority::MARKET_DATA;
+				}
+				auto it = this->_priorities.find(event.type);
+				return (it != this->_priorities.end()) ? it->second : EventPriority::MARKET_DATA;
+			}
+
+			bool _lane_waiting(size_t lane) const
+			{
+				return !this->_lanes[lane]->IsEmptyApprox() || (this->_overflow[lane].size.load(std::memory_order_acquire) != 0);
+			}
+
+			bool _lanes_empty() const
+			{
+				for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+				{
+					if (this->_lane_waiting(lane))
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			/** Takes the lane's next event, from its overflow once the lane itself is empty. Dispatcher thread only. */
+			bool _take(size_t lane, Event& event)
+			{
+				if (this->_lanes[lane]->TryPop(event))
+				{
+					return true;
+				}
+
+				Overflow& overflow = this->_overflow[lane];
+				if (overflow.size.load(std::memory_order_acquire) == 0)
+				{
+					return false;
+				}
+				cCSLock Lock(overflow.cs);
+				if (overflow.events.empty())
+				{
+					return false;
+				}
+				event = std::move(overflow.events.front());
+				overflow.events.pop_front();
+				overflow.size.store(overflow.events.size(), std::memory_order_release);
+				return true;
+			}
+
+			/** Takes the next event from the highest non-empty lane, unless a lower lane has been passed
+			over _starvation_limit times in a row, in which case it goes first. Dispatcher thread only. */
+			bool _pop(Event& event)
+			{
+				for (size_t lane = LANE_COUNT - 1; lane > 0; --lane)
+				{
+					if ((this->_skipped[lane] >= this->_starvation_limit) && this->_take(lane, event))
+					{
+						this->_skipped[lane] = 0;
+						++this->_starved_count;
+						return true;
+					}
+				}
+
+				for (size_t lane = 0; lane < LANE_COUNT; ++lane)
+				{
+					if (!this->_take(lane, event))
+					{
+						continue;
+					}
+
+					this->_skipped[lane] = 0;
+					for (size_t lower = lane + 1; lower < LANE_COUNT; ++lower)
+					{
+						this->_skipped[lower] = this->_lane_waiting(lower) ? this->_skipped[lower] + 1 : 0;
+					}
+					return true;
+				}
+				return false;
+			}
+
+			bool _push(const Event& event)
+			{
+				EventPriority priority = this->_priority_of(event);
+				size_t lane = static_cast<size_t>(priority);
+				cLockFreeQueue<Event>& queue = *this->_lanes[lane];
+				Overflow& overflow = this->_overflow[lane];
+
+				// Orders and trades are never dropped, whatever the policy
+				OverflowPolicy policy = (priority == EventPriority::EXECUTION) ? OverflowPolicy::BLOCK : this->_overflow_policy;
+
+				// While a lane has overflowed its events queue behind the overflow, so that they keep their order
+				while ((overflow.size.load(std::memory_order_acquire) != 0) || !queue.TryPush(event))
+				{
+					switch (policy)
+					{
+					case OverflowPolicy::BLOCK:
+						if (!this->_active)
+						{
+							++this->_dropped_count;
+							return false;
+						}
+						if (api::is_main_event_loop_thread())
+						{
+							// Waiting here would deadlock: the dispatcher only makes room once the main loop has
+							// handled what it was given. Park the event past the end of the lane instead.
+							cCSLock Lock(overflow.cs);
+							overflow.events.push_back(event);
+							overflow.size.store(overflow.events.size(), std::memory_order_release);
+							++this->_overflowed_count;
+							this->_signal.notify();
+							return true;
+						}
+						std::this_thread::yield();
+						break;
+
+					case OverflowPolicy::DROP_OLDEST:
+					{
+						Event oldest;
+						if (queue.TryPop(oldest))
+						{
+							this->_discard(oldest);
+							++this->_dropped_count;
+						}
+						break;
+					}
+
+					case OverflowPolicy::FAIL:
+						++this->_dropped_count;
+						return false;
+					}
+				}
+
+				this->_signal.notify();
+				return true;
+			}
+
+			/** Parks the tick in the pending table; only the first tick of a symbol takes a queue position,
+			later ones overwrite it until the dispatcher picks it up. */
+			bool _put_conflated(const Event& event)
+			{
+				{
+					cCSLock Lock(m_ConflationCS);
+					auto it = this->_pending_ticks.find(event.route);
+					if (it != this->_pending_ticks.end())
+					{
+						this->_release_payload(it->second);
+						it->second = event;
+						++this->_conflated_count;
+						return true;
+					}
+					this->_pending_ticks.emplace(event.route, event);
+				}
+
+				Event placeholder(EVENT_CONFLATED_TICK);
+				placeholder.key = event.key;
+				placeholder.route = event.route;
+				if (!this->_push(placeholder))
+				{
+					this->_discard(placeholder);
+					return false;
+				}
+				return true;
+			}
+
+			/** Swaps a conflation placeholder for the latest pending tick of its symbol.
+			Returns false if there is nothing left to dispatch for it. */
+			bool _resolve(Event& event)
+			{
+				if (event.type != EVENT_CONFLATED_TICK)
+				{
+					return true;
+				}
+
+				cCSLock Lock(m_ConflationCS);
+				auto it = this->_pending_ticks.find(event.route);
+				if (it == this->_pending_ticks.end())
+				{
+					return false;
+				}
+				event = std::move(it->second);
+				this->_pending_ticks.erase(it);
+				return true;
+			}
+
+			/** Releases an event that leaves the queue without being dispatched. */
+			void _discard(Event& event)
+			{
+				if (this->_resolve(event))
+				{
+					this->_release_payload(event);
+				}
+			}
+
+			EventBatch* _acquire_batch()
+			{
+				EventBatch* batch;
+				if (!this->_free_batches.TryPop(batch))
+				{
+					batch = new EventBatch();
+					batch->reserve(this->_max_batch_size);
+				}
+				return batch;
+			}
+
+			void _release_batch(EventBatch* batch)
+			{
+				batch->clear();
+				if (!this->_free_batches.TryPush(batch))
+				{
+					delete batch;
+				}
+			}
+
+			using ShardedHandlers = std::unordered_map<AString, std::vector<HandlerType>>;
+
+			/** A reader thread's copy of the sharded handlers (the dispatcher's and each shard's). It is renewed only
+			when register_sharded() or unregister_sharded() published a new map, so dispatching an event reads one
+			counter instead of taking a lock or touching the map's reference count; a replaced map goes away once
+			every reader has renewed its copy. */
+			struct ShardedSnapshot
+			{
+				std::shared_ptr<const ShardedHandlers> handlers;
+				UInt64 version = 0;
+			};
+
+			const ShardedHandlers& _sharded_snapshot(ShardedSnapshot& snapshot)
+			{
+				if (snapshot.version != this->_sharded_version.load(std::memory_order_acquire))
+				{
+					cCSLock Lock(m_CS);
+					snapshot.handlers = this->_sharded_handlers;
+					snapshot.version = this->_sharded_version.load(std::memory_order_relaxed);
+				}
+				return *snapshot.handlers;
+			}
+
+			/** Replaces the sharded handlers; a map is never changed once published. Under m_CS. */
+			void _publish_sharded(std::shared_ptr<const ShardedHandlers> handlers)
+			{
+				this->_sharded_handlers = std::move(handlers);
+				this->_sharded_version.fetch_add(1, std::memory_order_release);
+			}
+
+			void _route_to_shard(const Event& event)
+			{
+				if (this->_shards.empty())
+				{
+					return;
+				}
+
+				// Only types with a sharded handler pay for the extra reference and queue hop
+				const ShardedHandlers& handlers = this->_sharded_snapshot(this->_dispatch_snapshot);
+				if (handlers.find(event.type) == handlers.end())
+				{
+					return;
+				}
+
+				if (event.channel)
+				{
+					event.channel->retain(event.slot);
+				}
+
+				EventShard* shard = this->_shards[event.route % this->_shards.size()].get();
+				if (!shard->put(event))
+				{
+					this->_release_payload(event);
+				}
+			}
+
+			void _process_sharded(const Event& event, ShardedSnapshot& snapshot)
+			{
+				const ShardedHandlers& sharded = this->_sharded_snapshot(snapshot);
+				auto it = sharded.find(event.type);
+				if (it != sharded.end())
+				{
+					const std::vector<HandlerType>& handlers = it->second;
+					for (size_t i = 0; i < handlers.size(); ++i)
+					{
+						handlers[i](event);
+					}
+				}
+
+				this->_release_payload(event);
+			}
+
+			/** Id of the key in the type's key space, added if it is new. Under m_CS. */
+			UInt32 _add_key(const AString& type, const AString& key)
+			{
+				UInt32 key_id = this->_keys.find(type, key);
+				if (key_id == 0)
+				{
+					key_id = ++this->_key_counts[type];
+					this->_keys.insert(type, key, key_id);
+				}
+				return key_id;
+			}
+
+			static void _add_handler(std::vector<HandlerType>& handlers, const HandlerType& handler)
+			{
+				for (auto& it : handlers)
+				{
+					if (it.target_type().name() == handler.target_type().name())
+					{
+						return;
+					}
+				}
+				handlers.push_back(handler);
+			}
+
+			static void _remove_handler(std::vector<HandlerType>& handlers, const HandlerType& handler)
+			{
+				for (auto it = handlers.begin(); it != handlers.end(); ++it)
+				{
+					if (it->target_type().name() == handler.target_type().name())
+					{
+						handlers.erase(it);
+						break;
+					}
+				}
+			}
+
 			void _process(const Event& event)
 			{
-				if (_handlers.count(event.type))
+				auto it = this->_handlers.find(event.type);
+				if (it != this->_handlers.end())
 				{
-					auto pr = _handlers.equal_range(event.type);
-					while (pr.first != pr.second)
+					const TypeHandlers& type_handlers = it->second;
+					for (size_t i = 0; i < type_handlers.handlers.size(); ++i)
+					{
+						type_handlers.handlers[i](event);
+					}
+
+					// Keyed subscribers are reached straight from the key id of the single published event
+					if ((event.key != 0) && (event.key < type_handlers.keyed.size()))
 					{
-						HandlerType handler = pr.first->second;
-						handler(event);
-						++pr.first;
+						const std::vector<HandlerType>& keyed = type_handlers.keyed[event.key];
+						for (size_t i = 0; i < keyed.size(); ++i)
+						{
+							keyed[i](event);
+						}
 					}
 				}
 
@@ -168,37 +1090,91 @@ namespace Keen
 				{
 					handler(event);
 				}
+
+				this->_release_payload(event);
+			}
+
+			void _release_payload(const Event& event)
+			{
+				if (event.channel)
+				{
+					event.channel->release(event.slot);
+				}
 			}
 
 			void _run_timer()
 			{
-				if (!this->_active)
+				if (this->_interval.count() <= 0)
+				{
 					return;
+				}
 
-				_timer.expires_after(std::chrono::seconds(this->_interval));
-				_timer.async_wait([this](const asio::error_code& ec)
-					{
-						if (!ec)
-						{
-							Event event(EVENT_TIMER);
-							this->put(event);
-
-							_run_timer();
-						}
-					});
+				this->_timer = api::RepeatToQueue(this->_interval, [this]() {
+					Event event(EVENT_TIMER);
+					this->put(event);
+				});
 			}
 
 		private:
-			int _interval;
+			std::chrono::milliseconds _interval;
 
 			cCriticalSection	m_CS;
-			std::deque<Event>	_queue;
-			cEvent				m_QueueNonempty;
+			std::array<std::unique_ptr<cLockFreeQueue<Event>>, LANE_COUNT> _lanes;
+
+			/** Unbounded spill of a full lane, for events put from the main loop, which must never wait. */
+			struct Overflow
+			{
+				cCriticalSection cs;
+				std::deque<Event> events;
+				std::atomic<size_t> size = 0;
+			};
+			std::array<Overflow, LANE_COUNT> _overflow;
+			std::unordered_map<AString, EventPriority> _priorities;
+			size_t _starvation_limit;
+			size_t _skipped[LANE_COUNT] = {};  // consecutive pops that passed over a waiting lane
+			OverflowPolicy		_overflow_policy;
+			WakeSignal			_signal;
+
+			std::atomic<UInt64> _put_count = 0;
+			std::atomic<UInt64> _dropped_count = 0;
+			std::atomic<UInt64> _dispatched_count = 0;
+			std::atomic<UInt64> _batch_count = 0;
+			std::atomic<UInt64> _conflated_count = 0;
+			std::atomic<UInt64> _starved_count = 0;
+			std::atomic<UInt64> _overflowed_count = 0;
+			std::atomic<size_t> _in_flight = 0;
 
-			bool _active = false;
+			bool _batch_drain;
+			size_t _max_batch_size;
+			cLockFreeQueue<EventBatch*> _free_batches;
+
+			bool _conflate_ticks = false;
+			cCriticalSection	m_ConflationCS;
+			std::unordered_map<UInt32, Event> _pending_ticks;  // latest undispatched tick per kt_symbol route
+
+			std::atomic<bool> _active = false;
 			std::thread _thread;
-			asio::steady_timer _timer;
-			std::unordered_multimap<AString, HandlerType> _handlers;
+			api::TimerHandle _timer;
+
+			struct TypeHandlers
+			{
+				std::vector<HandlerType> handlers;
+				std::vector<std::vector<HandlerType>> keyed;   // indexed by key id, see _add_key
+			};
+
+			std::unordered_map<AString, TypeHandlers> _handlers;
+
+			size_t _shard_count = 0;
+			std::vector<std::unique_ptr<EventShard>> _shards;
+			std::shared_ptr<const ShardedHandlers> _sharded_handlers = std::make_shared<ShardedHandlers>();  // under m_CS
+			std::atomic<UInt64> _sharded_version = 1;  // bumped with every new map, see ShardedSnapshot
+			ShardedSnapshot _dispatch_snapshot;  // dispatcher thread only
+
+			KeyIndex _keys;  // subscribed keys per type, inserts under m_CS
+			std::unordered_map<AString, UInt32> _key_counts;  // keys per type, under m_CS
+			KeyIndex _routes;  // symbols and accounts under the empty type, inserts under m_CS
+			UInt32 _route_count = 0;  // under m_CS
+			std::atomic<size_t> _keyed_count = 0;  // keyed handlers registered, find_key() skips the lookup at 0
 			std::list<HandlerType> _general_handlers;
 
 		};
@@ -208,8 +1184,7 @@ namespace Keen
 			static std::unique_ptr<EventEmitterImpl> instance;
 			if (!instance)
 			{
-				auto event_loop = api::get_main_event_loop();
-				instance = std::make_unique<EventEmitterImpl>((asio::io_service*)event_loop);
+				instance = std::make_unique<EventEmitterImpl>();
 			}
 			return instance.get();
 		}
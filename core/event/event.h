@@ -1,5 +1,7 @@
 #pragma once
 
+#include <api/OSSupport/LockFreeQueue.h>
+
 namespace Keen
 {
 	namespace engine
@@ -14,6 +16,8 @@ namespace Keen
 		extern KEEN_EVENT_EXPORT const char* EVENT_CONTRACT;
 		extern KEEN_EVENT_EXPORT const char* EVENT_LOG;
 
+		class ChannelBase;
+
 		class Event
 		{
 		public:
@@ -25,9 +29,88 @@ namespace Keen
 				this->data = data;
 			}
 
+			Event(AString type, ChannelBase* channel, UInt32 slot, UInt32 key = 0, UInt32 route = 0)
+			{
+				this->type = type;
+				this->channel = channel;
+				this->slot = slot;
+				this->key = key;
+				this->route = route;
+			}
+
+			/** Returns the payload, whether it lives in a channel slot or in data.
+			A slot payload is only valid until the event has been dispatched. */
+			template <class T>
+			const T& get() const;
+
 		public:
 			AString type;
 			std::any data;
+
+			ChannelBase* channel = nullptr;
+			UInt32 slot = 0;
+
+			/** Id of the symbol / order id in the key space of the event type (see EventEmitter::find_key),
+			0 if nobody subscribed to it. */
+			UInt32 key = 0;
+
+			/** Routing key (see EventEmitter::route_of, kt_symbol for market and order flow) that picks the
+			dispatch shard. Events with the same route are handled in order by sharded handlers. */
+			UInt32 route = 0;
+		};
+
+		class ChannelBase
+		{
+		public:
+			virtual ~ChannelBase() {
+			}
+
+			/** Adds a reference to the slot, when the event is handed to one more consumer (e.g. a dispatch shard). */
+			virtual void retain(UInt32 slot) = 0;
+
+			/** Drops a reference, called by the emitter once the event has been dispatched or dropped.
+			The slot returns to the channel when the last reference is gone. */
+			virtual void release(UInt32 slot) = 0;
+
+			virtual const std::type_info& payload_type() const = 0;
+		};
+
+		/** What put() does when the event queue is full. Only market data and background lanes follow it:
+		the execution lane always blocks. A put() from the main loop never blocks, as the dispatcher waits for
+		the main loop to make room; the event goes to an unbounded overflow behind the lane instead. */
+		enum class OverflowPolicy {
+			BLOCK,          // wait for the dispatcher to make room
+			DROP_OLDEST,    // evict the oldest queued event
+			FAIL            // reject the new event, put() returns false
+		};
+
+		/** Dispatch lane of an event type. Pending events of a higher lane are dispatched first. */
+		enum class EventPriority {
+			EXECUTION,      // orders, trades, positions and accounts
+			MARKET_DATA,    // ticks, quotes, contracts and any type not classified otherwise
+			BACKGROUND      // timer and log
+		};
+
+		/** How the dispatcher thread waits for work, shared with the main loop. */
+		using WaitStrategy = api::WaitStrategy;
+
+		class EventEmitterStats
+		{
+		public:
+			UInt64 put = 0;
+			UInt64 dropped = 0;
+			UInt64 dispatched = 0;
+			UInt64 batches = 0;        // strand posts made in batch-drain mode
+			UInt64 conflated = 0;      // queued ticks replaced by a newer tick for the same symbol
+			UInt64 starved = 0;        // events taken out of priority order to keep a lower lane moving
+			UInt64 busy_ns = 0;        // dispatcher time spent moving events
+			UInt64 spin_ns = 0;        // dispatcher time spent spinning or yielding without work
+			UInt64 parks = 0;          // times the dispatcher went to sleep
+			UInt64 main_spin_ns = 0;   // the same two for the main loop, which runs the handlers
+			UInt64 main_parks = 0;
+			UInt64 overflowed = 0;     // events put from the main loop into a full lane, queued past its capacity
+			size_t queue_size = 0;
+			size_t queue_capacity = 0;
 		};
 
 		class EventEmitter
@@ -38,21 +121,163 @@ namespace Keen
 			virtual ~EventEmitter() {
 			}
 
-			virtual void start(int interval = 1) = 0;
+			/** Starts dispatching; EVENT_TIMER is put every interval, or never if it is zero. */
+			virtual void start(std::chrono::milliseconds interval = std::chrono::seconds(1)) = 0;
 
 			virtual void stop() = 0;
 
-			virtual void put(const Event& event) = 0;
+			/** Capacity of each priority lane. Must be called before start(). The capacity is rounded up to a power of two. */
+			virtual void set_queue(size_t capacity, OverflowPolicy policy = OverflowPolicy::BLOCK) = 0;
+
+			/** When enabled the dispatcher drains up to max_batch_size pending events per pass
+			and posts them to the main loop as one unit. Must be called before start(). */
+			virtual void set_batch_drain(bool enabled, size_t max_batch_size = 1024) = 0;
+
+			/** When enabled a tick that is still queued is replaced in place by a newer tick for the same
+			kt_symbol, so slow consumers only see the latest one. Only EVENT_TICK events carrying a route are
+			conflated; orders, trades and positions never are. Must be called before start(). */
+			virtual void set_tick_conflation(bool enabled) = 0;
+
+			/** Moves an event type to another lane. Must be called before start(). */
+			virtual void set_priority(const AString& type, EventPriority priority) = 0;
+
+			/** After this many events were taken from higher lanes while a lower lane was waiting,
+			the lower lane gets the next turn. Must be called before start(). */
+			virtual void set_starvation_limit(size_t limit) = 0;
+
+			/** How the dispatcher waits when there is nothing to do. A spin budget of zero never parks the
+			spinning strategies, which keeps a core busy for as long as the emitter runs. Must be called before start(). */
+			virtual void set_wait_strategy(WaitStrategy strategy, std::chrono::microseconds spin_budget = std::chrono::microseconds(0)) = 0;
+
+			/** Returns false if the event was dropped because the queue was full. */
+			virtual bool put(const Event& event) = 0;
 
 			virtual void Register(const AString& type, HandlerType handler) = 0;
 
 			virtual void unRegister(const AString& type, HandlerType handler) = 0;
 
+			/** Id to tag an event of this type with so that subscribers of the key (symbol or order id) get it,
+			0 if nobody subscribed to that key. Each type has its own key space, and a key only gets an id once
+			someone subscribes to it. Lock-free, and returns right away while there are no keyed subscriptions. */
+			virtual UInt32 find_key(const AString& type, const AString& key) const = 0;
+
+			/** Stable non-zero id of a symbol or account, see Event::route. Lock-free once the key has been seen.
+			Returns 0 without a lookup while neither sharding nor tick conflation is enabled, as nothing reads the route then. */
+			virtual UInt32 route_of(const AString& route_key) = 0;
+
+			/** Subscribes to events of this type whose key is the given symbol or order id, e.g. the ticks of
+			one kt_symbol. Publishers tag events with find_key(). */
+			virtual void register_keyed(const AString& type, const AString& key, HandlerType handler) = 0;
+
+			virtual void unregister_keyed(const AString& type, const AString& key, HandlerType handler) = 0;
+
+			/** Number of shard worker threads (0 disables sharding). Must be called before start(). */
+			virtual void set_shards(size_t count) = 0;
+
+			/** Registers a handler that is safe to run off the main loop. With sharding enabled it runs on the
+			shard worker chosen by Event::route, in order per route; handlers registered with Register() stay
+			serialized on the main loop. Without shards it behaves like Register().
+			Event types without a sharded handler are never routed to a shard.
+			This is infrastructure only: no engine in the tree registers a sharded handler, so event.shards
+			changes nothing on its own. CtaEngine and OmsEngine share order maps and call into the trade engine,
+			which is not safe off the main loop, so they stay on Register(); a sharded handler must keep all of
+			its state per route. */
+			virtual void register_sharded(const AString& type, HandlerType handler) = 0;
+
+			virtual void unregister_sharded(const AString& type, HandlerType handler) = 0;
+
 			virtual void register_general(HandlerType handler) = 0;
 
 			virtual void unregister_general(HandlerType handler) = 0;
+
+			virtual EventEmitterStats get_stats() const = 0;
 		};
 
+		/** Typed publisher that keeps payloads in preallocated, cache-aligned slots.
+		publish() copies the data into a free slot (reusing the slot's string buffers) and queues an event
+		pointing at it, so no std::any is allocated. Handlers read it through Event::get<T>() and the slot
+		is recycled after dispatch. Falls back to a regular std::any event when every slot is in flight. */
+		template <class T>
+		class Channel : public ChannelBase
+		{
+		public:
+			explicit Channel(size_t capacity = 4096)
+				: _free(capacity)
+			{
+				size_t slots = this->_free.Capacity();
+				this->_slots.reset(new Slot[slots]);
+				for (size_t i = 0; i < slots; ++i)
+				{
+					this->_free.TryPush(static_cast<UInt32>(i));
+				}
+			}
+
+			bool publish(EventEmitter* emitter, const AString& type, const T& data, UInt32 key = 0, UInt32 route = 0)
+			{
+				UInt32 slot;
+				if (!this->_free.TryPop(slot))
+				{
+					Event event(type, data);
+					event.key = key;
+					event.route = route;
+					return emitter->put(event);
+				}
+
+				this->_slots[slot].value = data;
+				this->_slots[slot].refs.store(1, std::memory_order_relaxed);
+				if (!emitter->put(Event(type, this, slot, key, route)))
+				{
+					this->release(slot);
+					return false;
+				}
+				return true;
+			}
+
+			const T& at(UInt32 slot) const
+			{
+				return this->_slots[slot].value;
+			}
+
+			void retain(UInt32 slot) override
+			{
+				this->_slots[slot].refs.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			void release(UInt32 slot) override
+			{
+				if (this->_slots[slot].refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					this->_free.TryPush(slot);
+				}
+			}
+
+			const std::type_info& payload_type() const override
+			{
+				return typeid(T);
+			}
+
+		private:
+			struct alignas(64) Slot
+			{
+				std::atomic<UInt32> refs = 0;
+				T value;
+			};
+
+			std::unique_ptr<Slot[]> _slots;
+			cLockFreeQueue<UInt32> _free;
+		};
+
+		template <class T>
+		const T& Event::get() const
+		{
+			if (this->channel)
+			{
+				ASSERT(this->channel->payload_type() == typeid(T));
+				return static_cast<const Channel<T>*>(this->channel)->at(this->slot);
+			}
+			return std::any_cast<const T&>(this->data);
+		}
+
 		extern "C" KEEN_EVENT_EXPORT EventEmitter* MakeEventEmitter();
 	}
 }
@@ -1,4 +1,5 @@
 #include <api/Globals.h>
+#include <api/JsonRecords.h>
 #include <engine/engine.h>
 #include <engine/utility.h>
 #include "binance_linear_exchange.h"
@@ -27,6 +28,31 @@ namespace Keen
 
             const int WEBSOCKET_TIMEOUT = 24 * 60 * 60;
 
+            // Klines per history request
+            const int HISTORY_LIMIT = 1500;
+
+            // USD-M futures limits, shared by REST and the websocket API: IP request weight and account order counts
+            static void setup_rate_limits(RateLimiter& limiter)
+            {
+                limiter.add_bucket("weight", 2400, std::chrono::minutes(1));
+                limiter.add_bucket("orders_10s", 300, std::chrono::seconds(10));
+                limiter.add_bucket("orders_1m", 1200, std::chrono::minutes(1));
+
+                limiter.set_weight("", "/fapi/", "weight", 1);
+                limiter.set_weight("GET", "/fapi/v1/klines", "weight", 10);  // 10 for up to 1500 klines
+                limiter.set_weight("GET", "/fapi/v1/openOrders", "weight", 40);  // 40 without a symbol
+                limiter.set_weight("GET", "/fapi/v3/account", "weight", 5);
+                limiter.set_weight("GET", "/fapi/v3/positionRisk", "weight", 5);
+
+                limiter.set_weight("WS", "order.", "weight", 1, RequestPriority::ORDER);
+                limiter.set_weight("WS", "order.place", "orders_10s", 1, RequestPriority::ORDER);
+                limiter.set_weight("WS", "order.place", "orders_1m", 1, RequestPriority::ORDER);
+
+                limiter.set_usage_header("X-MBX-USED-WEIGHT-1M", "weight");
+                limiter.set_usage_header("X-MBX-ORDER-COUNT-10S", "orders_10s");
+                limiter.set_usage_header("X-MBX-ORDER-COUNT-1M", "orders_1m");
+            }
+
             static std::map<AString, Product> PRODUCT_BINANCE2KT = {
                 {"PERPETUAL", Product::SWAP},
                 {"PERPETUAL_DELIVERING", Product::SWAP},
@@ -77,6 +103,9 @@ namespace Keen
                 this->md_api = new BinanceMdApi(this);
                 this->trade_api = new BinanceTradeApi(this);
                 this->user_api = new BinanceUserApi(this);
+
+                setup_rate_limits(*this->rest_api->get_rate_limiter());
+                this->trade_api->set_rate_limiter(this->rest_api->get_rate_limiter());
             }
 
             BinanceLinearExchange::~BinanceLinearExchange()
@@ -95,6 +124,8 @@ namespace Keen
                 this->proxy_port = setting.value("proxy_port", 0);
                 this->server = setting.value("server", "");
                 this->hedge_mode = setting.value("hedge_mode", false);
+                // permessage-deflate for market data, order entry stays uncompressed
+                this->md_api->set_compression(setting.value("ws_compression", false));
 
                 this->rest_api->connect(
                     this->key,
@@ -105,6 +136,12 @@ namespace Keen
                     this->proxy_port);
 
                 this->connect_ws_api();
+
+                // keep_user_stream() renews the listen key once every 600 calls
+                this->keepalive_timer.cancel();
+                this->keepalive_timer = RepeatToQueue(std::chrono::seconds(1), [this]() {
+                    this->rest_api->keep_user_stream();
+                });
             }
 
             void BinanceLinearExchange::process_timer_event(const Event& event)
@@ -159,8 +196,14 @@ namespace Keen
                 return this->rest_api->query_history(req);
             }
 
+            Task<std::list<BarData>> BinanceLinearExchange::query_history_async(HistoryRequest req)
+            {
+                return this->rest_api->query_history_async(std::move(req));
+            }
+
             void BinanceLinearExchange::close()
             {
+                this->keepalive_timer.cancel();
                 this->rest_api->stop();
                 this->user_api->stop();
                 this->md_api->stop();
@@ -296,8 +339,7 @@ namespace Keen
                 request.headers = {
                     {"Content-Type", "application/x-www-form-urlencoded"},
                     {"Accept", "application/json"},
-                    {"X-MBX-APIKEY", this->key},
-                    {"Connection", "close"}
+                    {"X-MBX-APIKEY", this->key}
                 };
 
                 return request;
@@ -353,7 +395,8 @@ namespace Keen
                 Request request{
                     .method = "GET",
                     .path = "/fapi/v1/exchangeInfo",
-                    .callback = std::bind(&BinanceRestApi::on_query_contract, this, _1, _2)
+                    // Several MB, parsed symbol by symbol
+                    .body_callback = std::bind(&BinanceRestApi::on_query_contract, this, _1, _2)
                 };
                 this->request(request);
             }
@@ -377,117 +420,156 @@ namespace Keen
                     return {};
                 }
 
-                ContractData contract = *opt_contract;
-
                 std::list<BarData> history;
-                int limit = 1500;
 
                 // start time in milliseconds
                 long long start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(req.start.time_since_epoch()).count();
 
                 while (true)
                 {
-                    AString path = "/fapi/v1/klines";
+                    Response resp = this->request("GET", "/fapi/v1/klines", this->history_params(*opt_contract, req, start_ms));
+                    if (!this->on_history_page(resp, req, history, start_ms))
+                        break;
+                }
 
-                    Params params = {
-                        {"symbol", contract.name},
-                        {"interval", (req.interval == Interval::MINUTE) ? "1m" : (req.interval == Interval::HOUR) ? "1h" : "1d"},
-                        {"limit", std::to_string(limit)},
-                        {"startTime", std::to_string(start_ms)}
-                    };
+                return this->finish_history(history);
+            }
 
-                    // add end time if provided (non-zero)
-                    if (req.end.time_since_epoch().count() != 0)
-                    {
-                        long long end_ms = std::chrono::duration_cast<std::chrono::milliseconds>(req.end.time_since_epoch()).count();
-                        params["endTime"] = std::to_string(end_ms);
-                    }
+            Task<std::list<BarData>> BinanceRestApi::query_history_async(HistoryRequest req)
+            {
+                auto opt_contract = this->exchange->get_contract_by_symbol(req.symbol);
+                if (!opt_contract)
+                {
+                    this->exchange->write_log(Printf("Query kline history failed, symbol not found: %s", req.symbol.c_str()));
+                    co_return std::list<BarData>();
+                }
 
-                    Response resp = this->request("GET", path, params);
+                ContractData contract = *opt_contract;
+                std::list<BarData> history;
 
-                    if (resp.status / 100 != 2)
-                    {
-                        AString msg = Printf("Query kline history failed, status code: %d, information: %s", resp.status, resp.body.c_str());
-                        this->exchange->write_log(msg);
+                // start time in milliseconds
+                long long start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(req.start.time_since_epoch()).count();
+
+                while (true)
+                {
+                    Response resp = co_await this->async_request("GET", "/fapi/v1/klines", this->history_params(contract, req, start_ms));
+                    if (!this->on_history_page(resp, req, history, start_ms))
                         break;
-                    }
+                }
 
-                    try {
-                        Json data = Json::parse(resp.body);
+                co_return this->finish_history(history);
+            }
 
-                        if (!data.is_array() || data.empty())
-                        {
-                            AString msg = Printf("No kline history data is received, symbol: %s", req.symbol.c_str());
-                            this->exchange->write_log(msg);
-                            break;
-                        }
+            Params BinanceRestApi::history_params(const ContractData& contract, const HistoryRequest& req, long long start_ms)
+            {
+                Params params = {
+                    {"symbol", contract.name},
+                    {"interval", (req.interval == Interval::MINUTE) ? "1m" : (req.interval == Interval::HOUR) ? "1h" : "1d"},
+                    {"limit", std::to_string(HISTORY_LIMIT)},
+                    {"startTime", std::to_string(start_ms)}
+                };
 
-                        std::vector<BarData> buf;
+                // add end time if provided (non-zero)
+                if (req.end.time_since_epoch().count() != 0)
+                {
+                    long long end_ms = std::chrono::duration_cast<std::chrono::milliseconds>(req.end.time_since_epoch()).count();
+                    params["endTime"] = std::to_string(end_ms);
+                }
+                return params;
+            }
 
-                        for (const Json& row : data)
-                        {
-                            if (!row.is_array() || row.size() < 6)
-                                continue;
+            bool BinanceRestApi::on_history_page(const Response& resp, const HistoryRequest& req, std::list<BarData>& history, long long& start_ms)
+            {
+                if (resp.status / 100 != 2)
+                {
+                    AString msg = Printf("Query kline history failed, status code: %d, information: %s", resp.status, resp.body.c_str());
+                    this->exchange->write_log(msg);
+                    return false;
+                }
 
-                            long long ts = 0;
-                            if (row[0].is_number())
-                                ts = row[0].get<long long>();
-                            else
-                                ts = std::atoll(AString(row[0]).c_str());
-
-                            BarData bar;
-                            bar.symbol = req.symbol;
-                            bar.exchange = req.exchange;
-                            bar.datetime = DateTimeFromTimestamp(ts);
-                            bar.interval = req.interval;
-                            bar.volume = JsonToFloat(row[5]);
-                            // quote asset volume at index 7 if exists
-                            if (row.size() > 7)
-                                bar.open_interest = JsonToFloat(row[7]);
-                            bar.open_price = JsonToFloat(row[1]);
-                            bar.high_price = JsonToFloat(row[2]);
-                            bar.low_price = JsonToFloat(row[3]);
-                            bar.close_price = JsonToFloat(row[4]);
-                            bar.exchange_name = this->exchange_name;
-                            bar.__post_init__();
-
-                            buf.push_back(bar);
-                        }
+                try {
+                    size_t rows = 0;
+                    std::vector<BarData> buf;
+                    auto on_row = [&](Json& row) {
+                        ++rows;
+                        if (!row.is_array() || row.size() < 6)
+                            return;
 
-                        if (buf.empty())
-                            break;
+                        long long ts = 0;
+                        if (row[0].is_number())
+                            ts = row[0].get<long long>();
+                        else
+                            ts = std::atoll(AString(row[0]).c_str());
+
+                        BarData bar;
+                        bar.symbol = req.symbol;
+                        bar.exchange = req.exchange;
+                        bar.datetime = DateTimeFromTimestamp(ts);
+                        bar.interval = req.interval;
+                        bar.volume = JsonToFloat(row[5]);
+                        // quote asset volume at index 7 if exists
+                        if (row.size() > 7)
+                            bar.open_interest = JsonToFloat(row[7]);
+                        bar.open_price = JsonToFloat(row[1]);
+                        bar.high_price = JsonToFloat(row[2]);
+                        bar.low_price = JsonToFloat(row[3]);
+                        bar.close_price = JsonToFloat(row[4]);
+                        bar.exchange_name = this->exchange_name;
+                        bar.__post_init__();
+
+                        buf.push_back(bar);
+                    };
 
-                        DateTime begin_dt = buf.front().datetime;
-                        DateTime end_dt = buf.back().datetime;
+                    AString error;
+                    if (!ParseJsonRecords(resp.body, {}, on_row, nullptr, &error))
+                    {
+                        this->exchange->write_log(Printf("JSON parsing failed: %s", error.c_str()));
+                        return false;
+                    }
+                    if (rows == 0)
+                    {
+                        AString msg = Printf("No kline history data is received, symbol: %s", req.symbol.c_str());
+                        this->exchange->write_log(msg);
+                        return false;
+                    }
 
-                        for (auto &b : buf)
-                            history.push_back(b);
+                    if (buf.empty())
+                        return false;
 
-                        AString msg = Printf("Query kline history finished, %s - %s, %s - %s",
-                            req.symbol.c_str(), interval_to_str(req.interval).c_str(),
-                            DateTimeToString(begin_dt).c_str(), DateTimeToString(end_dt).c_str());
-                        this->exchange->write_log(msg);
+                    DateTime begin_dt = buf.front().datetime;
+                    DateTime end_dt = buf.back().datetime;
+
+                    for (auto &b : buf)
+                        history.push_back(b);
 
-                        // Break if latest data received
-                        if ((int)data.size() < limit || (req.end.time_since_epoch().count() != 0 && end_dt >= req.end))
-                            break;
+                    AString msg = Printf("Query kline history finished, %s - %s, %s - %s",
+                        req.symbol.c_str(), interval_to_str(req.interval).c_str(),
+                        DateTimeToString(begin_dt).c_str(), DateTimeToString(end_dt).c_str());
+                    this->exchange->write_log(msg);
 
-                        // move start to next bar
-                        long long add_ms = 60000; // default 1 minute
-                        if (req.interval == Interval::HOUR)
-                            add_ms = 60LL * 60LL * 1000LL;
-                        else if (req.interval == Interval::DAILY)
-                            add_ms = 24LL * 60LL * 60LL * 1000LL;
+                    // Break if latest data received
+                    if ((int)rows < HISTORY_LIMIT || (req.end.time_since_epoch().count() != 0 && end_dt >= req.end))
+                        return false;
 
-                        start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_dt.time_since_epoch()).count() + add_ms;
-                    }
-                    catch (const std::exception& e)
-                    {
-                        this->exchange->write_log(Printf("JSON parsing failed: %s", e.what()));
-                        break;
-                    }
+                    // move start to next bar
+                    long long add_ms = 60000; // default 1 minute
+                    if (req.interval == Interval::HOUR)
+                        add_ms = 60LL * 60LL * 1000LL;
+                    else if (req.interval == Interval::DAILY)
+                        add_ms = 24LL * 60LL * 60LL * 1000LL;
+
+                    start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_dt.time_since_epoch()).count() + add_ms;
+                    return true;
                 }
+                catch (const std::exception& e)
+                {
+                    this->exchange->write_log(Printf("JSON parsing failed: %s", e.what()));
+                    return false;
+                }
+            }
 
+            std::list<BarData> BinanceRestApi::finish_history(std::list<BarData>& history)
+            {
                 // sort by datetime
                 history.sort([](const BarData& a, const BarData& b) { return a.datetime < b.datetime; });
 
@@ -495,7 +577,7 @@ namespace Keen
                 if (!history.empty())
                     history.pop_back();
 
-                return history;
+                return std::move(history);
             }
 
             void BinanceRestApi::start()
@@ -660,61 +742,72 @@ namespace Keen
                 this->query_contract();
             }
 
-            void BinanceRestApi::on_query_contract(const Json& packet, const Request& request)
+            void BinanceRestApi::on_contract_data(const Json& d)
             {
-                if (!packet.contains("symbols"))
-                    return;
+                float pricetick = 1.0f;
+                float min_volume = 1.0f;
+                float max_volume = 1.0f;
 
-                for (auto &d : packet["symbols"])
+                if (d.contains("filters") && d["filters"].is_array())
                 {
-                    float pricetick = 1.0f;
-                    float min_volume = 1.0f;
-                    float max_volume = 1.0f;
-
-                    if (d.contains("filters") && d["filters"].is_array())
+                    for (auto &f : d["filters"])
                     {
-                        for (auto &f : d["filters"])
+                        AString t = f.value("filterType", "");
+                        if (t == "PRICE_FILTER")
+                            pricetick = std::stof(f.value("tickSize", "1"));
+                        else if (t == "LOT_SIZE")
                         {
-                            AString t = f.value("filterType", "");
-                            if (t == "PRICE_FILTER")
-                                pricetick = std::stof(f.value("tickSize", "1"));
-                            else if (t == "LOT_SIZE")
-                            {
-                                min_volume = std::stof(f.value("minQty", "1"));
-                                max_volume = std::stof(f.value("maxQty", "0"));
-                            }
+                            min_volume = std::stof(f.value("minQty", "1"));
+                            max_volume = std::stof(f.value("maxQty", "0"));
                         }
                     }
+                }
 
-                    AString contractType = d.value("contractType", "PERPETUAL");
-                    Product product = Product::SWAP;
-                    if (PRODUCT_BINANCE2KT.count(contractType))
-                        product = PRODUCT_BINANCE2KT[contractType];
+                AString contractType = d.value("contractType", "PERPETUAL");
+                Product product = Product::SWAP;
+                if (PRODUCT_BINANCE2KT.count(contractType))
+                    product = PRODUCT_BINANCE2KT[contractType];
 
-                    AString name = d.value("symbol", "");
-                    AString symbol;
-                    if (product == Product::SWAP)
-                        symbol = name + "_SWAP";
-                    else
-                        symbol = name;
-
-                    ContractData contract;
-                    contract.symbol = symbol;
-                    contract.exchange = Exchange::BINANCE;
-                    contract.name = name;
-                    contract.pricetick = pricetick;
-                    contract.size = 1;
-                    contract.min_volume = min_volume;
-                    contract.max_volume = max_volume;
-                    contract.product = product;
-                    contract.net_position = true;
-                    contract.history_data = true;
-                    contract.exchange_name = this->exchange_name;
-                    contract.stop_supported = true;
-                    contract.__post_init__();
-
-                    this->exchange->on_contract(contract);
+                AString name = d.value("symbol", "");
+                AString symbol;
+                if (product == Product::SWAP)
+                    symbol = name + "_SWAP";
+                else
+                    symbol = name;
+
+                ContractData contract;
+                contract.symbol = symbol;
+                contract.exchange = Exchange::BINANCE;
+                contract.name = name;
+                contract.pricetick = pricetick;
+                contract.size = 1;
+                contract.min_volume = min_volume;
+                contract.max_volume = max_volume;
+                contract.product = product;
+                contract.net_position = true;
+                contract.history_data = true;
+                contract.exchange_name = this->exchange_name;
+                contract.stop_supported = true;
+                contract.__post_init__();
+
+                this->exchange->on_contract(contract);
+            }
+
+            void BinanceRestApi::on_query_contract(const AString& body, const Request& request)
+            {
+                size_t count = 0;
+                AString error;
+                auto on_symbol = [this, &count](Json& d) {
+                    this->on_contract_data(d);
+                    ++count;
+                };
+                if (!ParseJsonRecords(body, { "symbols" }, on_symbol, nullptr, &error))
+                {
+                    this->exchange->write_log(Printf("Contract data parsing failed: %s", error.c_str()));
+                    return;
                 }
+                if (count == 0)
+                    return;
 
                 this->exchange->write_log("Contract data received");
 
@@ -912,7 +1005,7 @@ namespace Keen
                     {"id", this->reqid}
                 };
 
-                this->send_packet(packet);
+                this->send_subscription(packet, "params");
             }
 
                 void BinanceMdApi::on_connected()
@@ -924,113 +1017,118 @@ namespace Keen
 
                 void BinanceMdApi::on_disconnected()
                 {
-                    this->exchange->write_log("MD API disconnected");
+                    WebsocketStats stats = this->get_stats();
+                    this->exchange->write_log(Printf("MD API disconnected, received %llu messages, %llu bytes (%llu on the wire, compression %s)",
+                        (unsigned long long)stats.messages, (unsigned long long)stats.raw_bytes, (unsigned long long)stats.wire_bytes,
+                        stats.compression ? "on" : "off"));
                 }
 
-                void BinanceMdApi::on_packet(const Json& packet)
+                bool BinanceMdApi::on_frame(std::string_view frame)
                 {
-                    if (!packet.contains("stream"))
-                        return;
-
-                    AString stream = packet.value("stream", "");
-                    if (stream.empty())
-                        return;
-
-                    if (!packet.contains("data"))
-                        return;
+                    // Stream messages are decoded here, on the connection's thread; subscription replies go on to
+                    // unpack_data and on_packet
+                    MarketDataUpdate update;
+                    if (!decode_market_data(frame, update))
+                        return false;
+
+                    // ignore kline stream in C++ implementation (no extra field on TickData)
+                    if (update.name.empty())
+                        return true;
+
+                    this->deliver([this, update = std::move(update)]() {
+                        this->on_market_data(update);
+                    });
+                    return true;
+                }
 
-                    const Json& data = packet["data"];
+                bool BinanceMdApi::decode_market_data(std::string_view frame, MarketDataUpdate& update)
+                {
+                    // Reads only the fields TickData takes
+                    JsonView packet(frame);
+                    std::string_view stream = packet["stream"].str();
+                    JsonView data = packet["data"];
 
                     size_t pos = stream.find('@');
-                    if (pos == AString::npos)
-                        return;
-
-                    AString name = stream.substr(0, pos);
-                    AString channel = stream.substr(pos + 1);
-
-                    AString name_upper = StrToUpper(name);
-
-                    auto opt_contract = this->exchange->get_contract_by_name(name_upper);
-                    if (!opt_contract)
-                        return;
+                    if (pos == std::string_view::npos || !data.is_object())
+                        return false;
 
-                    ContractData contract = *opt_contract;
-
-                    // ensure we have a tick registered for this symbol
-                    if (!this->ticks.count(contract.symbol))
-                        return;
-
-                    TickData& tick = this->ticks[contract.symbol];
+                    std::string_view channel = stream.substr(pos + 1);
 
                     if (channel == "ticker")
                     {
-                        tick.volume = JsonToFloat(data["v"]);
-                        tick.turnover = JsonToFloat(data["q"]);
-                        tick.open_price = JsonToFloat(data["o"]);
-                        tick.high_price = JsonToFloat(data["h"]);
-                        tick.low_price = JsonToFloat(data["l"]);
-                        tick.last_price = JsonToFloat(data["c"]);
-
-                        // event time
-                        long long ts = 0;
-                        if (data.contains("E"))
+                        for (auto it = data.begin(); it != data.end(); ++it)
                         {
-                            if (data["E"].is_number())
-                                ts = data["E"].get<long long>();
-                            else if (data["E"].is_string())
-                                ts = std::atoll(AString(data["E"]).c_str());
-                        }
-
-                        if (ts > 0)
-                            tick.datetime = DateTimeFromTimestamp(ts);
+                            std::string_view key = it.key();
+                            if (key.size() != 1)
+                                continue;
 
-                        this->exchange->on_tick(copy(tick));
+                            switch (key[0])
+                            {
+                                case 'v': update.volume = (float)it->get_double(); break;
+                                case 'q': update.turnover = (float)it->get_double(); break;
+                                case 'o': update.open_price = (float)it->get_double(); break;
+                                case 'h': update.high_price = (float)it->get_double(); break;
+                                case 'l': update.low_price = (float)it->get_double(); break;
+                                case 'c': update.last_price = (float)it->get_double(); break;
+                                case 'E': update.timestamp = it->get_int(); break;
+                            }
+                        }
                     }
                     else if (channel == "depth10")
                     {
-                        const Json& bids = data.value("b", Json::array());
-                        const Json& asks = data.value("a", Json::array());
-
-                        if (bids.is_array())
+                        update.depth = true;
+                        for (auto it = data.begin(); it != data.end(); ++it)
                         {
-                            if (bids.size() > 0) { tick.bid_price_1 = JsonToFloat(bids[0][0]); tick.bid_volume_1 = JsonToFloat(bids[0][1]); }
-                            if (bids.size() > 1) { tick.bid_price_2 = JsonToFloat(bids[1][0]); tick.bid_volume_2 = JsonToFloat(bids[1][1]); }
-                            if (bids.size() > 2) { tick.bid_price_3 = JsonToFloat(bids[2][0]); tick.bid_volume_3 = JsonToFloat(bids[2][1]); }
-                            if (bids.size() > 3) { tick.bid_price_4 = JsonToFloat(bids[3][0]); tick.bid_volume_4 = JsonToFloat(bids[3][1]); }
-                            if (bids.size() > 4) { tick.bid_price_5 = JsonToFloat(bids[4][0]); tick.bid_volume_5 = JsonToFloat(bids[4][1]); }
+                            std::string_view key = it.key();
+                            if (key == "b")
+                                update.bid_levels = MarketDataUpdate::decode_levels(*it, update.bid_price, update.bid_volume);
+                            else if (key == "a")
+                                update.ask_levels = MarketDataUpdate::decode_levels(*it, update.ask_price, update.ask_volume);
+                            else if (key == "E")
+                                update.timestamp = it->get_int();
                         }
+                    }
+                    else
+                    {
+                        return true;
+                    }
 
-                        if (asks.is_array())
-                        {
-                            if (asks.size() > 0) { tick.ask_price_1 = JsonToFloat(asks[0][0]); tick.ask_volume_1 = JsonToFloat(asks[0][1]); }
-                            if (asks.size() > 1) { tick.ask_price_2 = JsonToFloat(asks[1][0]); tick.ask_volume_2 = JsonToFloat(asks[1][1]); }
-                            if (asks.size() > 2) { tick.ask_price_3 = JsonToFloat(asks[2][0]); tick.ask_volume_3 = JsonToFloat(asks[2][1]); }
-                            if (asks.size() > 3) { tick.ask_price_4 = JsonToFloat(asks[3][0]); tick.ask_volume_4 = JsonToFloat(asks[3][1]); }
-                            if (asks.size() > 4) { tick.ask_price_5 = JsonToFloat(asks[4][0]); tick.ask_volume_5 = JsonToFloat(asks[4][1]); }
-                        }
+                    update.name = StrToUpper(AString(stream.substr(0, pos)));
+                    return true;
+                }
 
-                        // event time
-                        long long ts = 0;
-                        if (data.contains("E"))
-                        {
-                            if (data["E"].is_number())
-                                ts = data["E"].get<long long>();
-                            else if (data["E"].is_string())
-                                ts = std::atoll(AString(data["E"]).c_str());
-                        }
+                void BinanceMdApi::on_market_data(const MarketDataUpdate& update)
+                {
+                    auto opt_contract = this->exchange->get_contract_by_name(update.name);
+                    if (!opt_contract)
+                        return;
 
-                        if (ts > 0)
-                            tick.datetime = DateTimeFromTimestamp(ts);
+                    // ensure we have a tick registered for this symbol
+                    auto it = this->ticks.find(opt_contract->symbol);
+                    if (it == this->ticks.end())
+                        return;
 
-                        this->exchange->on_tick(copy(tick));
+                    TickData& tick = it->second;
+
+                    if (update.depth)
+                    {
+                        update.apply_depth(tick);
                     }
                     else
                     {
-                        // ignore kline stream in C++ implementation (no extra field on TickData)
-                        (void)data;
+                        tick.volume = update.volume;
+                        tick.turnover = update.turnover;
+                        tick.open_price = update.open_price;
+                        tick.high_price = update.high_price;
+                        tick.low_price = update.low_price;
+                        tick.last_price = update.last_price;
                     }
 
-                    // final generic tick push removed to avoid duplicate pushes
+                    // event time
+                    if (update.timestamp > 0)
+                        tick.datetime = DateTimeFromTimestamp(update.timestamp);
+
+                    this->exchange->on_tick(copy(tick));
                 }
 
                 void BinanceMdApi::on_error(const std::exception& ex)
@@ -1042,6 +1140,7 @@ namespace Keen
             {
                 this->exchange = exchange;
                 this->exchange_name = exchange->get_exchange_name();
+                this->set_network_channel(NetworkChannel::ORDER);
 
                 this->proxy_host = "";
                 this->proxy_port = 0;
@@ -1174,7 +1273,7 @@ namespace Keen
                     {"params", params_json}
                 };
 
-                this->send_packet(packet);
+                this->send_packet(packet, "order.place");
 
                 return order.kt_orderid;
             }
@@ -1210,7 +1309,7 @@ namespace Keen
                     {"params", params_json}
                 };
 
-                this->send_packet(packet);
+                this->send_packet(packet, "order.cancel");
             }
 
             void BinanceTradeApi::sign(Params& params)
@@ -1260,6 +1359,24 @@ namespace Keen
 
             void BinanceTradeApi::on_packet(const Json& packet)
             {
+                // Replies carry the exchange's counts, keep the shared limiter in step with them
+                if (packet.contains("rateLimits"))
+                {
+                    for (const Json& limit : packet["rateLimits"])
+                    {
+                        AString type = limit.value("rateLimitType", "");
+                        AString interval = limit.value("interval", "");
+                        int interval_num = limit.value("intervalNum", 0);
+                        UInt32 count = limit.value("count", 0);
+                        if (type == "REQUEST_WEIGHT" && interval == "MINUTE" && interval_num == 1)
+                            this->get_rate_limiter()->set_used("weight", count);
+                        else if (type == "ORDERS" && interval == "SECOND" && interval_num == 10)
+                            this->get_rate_limiter()->set_used("orders_10s", count);
+                        else if (type == "ORDERS" && interval == "MINUTE" && interval_num == 1)
+                            this->get_rate_limiter()->set_used("orders_1m", count);
+                    }
+                }
+
                 int id = packet.value("id", 0);
                 auto it = this->reqid_callback_map.find(id);
                 if (it != this->reqid_callback_map.end())
@@ -1311,6 +1428,8 @@ namespace Keen
             {
                 this->exchange = exchange;
                 this->exchange_name = exchange->get_exchange_name();
+                // fills shouldn't wait behind market data either
+                this->set_network_channel(NetworkChannel::ORDER);
             }
 
             void BinanceUserApi::connect(
@@ -1333,11 +1452,27 @@ namespace Keen
                 this->exchange->rest_api->start_user_stream();
             }
 
-            void BinanceUserApi::on_packet(const Json& packet)
+            bool BinanceUserApi::on_frame(std::string_view frame)
             {
-                if (!packet.contains("e"))
-                    return;
-                AString evt = packet["e"];
+                // Decoded on the main loop, where orders and positions live; this copy is the frame's only one
+                auto text = std::make_shared<AString>(frame);
+                this->deliver([this, text]() {
+                    try
+                    {
+                        this->on_event(JsonView(*text));
+                    }
+                    catch (const std::exception& e)
+                    {
+                        LOGERROR(Printf("wss error with text: %s", text->c_str()));
+                        this->on_error(e);
+                    }
+                });
+                return true;
+            }
+
+            void BinanceUserApi::on_event(const JsonView& packet)
+            {
+                std::string_view evt = packet["e"].str();
                 if (evt == "ACCOUNT_UPDATE")
                     this->on_account(packet);
                 else if (evt == "ORDER_TRADE_UPDATE")
@@ -1357,21 +1492,21 @@ namespace Keen
                 this->stop();
             }
 
-            void BinanceUserApi::on_account(const Json& packet)
+            void BinanceUserApi::on_account(const JsonView& packet)
             {
                 if (!packet.contains("a"))
                     return;
 
-                const Json& a = packet["a"];
+                JsonView a = packet["a"];
 
                 // balances
-                if (a.contains("B") && a["B"].is_array())
+                if (a["B"].is_array())
                 {
-                    for (const Json& acc : a["B"]) {
+                    for (const JsonView& acc : a["B"]) {
                         AccountData account;
                         account.accountid = acc.value("a", "");
-                        account.balance = JsonToFloat(acc.value("wb", 0.0));
-                        double cw = JsonToFloat(acc.value("cw", 0.0));
+                        account.balance = (float)acc["wb"].get_double();
+                        double cw = acc["cw"].get_double();
                         account.frozen = account.balance - cw;
                         account.exchange_name = this->exchange_name;
                         account.__post_init__();
@@ -1382,17 +1517,14 @@ namespace Keen
                 }
 
                 // positions
-                if (a.contains("P") && a["P"].is_array())
+                if (a["P"].is_array())
                 {
-                    for (const Json& pos : a["P"]) {
-                        AString ps = pos.value("ps", "");
-                        if (ps != "BOTH")
+                    for (const JsonView& pos : a["P"]) {
+                        if (pos["ps"].str() != "BOTH")
                             continue;
 
                         // volume may be string or number
-                        double volume = 0.0;
-                        if (pos.contains("pa"))
-                            volume = JsonToFloat(pos["pa"]);
+                        double volume = pos["pa"].get_double();
 
                         AString name = pos.value("s", "");
                         auto opt_contract = this->exchange->get_contract_by_name(name);
@@ -1406,8 +1538,8 @@ namespace Keen
                         position.exchange = Exchange::BINANCE;
                         position.direction = Direction::NET;
                         position.volume = (float)volume;
-                        position.price = JsonToFloat(pos.value("ep", 0.0));
-                        position.pnl = JsonToFloat(pos.value("up", 0.0));
+                        position.price = (float)pos["ep"].get_double();
+                        position.pnl = (float)pos["up"].get_double();
                         position.exchange_name = this->exchange_name;
                         position.__post_init__();
 
@@ -1416,12 +1548,12 @@ namespace Keen
                 }
             }
 
-            void BinanceUserApi::on_order(const Json& packet)
+            void BinanceUserApi::on_order(const JsonView& packet)
             {
                 if (!packet.contains("o"))
                     return;
 
-                const Json& ord = packet["o"];
+                JsonView ord = packet["o"];
 
                 // determine order type using mapping
                 AString type = ord.value("o", "");
@@ -1450,9 +1582,9 @@ namespace Keen
                 order.orderid = ord.value("c", "");
                 order.symbol = contract.symbol;
                 order.exchange = Exchange::BINANCE;
-                order.price = JsonToFloat(ord["p"]);
-                order.volume = JsonToFloat(ord["q"]);
-                order.traded = JsonToFloat(ord["z"]);
+                order.price = (float)ord["p"].get_double();
+                order.volume = (float)ord["q"].get_double();
+                order.traded = (float)ord["z"].get_double();
                 order.type = order_type;
                 AString side = ord.value("S", "");
                 auto it_dir = DIRECTION_BINANCE2VT.find(side);
@@ -1481,7 +1613,7 @@ namespace Keen
                 this->exchange->on_order(order);
 
                 // trades
-                double trade_volume = JsonToFloat(ord["l"]);
+                double trade_volume = ord["l"].get_double();
                 trade_volume = round_to((float)trade_volume, contract.min_volume);
                 if (trade_volume <= 0.0)
                     return;
@@ -1490,9 +1622,10 @@ namespace Keen
                 trade.symbol = order.symbol;
                 trade.exchange = order.exchange;
                 trade.orderid = order.orderid;
-                trade.tradeid = ord.value("t", "");
+                // a number in the stream
+                trade.tradeid = ord["t"].is_string() ? ord["t"].get_string() : AString(ord["t"].raw());
                 trade.direction = order.direction;
-                trade.price = JsonToFloat(ord["L"]);
+                trade.price = (float)ord["L"].get_double();
                 trade.volume = (float)trade_volume;
                 long long ttime = ord.value("T", 0LL);
                 if (ttime > 0)
@@ -36,6 +36,7 @@ namespace Keen
                 void query_account() override;
                 void query_position() override;
                 std::list<BarData> query_history(const HistoryRequest& req) override;
+                Task<std::list<BarData>> query_history_async(HistoryRequest req) override;
                 void process_timer_event(const Event& event);
                 void close() override;
 
@@ -59,6 +60,8 @@ namespace Keen
                 BinanceTradeApi* trade_api = nullptr;
                 BinanceUserApi* user_api = nullptr;
 
+                TimerHandle keepalive_timer;
+
             private:
                 AString key;
                     friend class BinanceRestApi;
@@ -103,15 +106,21 @@ namespace Keen
                 void on_query_account(const Json& packet, const Request& request);
                 void on_query_time(const Json& packet, const Request& request);
                 void on_query_position(const Json& packet, const Request& request);
-                void on_query_contract(const Json& packet, const Request& request);
+                void on_query_contract(const AString& body, const Request& request);
                 void on_start_user_stream(const Json& packet, const Request& request);
                 void on_keep_user_stream(const Json& packet, const Request& request);
                 void on_keep_user_stream_error(const std::type_info& exception_type, const std::exception& exception_value, const void* tb, const Request& request);
                 void on_set_position_mode(const Json& packet, const Request& request);
                 void on_set_leverage(const Json& packet, const Request& request);
                 std::list<BarData> query_history(const HistoryRequest& req);
+                Task<std::list<BarData>> query_history_async(HistoryRequest req);
 
             protected:
+                Params history_params(const ContractData& contract, const HistoryRequest& req, long long start_ms);
+                bool on_history_page(const Response& resp, const HistoryRequest& req, std::list<BarData>& history, long long& start_ms);
+                std::list<BarData> finish_history(std::list<BarData>& history);
+                void on_contract_data(const Json& d);
+
                 BinanceLinearExchange* exchange;
                 AString exchange_name;
                 AString key;
@@ -131,7 +140,7 @@ namespace Keen
                 bool hedge_mode = false;
             };
 
-            class BinanceMdApi : public WebsocketClient
+            class KEEN_EXCHANGE_EXPORT BinanceMdApi : public WebsocketClient
             {
             public:
                 BinanceMdApi(BinanceLinearExchange* exchange);
@@ -144,7 +153,12 @@ namespace Keen
                 void subscribe(const SubscribeRequest& req);
                 void on_connected() override;
                 void on_disconnected() override;
-                void on_packet(const Json& packet) override;
+                bool on_frame(std::string_view frame) override;
+                void on_market_data(const MarketDataUpdate& update);
+
+                /** Decodes a combined stream message into update; update.name stays empty for streams TickData has no
+                field for. Returns false for anything else, e.g. subscription replies. */
+                static bool decode_market_data(std::string_view frame, MarketDataUpdate& update);
                 void on_error(const std::exception& ex) override;
 
             protected:
@@ -209,11 +223,12 @@ namespace Keen
                 );
                 void on_connected() override;
                 void on_disconnected() override;
-                void on_packet(const Json& packet) override;
+                bool on_frame(std::string_view frame) override;
+                void on_event(const JsonView& packet);
                 void on_error(const std::exception& ex) override;
                 void on_listen_key_expired();
-                void on_account(const Json& packet);
-                void on_order(const Json& packet);
+                void on_account(const JsonView& packet);
+                void on_order(const JsonView& packet);
                 void on_disconnected(int status_code, const AString& msg);
 
             protected:
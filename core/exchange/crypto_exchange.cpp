@@ -8,6 +8,41 @@ namespace Keen
 {
 	namespace exchange
 	{
+		int MarketDataUpdate::decode_levels(const JsonView& levels, float* prices, float* volumes)
+		{
+			int count = 0;
+			for (const JsonView& level : levels)
+			{
+				if (count == 5)
+				{
+					break;
+				}
+				prices[count] = static_cast<float>(level[0].get_double());
+				volumes[count] = static_cast<float>(level[1].get_double());
+				++count;
+			}
+			return count;
+		}
+
+		void MarketDataUpdate::apply_depth(TickData& tick) const
+		{
+			float* bid_prices[] = { &tick.bid_price_1, &tick.bid_price_2, &tick.bid_price_3, &tick.bid_price_4, &tick.bid_price_5 };
+			float* bid_volumes[] = { &tick.bid_volume_1, &tick.bid_volume_2, &tick.bid_volume_3, &tick.bid_volume_4, &tick.bid_volume_5 };
+			float* ask_prices[] = { &tick.ask_price_1, &tick.ask_price_2, &tick.ask_price_3, &tick.ask_price_4, &tick.ask_price_5 };
+			float* ask_volumes[] = { &tick.ask_volume_1, &tick.ask_volume_2, &tick.ask_volume_3, &tick.ask_volume_4, &tick.ask_volume_5 };
+
+			for (int i = 0; i < this->bid_levels; ++i)
+			{
+				*bid_prices[i] = this->bid_price[i];
+				*bid_volumes[i] = this->bid_volume[i];
+			}
+			for (int i = 0; i < this->ask_levels; ++i)
+			{
+				*ask_prices[i] = this->ask_price[i];
+				*ask_volumes[i] = this->ask_volume[i];
+			}
+		}
+
 		CryptoExchange::CryptoExchange(EventEmitter* event_emitter, AString exchange_name)
 			: BaseExchange(event_emitter, exchange_name)
 		{
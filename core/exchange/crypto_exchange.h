@@ -2,6 +2,7 @@
 
 #include <engine/exchange.h>
 #include <engine/constant.h>
+#include <api/JsonView.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -12,6 +13,36 @@ namespace Keen
 {
 	namespace exchange
 	{
+		/** One ticker or five-level book message, decoded by a market data client on its connection's thread
+		and applied to the TickData on the main loop. */
+		struct MarketDataUpdate
+		{
+			AString name;               // the exchange's instrument name
+			long long timestamp = 0;    // ms, 0 if the message carries none
+			bool depth = false;         // a book message, otherwise a ticker
+
+			float volume = 0;
+			float turnover = 0;
+			float open_price = 0;
+			float high_price = 0;
+			float low_price = 0;
+			float last_price = 0;
+
+			// Best level first
+			int bid_levels = 0;
+			int ask_levels = 0;
+			float bid_price[5] = {};
+			float bid_volume[5] = {};
+			float ask_price[5] = {};
+			float ask_volume[5] = {};
+
+			/** Reads up to five [price, volume, ...] levels, returns how many were read. */
+			static int decode_levels(const Keen::api::JsonView& levels, float* prices, float* volumes);
+
+			/** Writes the book levels read into tick. */
+			void apply_depth(TickData& tick) const;
+		};
+
 		/**
 		 * @brief 数字货币交易所基础类
 		 * 专门处理数字货币交易所的全局设置，如持仓模式和杠杆倍数
@@ -1,4 +1,5 @@
 #include <api/Globals.h>
+#include <api/JsonRecords.h>
 #include <engine/engine.h>
 #include <engine/utility.h>
 #include "okx_exchange.h"
@@ -33,6 +34,30 @@ namespace Keen
 			const AString DEMO_PRIVATE_HOST = "wss://wspap.okx.com:8443/ws/v5/private?brokerId=9999";
 			const AString DEMO_BUSINESS_HOST = "wss://wspap.okx.com:8443/ws/v5/business?brokerId=9999";
 
+			// Candles per history request
+			const int HISTORY_LIMIT = 100;
+
+			// OKX limits each endpoint on its own, per 2 seconds; order and cancel limits are per instrument,
+			// kept here as one limit across instruments
+			static void setup_rate_limits(RateLimiter& limiter)
+			{
+				std::vector<std::tuple<AString, AString, UInt32, RequestPriority>> limits = {
+					{ "GET", "/api/v5/market/candles", 40, RequestPriority::QUERY },
+					{ "GET", "/api/v5/public/instruments", 20, RequestPriority::QUERY },
+					{ "GET", "/api/v5/public/time", 10, RequestPriority::QUERY },
+					{ "GET", "/api/v5/trade/orders-pending", 60, RequestPriority::QUERY },
+					{ "POST", "/api/v5/account/set-position-mode", 5, RequestPriority::QUERY },
+					{ "POST", "/api/v5/account/set-leverage", 20, RequestPriority::QUERY },
+					{ "WS", "order", 60, RequestPriority::ORDER },
+					{ "WS", "cancel-order", 60, RequestPriority::ORDER },
+				};
+				for (auto& [method, path, capacity, priority] : limits)
+				{
+					limiter.add_bucket(path, capacity, std::chrono::seconds(2));
+					limiter.set_weight(method, path, path, 1, priority);
+				}
+			}
+
 			AString okx_generate_signature(AString msg, AString secret_key);
 
 			AString generate_timestamp();
@@ -95,6 +120,9 @@ namespace Keen
 				this->rest_api = new OkxRestApi(this);
 				this->public_api = new OkxWebsocketPublicApi(this);
 				this->private_api = new OkxWebsocketPrivateApi(this);
+
+				setup_rate_limits(*this->rest_api->get_rate_limiter());
+				this->private_api->set_rate_limiter(this->rest_api->get_rate_limiter());
 			}
 
 			OkxExchange::~OkxExchange()
@@ -114,6 +142,8 @@ namespace Keen
 				this->proxy_port = setting.value("proxy_port", 0);
 				this->server = setting.value("server", "");
 				this->hedge_mode = setting.value("hedge_mode", false);
+				// permessage-deflate for market data, order entry stays uncompressed
+				this->public_api->set_compression(setting.value("ws_compression", false));
 
 				this->rest_api->connect(
 					this->key,
@@ -169,6 +199,11 @@ namespace Keen
 				return this->rest_api->query_history(req);
 			}
 
+			Task<std::list<BarData>> OkxExchange::query_history_async(HistoryRequest req)
+			{
+				return this->rest_api->query_history_async(std::move(req));
+			}
+
 			void OkxExchange::close()
 			{
 				this->rest_api->stop();
@@ -380,7 +415,8 @@ namespace Keen
 					Request request{
 						.method = "GET",
 						.path = "/api/v5/public/instruments?instType=" + inst_type,
-						.callback = std::bind(&OkxRestApi::on_query_contract, this, _1, _2) };
+						// Thousands of instruments, parsed one by one
+						.body_callback = std::bind(&OkxRestApi::on_query_contract, this, _1, _2) };
 
 					this->request(request);
 				}
@@ -453,40 +489,51 @@ namespace Keen
 				this->exchange->write_log(msg);
 			}
 
-			void OkxRestApi::on_query_contract(const Json& packet, const Request& request)
+			void OkxRestApi::on_contract_data(const Json& d)
 			{
-				AString instType;
-				for (const Json& d : packet["data"])
-				{
-					AString name = d["instId"];
-					int instIdCode = JsonToInt(d["instIdCode"]);
-					instType = d["instType"];
-					Product product = PRODUCT_OKX2KT[instType];
-					bool net_position = true;
-					float size;
-					if (product == Product::SPOT)
-						size = 1;
-					else
-						size = JsonToFloat(d["ctMult"]);
+				AString name = d["instId"];
+				int instIdCode = JsonToInt(d["instIdCode"]);
+				AString instType = d["instType"];
+				Product product = PRODUCT_OKX2KT[instType];
+				bool net_position = true;
+				float size;
+				if (product == Product::SPOT)
+					size = 1;
+				else
+					size = JsonToFloat(d["ctMult"]);
 
-					ContractData contract{
-						.symbol = name,
-						.exchange = Exchange::OKX,
-						.name = name,
-						.instIdCode = instIdCode,
-						.product = product,
-						.size = size,
-						.pricetick = JsonToFloat(d["tickSz"]),
-						.min_volume = JsonToFloat(d["minSz"]),
-						.history_data = true,
-						.net_position = net_position,
-						.exchange_name = this->exchange_name,
-					};
-					contract.__post_init__();
+				ContractData contract{
+					.symbol = name,
+					.exchange = Exchange::OKX,
+					.name = name,
+					.instIdCode = instIdCode,
+					.product = product,
+					.size = size,
+					.pricetick = JsonToFloat(d["tickSz"]),
+					.min_volume = JsonToFloat(d["minSz"]),
+					.history_data = true,
+					.net_position = net_position,
+					.exchange_name = this->exchange_name,
+				};
+				contract.__post_init__();
 
-					this->exchange->on_contract(contract);
+				this->exchange->on_contract(contract);
 
-					this->product_ready.insert(contract.product);
+				this->product_ready.insert(contract.product);
+			}
+
+			void OkxRestApi::on_query_contract(const AString& body, const Request& request)
+			{
+				AString instType;
+				auto on_instrument = [this, &instType](Json& d) {
+					this->on_contract_data(d);
+					instType = d["instType"];
+				};
+				AString error;
+				if (!ParseJsonRecords(body, { "data" }, on_instrument, nullptr, &error))
+				{
+					this->exchange->write_log(Printf("Contract data parsing failed: %s", error.c_str()));
+					return;
 				}
 
 				this->exchange->write_log(Printf("%s contract information query successful", instType.c_str()));
@@ -555,101 +602,130 @@ namespace Keen
 
 				std::list<BarData> history;
 				AString after = std::to_string(duration_cast<milliseconds>(req.end.time_since_epoch()).count());
-				int limit = 100;
-				bool has_error = false;
 
-				while (!has_error)
+				while (true)
 				{
-					AString path = "/api/v5/market/candles";
+					Response resp = this->request("GET", "/api/v5/market/candles", this->history_params(req, after));
+					if (!this->on_history_page(resp, req, history, after))
+						break;
+				}
 
-					Params params = {
-						{ "instId", req.symbol },
-						{ "limit", std::to_string(limit) },
-						{ "bar", INTERVAL_KT2OKX[req.interval]},
-						{ "after", after },
-					};
+				return this->finish_history(history);
+			}
 
-					Response resp = this->request("GET", path, params);
+			Task<std::list<BarData>> OkxRestApi::query_history_async(HistoryRequest req)
+			{
+				auto contract = this->exchange->get_contract_by_symbol(req.symbol);
+				if (!contract)
+				{
+					this->exchange->write_log(Printf("Query kline history failed, symbol not found: %s", req.symbol.c_str()));
+					co_return std::list<BarData>();
+				}
 
-					if (resp.status / 100 != 2)
-					{
-						AString msg = Printf("Query kline history failed, status code: %d, information: %s",
-							resp.status, resp.body.c_str());
-						this->exchange->write_log(msg);
-						has_error = true;
+				std::list<BarData> history;
+				AString after = std::to_string(duration_cast<milliseconds>(req.end.time_since_epoch()).count());
+
+				while (true)
+				{
+					Response resp = co_await this->async_request("GET", "/api/v5/market/candles", this->history_params(req, after));
+					if (!this->on_history_page(resp, req, history, after))
 						break;
-					}
-					else
-					{
-						try {
-							Json data = Json::parse(resp.body); // get() is needed!
-							if (!data.contains("data"))
-							{
-								AString m = data["msg"];
-								AString msg = Printf("The historical data obtained is empty, %s", m.c_str());
-								has_error = true;
-								break;
-							}
+				}
 
-							const Json& bar_data = data.value("data", Json::array());
+				co_return this->finish_history(history);
+			}
 
-							if (!bar_data.size())
-								break;
+			Params OkxRestApi::history_params(const HistoryRequest& req, const AString& after)
+			{
+				return Params{
+					{ "instId", req.symbol },
+					{ "limit", std::to_string(HISTORY_LIMIT) },
+					{ "bar", INTERVAL_KT2OKX[req.interval]},
+					{ "after", after },
+				};
+			}
 
-							for (auto row : bar_data)
-							{
-								if (!row.is_array() || row.size() < 6) {
-									continue;
-								}
-
-								BarData bar;
-								bar.symbol = req.symbol;
-								bar.exchange = req.exchange;
-								bar.datetime = DateTimeFromStringTime(row[0]);
-								bar.interval = req.interval;
-								bar.volume = JsonToFloat(row[5]);
-								bar.open_price = JsonToFloat(row[1]);
-								bar.high_price = JsonToFloat(row[2]);
-								bar.low_price = JsonToFloat(row[3]);
-								bar.close_price = JsonToFloat(row[4]);
-								bar.exchange_name = this->exchange_name;
-								bar.__post_init__();
-
-								history.push_back(bar);
-							}
+			bool OkxRestApi::on_history_page(const Response& resp, const HistoryRequest& req, std::list<BarData>& history, AString& after)
+			{
+				if (resp.status / 100 != 2)
+				{
+					AString msg = Printf("Query kline history failed, status code: %d, information: %s",
+						resp.status, resp.body.c_str());
+					this->exchange->write_log(msg);
+					return false;
+				}
+
+				try {
+					// Rows come newest first: [ts, open, high, low, close, volume, ...]
+					size_t rows = 0;
+					AString begin;
+					AString end;
+					auto on_row = [&](Json& row) {
+						++rows;
+						if (!row.is_array() || row.size() < 6) {
+							return;
+						}
 
-							AString begin = (*bar_data.rbegin())[0];
-							AString end = (*bar_data.begin())[0];
-							DateTime begin_dt = DateTimeFromStringTime(begin);
-							DateTime end_dt = DateTimeFromStringTime(end);
+						BarData bar;
+						bar.symbol = req.symbol;
+						bar.exchange = req.exchange;
+						bar.datetime = DateTimeFromStringTime(row[0]);
+						bar.interval = req.interval;
+						bar.volume = JsonToFloat(row[5]);
+						bar.open_price = JsonToFloat(row[1]);
+						bar.high_price = JsonToFloat(row[2]);
+						bar.low_price = JsonToFloat(row[3]);
+						bar.close_price = JsonToFloat(row[4]);
+						bar.exchange_name = this->exchange_name;
+						bar.__post_init__();
+
+						history.push_back(bar);
+
+						if (end.empty())
+							end = row[0];
+						begin = row[0];
+					};
+					AString error;
+					if (!ParseJsonRecords(resp.body, { "data" }, on_row, nullptr, &error))
+					{
+						this->exchange->write_log(Printf("JSON parsing failed: %s", error.c_str()));
+						return false;
+					}
 
+					// An empty page, or no "data" at all, ends the query
+					if (!rows || begin.empty())
+						return false;
 
-							AString msg = Printf("Query kline history finished, %s - %s, %s - %s",
-								req.symbol.c_str(), interval_to_str(req.interval).c_str(),
-								DateTimeToString(begin_dt).c_str(), DateTimeToString(end_dt).c_str());
-							this->exchange->write_log(msg);
+					DateTime begin_dt = DateTimeFromStringTime(begin);
+					DateTime end_dt = DateTimeFromStringTime(end);
 
-							// Break if all bars have been queried
-							if (begin_dt <= req.start)
-								break;
 
-							// Update start time
-							after = begin;
-						}
-						catch (const std::exception& e) {
-							this->exchange->write_log(Printf("JSON parsing failed: %s", e.what()));
-							has_error = true;
-							break;
-						}
+					AString msg = Printf("Query kline history finished, %s - %s, %s - %s",
+						req.symbol.c_str(), interval_to_str(req.interval).c_str(),
+						DateTimeToString(begin_dt).c_str(), DateTimeToString(end_dt).c_str());
+					this->exchange->write_log(msg);
 
-					}
+					// Break if all bars have been queried
+					if (begin_dt <= req.start)
+						return false;
+
+					// Update start time
+					after = begin;
+					return true;
+				}
+				catch (const std::exception& e) {
+					this->exchange->write_log(Printf("JSON parsing failed: %s", e.what()));
+					return false;
 				}
+			}
 
+			std::list<BarData> OkxRestApi::finish_history(std::list<BarData>& history)
+			{
 				history.sort([](const BarData& a, const BarData& b) {
 					return a.datetime < b.datetime;
 					});
 
-				return history;
+				return std::move(history);
 			}
 
 			OkxWebsocketPublicApi::OkxWebsocketPublicApi(OkxExchange* exchange)
@@ -657,11 +733,6 @@ namespace Keen
 			{
 				this->exchange = exchange;
 				this->exchange_name = exchange->exchange_name;
-
-				this->callbacks = {
-					{"tickers", std::bind(&OkxWebsocketPublicApi::on_ticker, this, _1)},
-					{"books5", std::bind(&OkxWebsocketPublicApi::on_depth, this, _1)},
-				};
 			}
 
 			void OkxWebsocketPublicApi::connect(
@@ -718,7 +789,7 @@ namespace Keen
 					{"op", "subscribe"},
 					{"args", args} };
 
-				this->send_packet(okx_req);
+				this->send_subscription(okx_req, "args");
 			}
 
 			void OkxWebsocketPublicApi::on_connected()
@@ -731,7 +802,81 @@ namespace Keen
 
 			void OkxWebsocketPublicApi::on_disconnected()
 			{
-				this->exchange->write_log("Websocket Public API connection disconnected");
+				WebsocketStats stats = this->get_stats();
+				this->exchange->write_log(Printf("Websocket Public API connection disconnected, received %llu messages, %llu bytes (%llu on the wire, compression %s)",
+					(unsigned long long)stats.messages, (unsigned long long)stats.raw_bytes, (unsigned long long)stats.wire_bytes,
+					stats.compression ? "on" : "off"));
+			}
+
+			bool OkxWebsocketPublicApi::on_frame(std::string_view frame)
+			{
+				// Channel pushes are decoded here, on the connection's thread; events go on to unpack_data and on_packet
+				std::vector<MarketDataUpdate> updates;
+				if (!decode_market_data(frame, updates))
+				{
+					return false;
+				}
+
+				if (updates.empty())
+				{
+					return true;
+				}
+
+				this->deliver([this, updates = std::move(updates)]() {
+					this->on_market_data(updates);
+				});
+				return true;
+			}
+
+			bool OkxWebsocketPublicApi::decode_market_data(std::string_view frame, std::vector<MarketDataUpdate>& updates)
+			{
+				// Reads only the fields TickData takes
+				JsonView packet(frame);
+				JsonView data = packet["data"];
+				if (!data.is_array())
+				{
+					return false;
+				}
+
+				std::string_view channel = packet["arg"]["channel"].str();
+				bool depth = (channel == "books5");
+				if (!depth && (channel != "tickers"))
+				{
+					return true;
+				}
+
+				for (const JsonView& d : data)
+				{
+					MarketDataUpdate& update = updates.emplace_back();
+					update.depth = depth;
+					for (auto it = d.begin(); it != d.end(); ++it)
+					{
+						std::string_view key = it.key();
+						if (key == "instId")
+							update.name = it->get_string();
+						else if (key == "ts")
+							update.timestamp = it->get_int();
+						else if (depth && (key == "bids"))
+							update.bid_levels = MarketDataUpdate::decode_levels(*it, update.bid_price, update.bid_volume);
+						else if (depth && (key == "asks"))
+							update.ask_levels = MarketDataUpdate::decode_levels(*it, update.ask_price, update.ask_volume);
+						else if (depth)
+							continue;
+						else if (key == "last")
+							update.last_price = (float)it->get_double();
+						else if (key == "open24h")
+							update.open_price = (float)it->get_double();
+						else if (key == "high24h")
+							update.high_price = (float)it->get_double();
+						else if (key == "low24h")
+							update.low_price = (float)it->get_double();
+						else if (key == "vol24h")
+							update.volume = (float)it->get_double();
+						else if (key == "volCcy24h")
+							update.turnover = (float)it->get_double();
+					}
+				}
+				return true;
 			}
 
 			void OkxWebsocketPublicApi::on_packet(const Json& packet)
@@ -750,17 +895,6 @@ namespace Keen
 						this->exchange->write_log(Printf("Websocket Public API request exception, status code: %d, information: %s", code, msg.c_str()));
 					}
 				}
-				else
-				{
-					const AString& channel = packet["arg"]["channel"];
-					const Json& data = packet["data"];
-
-					auto callback = this->callbacks.find(channel);
-					if (callback != this->callbacks.end())
-					{
-						callback->second(data);
-					}
-				}
 			}
 
 			void OkxWebsocketPublicApi::on_error(const std::exception& ex)
@@ -771,62 +905,28 @@ namespace Keen
 				fprintf(stderr, "%s", msg.c_str());
 			}
 
-			void OkxWebsocketPublicApi::on_ticker(const Json& data)
+			void OkxWebsocketPublicApi::on_market_data(const std::vector<MarketDataUpdate>& updates)
 			{
-				for (const Json& d : data)
+				for (const MarketDataUpdate& update : updates)
 				{
-					const AString& symbol = d["instId"];
-					float volume = JsonToFloat(d["vol24h"]);
-
-					TickData& tick = ticks[symbol];
-					tick.last_price = JsonToFloat(d["last"]);
-					tick.open_price = JsonToFloat(d["open24h"]);
-					tick.high_price = JsonToFloat(d["high24h"]);
-					tick.low_price = JsonToFloat(d["low24h"]);
-					tick.last_volume = tick.volume > 0.f ? volume - tick.volume : 0.f;
-					tick.volume = volume;
-					tick.turnover = JsonToFloat(d["volCcy24h"]);
+					TickData& tick = ticks[update.name];
 
-					tick.datetime = DateTimeFromStringTime(d["ts"]);
-
-					this->exchange->on_tick(tick);
-				}
-			}
+					if (update.depth)
+					{
+						update.apply_depth(tick);
+					}
+					else
+					{
+						tick.last_price = update.last_price;
+						tick.open_price = update.open_price;
+						tick.high_price = update.high_price;
+						tick.low_price = update.low_price;
+						tick.last_volume = tick.volume > 0.f ? update.volume - tick.volume : 0.f;
+						tick.volume = update.volume;
+						tick.turnover = update.turnover;
+					}
 
-			void OkxWebsocketPublicApi::on_depth(const Json& data)
-			{
-				for (const Json& d : data)
-				{
-					AString symbol = d["instId"];
-
-					TickData& tick = ticks[symbol];
-
-					const Json& bids = d["bids"];
-					const Json& asks = d["asks"];
-
-					tick.bid_price_1 = JsonToFloat(bids[0][0]);
-					tick.bid_volume_1 = JsonToFloat(bids[0][1]);
-					tick.bid_price_2 = JsonToFloat(bids[1][0]);
-					tick.bid_volume_2 = JsonToFloat(bids[1][1]);
-					tick.bid_price_3 = JsonToFloat(bids[2][0]);
-					tick.bid_volume_3 = JsonToFloat(bids[2][1]);
-					tick.bid_price_4 = JsonToFloat(bids[3][0]);
-					tick.bid_volume_4 = JsonToFloat(bids[3][1]);
-					tick.bid_price_5 = JsonToFloat(bids[4][0]);
-					tick.bid_volume_5 = JsonToFloat(bids[4][1]);
-
-					tick.ask_price_1 = JsonToFloat(asks[0][0]);
-					tick.ask_volume_1 = JsonToFloat(asks[0][1]);
-					tick.ask_price_2 = JsonToFloat(asks[1][0]);
-					tick.ask_volume_2 = JsonToFloat(asks[1][1]);
-					tick.ask_price_3 = JsonToFloat(asks[2][0]);
-					tick.ask_volume_3 = JsonToFloat(asks[2][1]);
-					tick.ask_price_4 = JsonToFloat(asks[3][0]);
-					tick.ask_volume_4 = JsonToFloat(asks[3][1]);
-					tick.ask_price_5 = JsonToFloat(asks[4][0]);
-					tick.ask_volume_5 = JsonToFloat(asks[4][1]);
-
-					tick.datetime = DateTimeFromStringTime(d["ts"]);
+					tick.datetime = DateTimeFromTimestamp(update.timestamp);
 
 					this->exchange->on_tick(copy(tick));
 				}
@@ -837,6 +937,7 @@ namespace Keen
 			{
 				this->exchange = exchange;
 				this->exchange_name = exchange->exchange_name;
+				this->set_network_channel(NetworkChannel::ORDER);
 
 				this->reqid = 0;
 				this->order_count = 0;
@@ -1240,7 +1341,7 @@ namespace Keen
 				// Log the full request for debugging
 				this->exchange->write_log(Printf("Order request: %s", okx_req.dump().c_str()));
 
-				this->send_packet(okx_req);
+				this->send_packet(okx_req, "order");
 
 				OrderData order = req.create_order_data(orderid, this->exchange_name);
 				this->exchange->on_order(order);
@@ -1275,7 +1376,7 @@ namespace Keen
 					{"id", std::to_string(this->reqid)},
 					{"op", "cancel-order"},
 					{"args", {args}} };
-				this->send_packet(okx_req);
+				this->send_packet(okx_req, "cancel-order");
 			}
 
 			AString okx_generate_signature(AString msg, AString secret_key)
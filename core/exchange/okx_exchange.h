@@ -48,6 +48,7 @@ namespace Keen
 				void query_position() override;
 
 				std::list<BarData> query_history(const HistoryRequest& req) override;
+				Task<std::list<BarData>> query_history_async(HistoryRequest req) override;
 
 				void close() override;
 
@@ -113,15 +114,21 @@ namespace Keen
 
 				void on_query_order(const Json& packet, const Request& request);
 				void on_query_time(const Json& packet, const Request& request);
-				void on_query_contract(const Json& packet, const Request& request);
+				void on_query_contract(const AString& body, const Request& request);
 				void on_set_position_mode(const Json& packet, const Request& request);
 				void on_set_leverage(const Json& packet, const Request& request);
 
 				void on_error(const std::exception& ex, const Request& request) override;
 
 				std::list<BarData> query_history(const HistoryRequest& req);
+				Task<std::list<BarData>> query_history_async(HistoryRequest req);
 
 			protected:
+				Params history_params(const HistoryRequest& req, const AString& after);
+				bool on_history_page(const Response& resp, const HistoryRequest& req, std::list<BarData>& history, AString& after);
+				std::list<BarData> finish_history(std::list<BarData>& history);
+				void on_contract_data(const Json& d);
+
 				OkxExchange* exchange;
 				AString exchange_name;
 
@@ -156,13 +163,17 @@ namespace Keen
 
 				void on_disconnected() override;
 
+				bool on_frame(std::string_view frame) override;
+
 				void on_packet(const Json& packet) override;
 
 				void on_error(const std::exception& ex) override;
 
-				void on_ticker(const Json& data);
+				void on_market_data(const std::vector<MarketDataUpdate>& updates);
 
-				void on_depth(const Json& data);
+				/** Decodes a tickers or books5 push into updates, which stays empty for other channels. Returns false for
+				anything but a data push, e.g. subscription events. */
+				static bool decode_market_data(std::string_view frame, std::vector<MarketDataUpdate>& updates);
 
 			protected:
 				OkxExchange* exchange;
@@ -170,7 +181,6 @@ namespace Keen
 
 				std::map<AString, SubscribeRequest> subscribed;
 				std::map<AString, TickData> ticks;
-				std::map<AString, FnMut<void(const Json&)>> callbacks;
 			};
 
 			class KEEN_EXCHANGE_EXPORT OkxWebsocketPrivateApi : public WebsocketClient
@@ -0,0 +1,219 @@
+#include <api/Globals.h>
+#include <engine/utility.h>
+#include <exchange/binance_linear_exchange.h>
+#include <exchange/okx_exchange.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+using namespace Keen::engine;
+using namespace Keen::exchange;
+using namespace Keen::exchange::binance;
+using namespace Keen::exchange::okx;
+
+/*
+* json_bench                 decodes the sample frames below
+* json_bench <frames file>   decodes frames recorded from the Binance or OKX market data streams, one per line
+*
+* Every frame goes through the decoder the adapters run on the connection thread (JsonView) and through the
+* Json::parse + JsonToFloat path they used before, which reads the same fields into a MarketDataUpdate.
+*/
+
+// Ticker and depth frames in the shape and field order the exchanges send them
+static const char* SAMPLE_FRAMES[] = {
+	R"({"stream":"btcusdt@ticker","data":{"e":"24hrTicker","E":1700000000123,"s":"BTCUSDT","p":"-120.50","P":"-0.318","w":"37612.71","c":"37754.10","Q":"0.004","o":"37874.60","h":"38012.00","l":"37300.00","v":"183745.321","q":"6911233842.59","O":1699913600000,"C":1700000000120,"F":4223456789,"L":4225456789,"n":2000001}})",
+	R"({"stream":"btcusdt@depth10","data":{"e":"depthUpdate","E":1700000000234,"T":1700000000230,"s":"BTCUSDT","U":3400000001,"u":3400000050,"pu":3400000000,"b":[["37754.00","1.234"],["37753.90","0.512"],["37753.80","2.001"],["37753.50","0.090"],["37753.40","4.320"],["37753.00","1.000"],["37752.90","0.333"],["37752.50","7.450"],["37752.10","0.020"],["37752.00","3.100"]],"a":[["37754.10","0.821"],["37754.20","1.600"],["37754.40","0.050"],["37754.50","2.220"],["37754.90","0.700"],["37755.00","5.000"],["37755.30","0.410"],["37755.60","1.180"],["37755.90","0.060"],["37756.00","9.900"]]}})",
+	R"({"arg":{"channel":"tickers","instId":"BTC-USDT-SWAP"},"data":[{"instType":"SWAP","instId":"BTC-USDT-SWAP","last":"37754.1","lastSz":"2","askPx":"37754.2","askSz":"310","bidPx":"37754.1","bidSz":"48","open24h":"37874.6","high24h":"38012","low24h":"37300","sodUtc0":"37700.1","sodUtc8":"37650.3","volCcy24h":"183745.32","vol24h":"18374532","ts":"1700000000123"}]})",
+	R"({"arg":{"channel":"books5","instId":"BTC-USDT-SWAP"},"data":[{"asks":[["37754.2","310","0","12"],["37754.3","42","0","3"],["37754.5","128","0","7"],["37754.8","9","0","1"],["37755","560","0","21"]],"bids":[["37754.1","48","0","5"],["37754","215","0","9"],["37753.7","33","0","2"],["37753.5","700","0","30"],["37753.2","18","0","4"]],"instId":"BTC-USDT-SWAP","ts":"1700000000234","seqId":123456789}]})",
+};
+
+static bool IsBinance(const AString& frame)
+{
+	return frame.find("\"stream\"") != AString::npos;
+}
+
+static int DomLevels(const Json& levels, float* prices, float* volumes)
+{
+	int count = 0;
+	for (const Json& level : levels)
+	{
+		if (count == 5)
+			break;
+		prices[count] = JsonToFloat(level[0]);
+		volumes[count] = JsonToFloat(level[1]);
+		++count;
+	}
+	return count;
+}
+
+/** The DOM path: parse the whole frame, then read the fields. */
+static bool DomDecode(const AString& frame, std::vector<MarketDataUpdate>& updates)
+{
+	Json packet = Json::parse(frame);
+	if (IsBinance(frame))
+	{
+		AString stream = packet.value("stream", "");
+		const Json& data = packet["data"];
+		size_t pos = stream.find('@');
+		if (pos == AString::npos || !data.is_object())
+			return false;
+
+		AString channel = stream.substr(pos + 1);
+		MarketDataUpdate& update = updates.emplace_back();
+		if (channel == "ticker")
+		{
+			update.volume = JsonToFloat(data["v"]);
+			update.turnover = JsonToFloat(data["q"]);
+			update.open_price = JsonToFloat(data["o"]);
+			update.high_price = JsonToFloat(data["h"]);
+			update.low_price = JsonToFloat(data["l"]);
+			update.last_price = JsonToFloat(data["c"]);
+			update.timestamp = data.value("E", 0LL);
+		}
+		else if (channel == "depth10")
+		{
+			update.depth = true;
+			update.bid_levels = DomLevels(data.value("b", Json::array()), update.bid_price, update.bid_volume);
+			update.ask_levels = DomLevels(data.value("a", Json::array()), update.ask_price, update.ask_volume);
+			update.timestamp = data.value("E", 0LL);
+		}
+		update.name = StrToUpper(stream.substr(0, pos));
+		return true;
+	}
+
+	const Json& data = packet["data"];
+	if (!data.is_array())
+		return false;
+
+	AString channel = packet["arg"].value("channel", "");
+	bool depth = (channel == "books5");
+	for (const Json& d : data)
+	{
+		MarketDataUpdate& update = updates.emplace_back();
+		update.depth = depth;
+		update.name = d.value("instId", "");
+		update.timestamp = std::atoll(d.value("ts", "0").c_str());
+		if (depth)
+		{
+			update.bid_levels = DomLevels(d["bids"], update.bid_price, update.bid_volume);
+			update.ask_levels = DomLevels(d["asks"], update.ask_price, update.ask_volume);
+		}
+		else
+		{
+			update.last_price = JsonToFloat(d["last"]);
+			update.open_price = JsonToFloat(d["open24h"]);
+			update.high_price = JsonToFloat(d["high24h"]);
+			update.low_price = JsonToFloat(d["low24h"]);
+			update.volume = JsonToFloat(d["vol24h"]);
+			update.turnover = JsonToFloat(d["volCcy24h"]);
+		}
+	}
+	return true;
+}
+
+/** The adapters' on_frame path. */
+static bool ViewDecode(const AString& frame, std::vector<MarketDataUpdate>& updates)
+{
+	if (IsBinance(frame))
+		return BinanceMdApi::decode_market_data(frame, updates.emplace_back());
+	return OkxWebsocketPublicApi::decode_market_data(frame, updates);
+}
+
+static bool SameUpdate(const MarketDataUpdate& a, const MarketDataUpdate& b)
+{
+	bool same = (a.name == b.name) && (a.timestamp == b.timestamp) && (a.depth == b.depth)
+		&& (a.volume == b.volume) && (a.turnover == b.turnover) && (a.open_price == b.open_price)
+		&& (a.high_price == b.high_price) && (a.low_price == b.low_price) && (a.last_price == b.last_price)
+		&& (a.bid_levels == b.bid_levels) && (a.ask_levels == b.ask_levels);
+	for (int i = 0; same && (i < a.bid_levels); ++i)
+		same = (a.bid_price[i] == b.bid_price[i]) && (a.bid_volume[i] == b.bid_volume[i]);
+	for (int i = 0; same && (i < a.ask_levels); ++i)
+		same = (a.ask_price[i] == b.ask_price[i]) && (a.ask_volume[i] == b.ask_volume[i]);
+	return same;
+}
+
+/** Nanoseconds per frame, best of a few rounds so a stray interruption doesn't count. */
+template <class Decode>
+static double Measure(const std::vector<AString>& frames, size_t iterations, Decode decode)
+{
+	std::vector<MarketDataUpdate> updates;
+	double best = 0;
+	for (int round = 0; round < 5; ++round)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			for (const AString& frame : frames)
+			{
+				updates.clear();
+				decode(frame, updates);
+			}
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		ns /= static_cast<double>(iterations * frames.size());
+		if (round == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<AString> frames;
+	if (argc > 1)
+	{
+		std::ifstream file(argv[1]);
+		AString line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty())
+				frames.push_back(line);
+		}
+	}
+	else
+	{
+		frames.assign(std::begin(SAMPLE_FRAMES), std::end(SAMPLE_FRAMES));
+	}
+
+	if (frames.empty())
+	{
+		std::printf("no frames to decode\n");
+		return 1;
+	}
+
+	std::printf("%-8s %-10s %12s %12s %8s\n", "venue", "channel", "dom ns", "view ns", "speedup");
+	for (const AString& frame : frames)
+	{
+		std::vector<MarketDataUpdate> dom;
+		std::vector<MarketDataUpdate> view;
+		bool decoded = false;
+		try
+		{
+			decoded = DomDecode(frame, dom) && ViewDecode(frame, view);
+		}
+		catch (const std::exception& e)
+		{
+			std::printf("skipped a frame that does not parse: %s\n", e.what());
+			continue;
+		}
+		if (!decoded || view.empty() || view[0].name.empty())
+			continue;
+
+		bool same = (dom.size() == view.size());
+		for (size_t i = 0; same && (i < dom.size()); ++i)
+			same = SameUpdate(dom[i], view[i]);
+		if (!same)
+		{
+			std::printf("decoders disagree on: %s\n", frame.c_str());
+			return 1;
+		}
+
+		std::vector<AString> one = { frame };
+		double dom_ns = Measure(one, 20000, DomDecode);
+		double view_ns = Measure(one, 20000, ViewDecode);
+		std::printf("%-8s %-10s %12.0f %12.0f %7.1fx\n", IsBinance(frame) ? "binance" : "okx",
+			view[0].depth ? "depth" : "ticker", dom_ns, view_ns, dom_ns / view_ns);
+	}
+	return 0;
+}
@@ -3,6 +3,7 @@
 #include <api/Globals.h>
 #include <engine/engine.h>
 #include <engine/utility.h>
+#include <engine/replay.h>
 #include <exchange/okx_exchange.h>
 #include <exchange/binance_linear_exchange.h>
 
@@ -60,7 +61,12 @@ static LONG WINAPI crashHandler(EXCEPTION_POINTERS* ExceptionInfo)
 }
 #endif
 
-int main()
+/*
+* trader                                  trades live on the exchanges below
+* trader --replay <journal> [--speed x]   feeds a recorded journal folder or segment to the strategies instead,
+*                                         as fast as possible or at x times the recorded pace, then exits
+*/
+int main(int argc, char* argv[])
 {
 
 #ifdef _MSC_VER
@@ -68,6 +74,22 @@ int main()
 #endif
 	ConsoleSignalHandler::Register();
 
+	AString replay_path;
+	double replay_speed = 0;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		AString option = argv[i];
+		if (option == "--replay")
+			replay_path = argv[i + 1];
+		else if (option == "--speed")
+			replay_speed = atof(argv[i + 1]);
+	}
+	bool replay = !replay_path.empty();
+	if (replay)
+	{
+		ReplayEngine::use_replay_settings();
+	}
+
 	EventEmitter* event_emitter = MakeEventEmitter();
 	TradeEngine* trade_engine = new TradeEngine(event_emitter);
 
@@ -75,8 +97,24 @@ int main()
 	event_emitter->Register(EVENT_CTA_LOG, std::bind(&LogEngine::process_log_event, log_engine, std::placeholders::_1));
 	trade_engine->write_log("Register log event listeners");
 
-	[[maybe_unused]] auto okx = trade_engine->add_exchange<okx::OkxExchange>();
-	// trade_engine->add_exchange<binance::BinanceLinearExchange>();
+	// The replay registers stub exchanges under the recorded names instead of the live ones
+	ReplayEngine* replay_engine = nullptr;
+	if (replay)
+	{
+		replay_engine = dynamic_cast<ReplayEngine*>(trade_engine->add_engine(new ReplayEngine(trade_engine, event_emitter)));
+		if (!replay_engine->load(replay_path))
+		{
+			SAFE_RELEASE(trade_engine);
+			SAFE_RELEASE(event_emitter);
+			return 1;
+		}
+		replay_engine->set_speed(replay_speed);
+	}
+	else
+	{
+		[[maybe_unused]] auto okx = trade_engine->add_exchange<okx::OkxExchange>();
+		// trade_engine->add_exchange<binance::BinanceLinearExchange>();
+	}
 
 	CtaEngine* cta_engine = dynamic_cast<CtaEngine*>(trade_engine->add_app<CtaStrategyApp>());
 	trade_engine->write_log("Main engine was created successfully");
@@ -126,7 +164,7 @@ int main()
 	});
 	*/
 
-	DelayToQueue(10, [trade_engine, cta_engine]() {
+	DelayToQueue(replay ? 0 : 10, [trade_engine, cta_engine, replay_engine]() {
 		cta_engine->init_engine();
 		trade_engine->write_log("CTA strategy initialization completed");
 
@@ -136,8 +174,27 @@ int main()
 		//std::this_thread::sleep_for(std::chrono::seconds(2));
 		cta_engine->start_all_strategies();
 		trade_engine->write_log("All CTA strategies are activated");
+
+		if (replay_engine != nullptr)
+		{
+			replay_engine->start();
+		}
 		});
 
+	if (replay)
+	{
+		// Leave once every record is on the bus and every event put has been handled: an empty queue alone
+		// misses the events the dispatcher has taken but the main loop has not run yet
+		RepeatToQueue(std::chrono::seconds(1), [replay_engine, event_emitter]() {
+			EventEmitterStats stats = event_emitter->get_stats();
+			if (replay_engine->is_finished() && (stats.queue_size == 0)
+				&& (stats.dispatched + stats.dropped + stats.conflated == stats.put))
+			{
+				exit_main_event_loop();
+			}
+			});
+	}
+
 	run_main_event_loop();
 
 	SAFE_RELEASE(trade_engine);
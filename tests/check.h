@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+/** Fails the running test with the source location when cond does not hold. */
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+			return 1; \
+		} \
+	} while (0)
+
+/** Polls ready until it holds or timeout passes, returns whether it held. */
+template <class Pred>
+bool WaitFor(Pred ready, std::chrono::milliseconds timeout = std::chrono::seconds(10))
+{
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	while (!ready())
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
@@ -0,0 +1,387 @@
+#include <api/Globals.h>
+#include <event/event.h>
+#include "check.h"
+
+using namespace Keen;
+using namespace Keen::engine;
+
+static const char* EVENT_BURST = "eBurst.";
+static const char* EVENT_SEQ = "eSeq.";
+static const char* EVENT_HOLD = "eHold.";
+
+struct Quote
+{
+	AString symbol;
+	int seq = 0;
+	AString text;   // seq as a string, to tell a slot that was overwritten while a handler read it
+};
+
+/** Handler that keeps the main loop busy until released, so events pile up behind it. */
+class MainLoopHold
+{
+public:
+	void operator()(const Event&)
+	{
+		this->held = true;
+		while (this->hold)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	std::atomic<bool> hold = true;
+	std::atomic<bool> held = false;
+};
+
+/** A main loop handler puts far more events than its lane holds. With BLOCK that put used to wait for the
+dispatcher, which waited for the same handler to return. */
+static int TestSaturateLaneFromHandler(EventEmitter* emitter)
+{
+	static const int COUNT = 5000;
+	std::atomic<int> ticks = 0;
+
+	auto burst = [emitter](const Event&) {
+		for (int i = 0; i < COUNT; ++i)
+		{
+			emitter->put(Event(EVENT_TICK));
+		}
+	};
+	auto tick = [&ticks](const Event&) { ++ticks; };
+
+	emitter->set_queue(64, OverflowPolicy::BLOCK);
+	emitter->Register(EVENT_BURST, burst);
+	emitter->Register(EVENT_TICK, tick);
+	EventEmitterStats before = emitter->get_stats();
+	emitter->start(std::chrono::milliseconds(0));
+
+	emitter->put(Event(EVENT_BURST));
+	bool done = WaitFor([&]() { return ticks == COUNT; });
+
+	EventEmitterStats after = emitter->get_stats();
+	emitter->stop();
+	emitter->unRegister(EVENT_BURST, burst);
+	emitter->unRegister(EVENT_TICK, tick);
+
+	CHECK(done);
+	CHECK(after.overflowed > before.overflowed);
+	CHECK(after.dropped == before.dropped);
+	return 0;
+}
+
+/** With DROP_OLDEST ticks give way while the main loop is stuck, orders still all arrive. */
+static int TestExecutionsNeverDropped(EventEmitter* emitter)
+{
+	static const int COUNT = 20000;
+	std::atomic<int> orders = 0;
+	std::atomic<bool> hold = true;
+
+	auto order = [&](const Event&) {
+		while (hold)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		++orders;
+	};
+
+	emitter->set_queue(64, OverflowPolicy::DROP_OLDEST);
+	emitter->Register(EVENT_ORDER, order);
+	EventEmitterStats before = emitter->get_stats();
+	emitter->start(std::chrono::milliseconds(0));
+
+	std::thread producer([emitter]() {
+		for (int i = 0; i < COUNT; ++i)
+		{
+			emitter->put(Event(EVENT_ORDER));
+			emitter->put(Event(EVENT_TICK));
+		}
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	hold = false;
+	producer.join();
+	bool done = WaitFor([&]() { return orders == COUNT; });
+
+	EventEmitterStats after = emitter->get_stats();
+	emitter->stop();
+	emitter->unRegister(EVENT_ORDER, order);
+
+	CHECK(done);
+	CHECK(after.dropped > before.dropped);   // ticks
+	return 0;
+}
+
+/** Many times more events than the lane holds go through it in order while the producer waits for room. */
+static int TestQueueWraparound(EventEmitter* emitter)
+{
+	static const int COUNT = 10000;
+	std::atomic<int> next = 0;
+	std::atomic<bool> in_order = true;
+
+	auto seq = [&](const Event& event) {
+		if (event.get<int>() != next)
+		{
+			in_order = false;
+		}
+		++next;
+	};
+
+	emitter->set_queue(8, OverflowPolicy::BLOCK);
+	emitter->Register(EVENT_SEQ, seq);
+	EventEmitterStats before = emitter->get_stats();
+	emitter->start(std::chrono::milliseconds(0));
+
+	std::thread producer([emitter]() {
+		for (int i = 0; i < COUNT; ++i)
+		{
+			emitter->put(Event(EVENT_SEQ, i));
+		}
+	});
+	producer.join();
+	bool done = WaitFor([&]() { return next == COUNT; });
+
+	EventEmitterStats after = emitter->get_stats();
+	emitter->stop();
+	emitter->unRegister(EVENT_SEQ, seq);
+
+	CHECK(done);
+	CHECK(in_order);
+	CHECK(after.queue_capacity == 8 * 3);   // per lane
+	CHECK(after.dropped == before.dropped);
+	return 0;
+}
+
+/** Puts 20 events into a lane of 8 before the dispatcher runs and returns the ones that get handled. */
+static std::vector<int> PutIntoFullLane(EventEmitter* emitter, OverflowPolicy policy, int& rejected)
+{
+	static const int COUNT = 20;
+	std::vector<int> handled;
+	std::atomic<size_t> count = 0;
+
+	auto seq = [&](const Event& event) {
+		handled.push_back(event.get<int>());
+		++count;
+	};
+
+	emitter->set_queue(8, policy);
+	emitter->Register(EVENT_SEQ, seq);
+
+	rejected = 0;
+	for (int i = 0; i < COUNT; ++i)
+	{
+		if (!emitter->put(Event(EVENT_SEQ, i)))
+		{
+			++rejected;
+		}
+	}
+
+	emitter->start(std::chrono::milliseconds(0));
+	WaitFor([&]() { return count == 8; });
+	// Nothing beyond the lane may show up late
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	emitter->stop();
+	emitter->unRegister(EVENT_SEQ, seq);
+	return handled;
+}
+
+/** DROP_OLDEST keeps the newest events of a full lane, FAIL keeps the oldest and rejects the rest. */
+static int TestOverflowPolicies(EventEmitter* emitter)
+{
+	int rejected = 0;
+	EventEmitterStats before = emitter->get_stats();
+	std::vector<int> newest = PutIntoFullLane(emitter, OverflowPolicy::DROP_OLDEST, rejected);
+	EventEmitterStats after = emitter->get_stats();
+
+	CHECK(rejected == 0);
+	CHECK((newest == std::vector<int>{ 12, 13, 14, 15, 16, 17, 18, 19 }));
+	CHECK(after.dropped - before.dropped == 12);
+
+	before = after;
+	std::vector<int> oldest = PutIntoFullLane(emitter, OverflowPolicy::FAIL, rejected);
+	after = emitter->get_stats();
+
+	CHECK(rejected == 12);
+	CHECK((oldest == std::vector<int>{ 0, 1, 2, 3, 4, 5, 6, 7 }));
+	CHECK(after.dropped - before.dropped == 12);
+	return 0;
+}
+
+/** A channel slot handed to a shard and to the main loop returns to the channel only once both are done
+with it; while every slot is in flight publish() falls back to a std::any event. */
+static int TestChannelSlotsAcrossShards(EventEmitter* emitter)
+{
+	static const int COUNT = 2000;
+	std::atomic<int> sharded = 0;
+	std::atomic<int> serial = 0;
+	std::atomic<bool> intact = true;
+	std::vector<bool> in_slot;   // main loop only
+
+	auto check = [&intact](const Event& event) {
+		const Quote& quote = event.get<Quote>();
+		if (quote.text != std::to_string(quote.seq))
+		{
+			intact = false;
+		}
+	};
+	auto on_shard = [&](const Event& event) {
+		check(event);
+		++sharded;
+	};
+	auto on_main = [&](const Event& event) {
+		check(event);
+		if (event.get<Quote>().seq >= COUNT)
+		{
+			in_slot.push_back(event.channel != nullptr);
+		}
+		++serial;
+	};
+	MainLoopHold hold;
+	auto on_hold = [&hold](const Event& event) { hold(event); };
+
+	Channel<Quote> channel(4);
+	emitter->set_queue(1024, OverflowPolicy::BLOCK);
+	emitter->set_shards(2);
+	emitter->register_sharded(EVENT_SEQ, on_shard);
+	emitter->Register(EVENT_SEQ, on_main);
+	emitter->Register(EVENT_HOLD, on_hold);
+	emitter->start(std::chrono::milliseconds(0));
+
+	auto publish = [&](int seq) {
+		Quote quote{ .symbol = "S" + std::to_string(seq % 8), .seq = seq, .text = std::to_string(seq) };
+		channel.publish(emitter, EVENT_SEQ, quote, 0, emitter->route_of(quote.symbol));
+	};
+
+	std::thread producer([&]() {
+		for (int i = 0; i < COUNT; ++i)
+		{
+			publish(i);
+		}
+	});
+	producer.join();
+	bool done = WaitFor([&]() { return (sharded == COUNT) && (serial == COUNT); });
+
+	// Every slot is back: the first four events take one, the fifth finds none left while the main loop holds them
+	emitter->put(Event(EVENT_HOLD));
+	bool held = WaitFor([&]() { return hold.held.load(); });
+	for (int i = 0; i < 5; ++i)
+	{
+		publish(COUNT + i);
+	}
+	hold.hold = false;
+	bool drained = WaitFor([&]() { return (sharded == COUNT + 5) && (serial == COUNT + 5); });
+
+	emitter->stop();
+	emitter->unregister_sharded(EVENT_SEQ, on_shard);
+	emitter->unRegister(EVENT_SEQ, on_main);
+	emitter->unRegister(EVENT_HOLD, on_hold);
+	emitter->set_shards(0);
+
+	CHECK(done);
+	CHECK(held);
+	CHECK(drained);
+	CHECK(intact);
+	CHECK((in_slot == std::vector<bool>{ true, true, true, true, false }));
+	return 0;
+}
+
+/** A tick still queued is replaced in place by a newer tick of its symbol; orders and trades carrying the same
+route are all delivered. */
+static int TestTickConflation(EventEmitter* emitter)
+{
+	std::vector<AString> ticks;
+	std::vector<int> orders;
+	std::vector<int> trades;
+	std::atomic<size_t> count = 0;
+
+	auto on_tick = [&](const Event& event) {
+		const Quote& quote = event.get<Quote>();
+		ticks.push_back(quote.symbol + std::to_string(quote.seq));
+		++count;
+	};
+	auto on_order = [&](const Event& event) {
+		orders.push_back(event.get<int>());
+		++count;
+	};
+	auto on_trade = [&](const Event& event) {
+		trades.push_back(event.get<int>());
+		++count;
+	};
+
+	emitter->set_queue(1024, OverflowPolicy::BLOCK);
+	emitter->set_tick_conflation(true);
+	emitter->Register(EVENT_TICK, on_tick);
+	emitter->Register(EVENT_ORDER, on_order);
+	emitter->Register(EVENT_TRADE, on_trade);
+
+	UInt32 route_a = emitter->route_of("A");
+	UInt32 route_b = emitter->route_of("B");
+	auto put = [emitter](const char* type, std::any data, UInt32 route) {
+		Event event(type, data);
+		event.route = route;
+		emitter->put(event);
+	};
+
+	// Queued before the dispatcher starts, so every tick of A is still waiting when the next one comes
+	EventEmitterStats before = emitter->get_stats();
+	put(EVENT_TICK, Quote{ .symbol = "A", .seq = 1 }, route_a);
+	put(EVENT_ORDER, 1, route_a);
+	put(EVENT_TICK, Quote{ .symbol = "A", .seq = 2 }, route_a);
+	put(EVENT_TICK, Quote{ .symbol = "B", .seq = 1 }, route_b);
+	put(EVENT_TRADE, 1, route_a);
+	put(EVENT_TRADE, 2, route_a);
+	put(EVENT_TICK, Quote{ .symbol = "A", .seq = 3 }, route_a);
+	put(EVENT_ORDER, 2, route_a);
+	emitter->start(std::chrono::milliseconds(0));
+
+	bool done = WaitFor([&]() { return count == 6; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	EventEmitterStats after = emitter->get_stats();
+	emitter->stop();
+	emitter->unRegister(EVENT_TICK, on_tick);
+	emitter->unRegister(EVENT_ORDER, on_order);
+	emitter->unRegister(EVENT_TRADE, on_trade);
+	emitter->set_tick_conflation(false);
+
+	CHECK(done);
+	CHECK(count == 6);
+	CHECK((ticks == std::vector<AString>{ "A3", "B1" }));
+	CHECK((orders == std::vector<int>{ 1, 2 }));
+	CHECK((trades == std::vector<int>{ 1, 2 }));
+	CHECK(after.conflated - before.conflated == 2);
+	return 0;
+}
+
+int main()
+{
+	// Keeps the main loop running between the tests, when no emitter timer is armed
+	api::TimerHandle keep_alive = api::RepeatToQueue(std::chrono::seconds(1), []() {});
+	std::thread loop([]() { api::run_main_event_loop(); });
+
+	EventEmitter* emitter = MakeEventEmitter();
+	int result = TestSaturateLaneFromHandler(emitter);
+	if (result == 0)
+	{
+		result = TestExecutionsNeverDropped(emitter);
+	}
+	if (result == 0)
+	{
+		result = TestQueueWraparound(emitter);
+	}
+	if (result == 0)
+	{
+		result = TestOverflowPolicies(emitter);
+	}
+	if (result == 0)
+	{
+		result = TestChannelSlotsAcrossShards(emitter);
+	}
+	if (result == 0)
+	{
+		result = TestTickConflation(emitter);
+	}
+
+	keep_alive.cancel();
+	api::exit_main_event_loop();
+	loop.join();
+
+	std::printf("event_test: %s\n", (result == 0) ? "passed" : "FAILED");
+	return result;
+}
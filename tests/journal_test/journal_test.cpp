@@ -0,0 +1,337 @@
+#include <api/Globals.h>
+#include <event/event.h>
+#include <engine/journal.h>
+#include "check.h"
+
+#include <filesystem>
+
+using namespace Keen;
+using namespace Keen::engine;
+
+static const char* EVENT_CUSTOM = "eCustom.";
+
+/** Every field gets a distinct value, so a field written or read in the wrong place shows up. */
+static TickData MakeTick()
+{
+	TickData tick;
+	tick.symbol = "BTC-USDT-SWAP";
+	tick.exchange = Exchange::OKX;
+	tick.name = "BTC-USDT perpetual";
+	tick.datetime = DateTime(std::chrono::milliseconds(1700000000123));
+	tick.exchange_name = "OKX";
+	float* fields[] = {
+		&tick.volume, &tick.turnover, &tick.open_interest, &tick.last_price, &tick.last_volume,
+		&tick.limit_up, &tick.limit_down, &tick.open_price, &tick.high_price, &tick.low_price, &tick.pre_close,
+		&tick.bid_price_1, &tick.bid_price_2, &tick.bid_price_3, &tick.bid_price_4, &tick.bid_price_5,
+		&tick.ask_price_1, &tick.ask_price_2, &tick.ask_price_3, &tick.ask_price_4, &tick.ask_price_5,
+		&tick.bid_volume_1, &tick.bid_volume_2, &tick.bid_volume_3, &tick.bid_volume_4, &tick.bid_volume_5,
+		&tick.ask_volume_1, &tick.ask_volume_2, &tick.ask_volume_3, &tick.ask_volume_4, &tick.ask_volume_5
+	};
+	float value = 100.25f;
+	for (float* field : fields)
+	{
+		*field = value;
+		value += 1.5f;
+	}
+	tick.__post_init__();
+	return tick;
+}
+
+static OrderData MakeOrder()
+{
+	OrderData order;
+	order.symbol = "ETH-USDT-SWAP";
+	order.exchange = Exchange::OKX;
+	order.orderid = "6120934885";
+	order.type = OrderType::FAK;
+	order.direction = Direction::SHORT;
+	order.offset = Offset::CLOSE;
+	order.price = 2345.5f;
+	order.volume = 3;
+	order.traded = 1;
+	order.status = Status::PARTTRADED;
+	order.datetime = DateTime(std::chrono::milliseconds(1700000000456));
+	order.reference = "ma_cross";
+	order.exchange_name = "OKX";
+	order.__post_init__();
+	return order;
+}
+
+static TradeData MakeTrade()
+{
+	TradeData trade;
+	trade.symbol = "ETH-USDT-SWAP";
+	trade.exchange = Exchange::BINANCE;
+	trade.orderid = "6120934885";
+	trade.tradeid = "88123";
+	trade.direction = Direction::LONG;
+	trade.offset = Offset::OPEN;
+	trade.price = 2344.75f;
+	trade.volume = 2;
+	trade.datetime = DateTime(std::chrono::milliseconds(1700000000789));
+	trade.exchange_name = "BINANCE_LINEAR";
+	trade.__post_init__();
+	return trade;
+}
+
+static PositionData MakePosition()
+{
+	PositionData position;
+	position.symbol = "SOL-USDT-SWAP";
+	position.exchange = Exchange::OKX;
+	position.direction = Direction::NET;
+	position.volume = -4;
+	position.frozen = 1;
+	position.price = 61.5f;
+	position.pnl = -12.25f;
+	position.yd_volume = 2;
+	position.exchange_name = "OKX";
+	position.__post_init__();
+	return position;
+}
+
+static AccountData MakeAccount()
+{
+	AccountData account;
+	account.accountid = "USDT";
+	account.balance = 10000.5f;
+	account.frozen = 250.25f;
+	account.exchange_name = "OKX";
+	account.__post_init__();
+	return account;
+}
+
+static ContractData MakeContract()
+{
+	ContractData contract;
+	contract.symbol = "BTC-USD-240628-60000-C";
+	contract.exchange = Exchange::OKX;
+	contract.name = "BTC call";
+	contract.instIdCode = 4711;
+	contract.product = Product::OPTION;
+	contract.size = 0.01f;
+	contract.pricetick = 0.0005f;
+	contract.min_volume = 2;
+	contract.max_volume = 5000;
+	contract.stop_supported = true;
+	contract.history_data = true;
+	contract.net_position = true;
+	contract.option_strike = 60000;
+	contract.option_underlying = "BTC-USD-240628.OKX";
+	contract.option_type = OptionType::CALL;
+	contract.option_listed = 1700000000000ULL;
+	contract.option_expiry = 1719561600000ULL;
+	contract.option_portfolio = "BTC-USD";
+	contract.option_index = "BTC-USD-240628";
+	contract.exchange_name = "OKX";
+	contract.__post_init__();
+	return contract;
+}
+
+static int CheckTick(const TickData& a, const TickData& b)
+{
+	CHECK(a.symbol == b.symbol);
+	CHECK(a.exchange == b.exchange);
+	CHECK(a.name == b.name);
+	CHECK(a.datetime == b.datetime);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.volume == b.volume);
+	CHECK(a.turnover == b.turnover);
+	CHECK(a.open_interest == b.open_interest);
+	CHECK(a.last_price == b.last_price);
+	CHECK(a.last_volume == b.last_volume);
+	CHECK(a.limit_up == b.limit_up);
+	CHECK(a.limit_down == b.limit_down);
+	CHECK(a.open_price == b.open_price);
+	CHECK(a.high_price == b.high_price);
+	CHECK(a.low_price == b.low_price);
+	CHECK(a.pre_close == b.pre_close);
+	CHECK(a.bid_price_1 == b.bid_price_1);
+	CHECK(a.bid_price_5 == b.bid_price_5);
+	CHECK(a.ask_price_1 == b.ask_price_1);
+	CHECK(a.ask_price_5 == b.ask_price_5);
+	CHECK(a.bid_volume_1 == b.bid_volume_1);
+	CHECK(a.bid_volume_5 == b.bid_volume_5);
+	CHECK(a.ask_volume_1 == b.ask_volume_1);
+	CHECK(a.ask_volume_5 == b.ask_volume_5);
+	CHECK(a.kt_symbol == b.kt_symbol);
+	return 0;
+}
+
+static int CheckOrder(const OrderData& a, const OrderData& b)
+{
+	CHECK(a.symbol == b.symbol);
+	CHECK(a.exchange == b.exchange);
+	CHECK(a.orderid == b.orderid);
+	CHECK(a.type == b.type);
+	CHECK(a.direction == b.direction);
+	CHECK(a.offset == b.offset);
+	CHECK(a.price == b.price);
+	CHECK(a.volume == b.volume);
+	CHECK(a.traded == b.traded);
+	CHECK(a.status == b.status);
+	CHECK(a.datetime == b.datetime);
+	CHECK(a.reference == b.reference);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.kt_symbol == b.kt_symbol);
+	CHECK(a.kt_orderid == b.kt_orderid);
+	return 0;
+}
+
+static int CheckTrade(const TradeData& a, const TradeData& b)
+{
+	CHECK(a.symbol == b.symbol);
+	CHECK(a.exchange == b.exchange);
+	CHECK(a.orderid == b.orderid);
+	CHECK(a.tradeid == b.tradeid);
+	CHECK(a.direction == b.direction);
+	CHECK(a.offset == b.offset);
+	CHECK(a.price == b.price);
+	CHECK(a.volume == b.volume);
+	CHECK(a.datetime == b.datetime);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.kt_orderid == b.kt_orderid);
+	CHECK(a.kt_tradeid == b.kt_tradeid);
+	return 0;
+}
+
+static int CheckPosition(const PositionData& a, const PositionData& b)
+{
+	CHECK(a.symbol == b.symbol);
+	CHECK(a.exchange == b.exchange);
+	CHECK(a.direction == b.direction);
+	CHECK(a.volume == b.volume);
+	CHECK(a.frozen == b.frozen);
+	CHECK(a.price == b.price);
+	CHECK(a.pnl == b.pnl);
+	CHECK(a.yd_volume == b.yd_volume);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.kt_positionid == b.kt_positionid);
+	return 0;
+}
+
+static int CheckAccount(const AccountData& a, const AccountData& b)
+{
+	CHECK(a.accountid == b.accountid);
+	CHECK(a.balance == b.balance);
+	CHECK(a.frozen == b.frozen);
+	CHECK(a.available == b.available);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.kt_accountid == b.kt_accountid);
+	return 0;
+}
+
+static int CheckContract(const ContractData& a, const ContractData& b)
+{
+	CHECK(a.symbol == b.symbol);
+	CHECK(a.exchange == b.exchange);
+	CHECK(a.name == b.name);
+	CHECK(a.instIdCode == b.instIdCode);
+	CHECK(a.product == b.product);
+	CHECK(a.size == b.size);
+	CHECK(a.pricetick == b.pricetick);
+	CHECK(a.min_volume == b.min_volume);
+	CHECK(a.max_volume == b.max_volume);
+	CHECK(a.stop_supported == b.stop_supported);
+	CHECK(a.history_data == b.history_data);
+	CHECK(a.net_position == b.net_position);
+	CHECK(a.option_strike == b.option_strike);
+	CHECK(a.option_underlying == b.option_underlying);
+	CHECK(a.option_type == b.option_type);
+	CHECK(a.option_listed == b.option_listed);
+	CHECK(a.option_expiry == b.option_expiry);
+	CHECK(a.option_portfolio == b.option_portfolio);
+	CHECK(a.option_index == b.option_index);
+	CHECK(a.exchange_name == b.exchange_name);
+	CHECK(a.kt_symbol == b.kt_symbol);
+	return 0;
+}
+
+/** Journals one event of every payload type, then reads the segment back and compares field by field. */
+static int TestRoundTrip(EventEmitter* emitter, const AString& folder)
+{
+	TickData tick = MakeTick();
+	OrderData order = MakeOrder();
+	TradeData trade = MakeTrade();
+	PositionData position = MakePosition();
+	AccountData account = MakeAccount();
+	ContractData contract = MakeContract();
+
+	JournalEngine journal(nullptr, emitter, folder);
+	journal.process_event(Event(EVENT_TICK, tick));
+	journal.process_event(Event(EVENT_ORDER, order));
+	journal.process_event(Event(EVENT_TRADE, trade));
+	journal.process_event(Event(EVENT_POSITION, position));
+	journal.process_event(Event(EVENT_ACCOUNT, account));
+	journal.process_event(Event(EVENT_CONTRACT, contract));
+	journal.process_event(Event(EVENT_CUSTOM));
+	journal.close();
+
+	JournalStats stats = journal.get_stats();
+	CHECK(stats.recorded == 7);
+	CHECK(stats.written == 7);
+	CHECK(stats.dropped == 0);
+
+	JournalReader reader;
+	CHECK(reader.open(folder));
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_TICK);
+	CHECK(reader.record().payload == JournalPayload::TICK);
+	CHECK(CheckTick(reader.tick, tick) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_ORDER);
+	CHECK(reader.record().payload == JournalPayload::ORDER);
+	CHECK(CheckOrder(reader.order, order) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_TRADE);
+	CHECK(reader.record().payload == JournalPayload::TRADE);
+	CHECK(CheckTrade(reader.trade, trade) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_POSITION);
+	CHECK(reader.record().payload == JournalPayload::POSITION);
+	CHECK(CheckPosition(reader.position, position) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_ACCOUNT);
+	CHECK(reader.record().payload == JournalPayload::ACCOUNT);
+	CHECK(CheckAccount(reader.account, account) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_CONTRACT);
+	CHECK(reader.record().payload == JournalPayload::CONTRACT);
+	CHECK(CheckContract(reader.contract, contract) == 0);
+
+	CHECK(reader.next());
+	CHECK(reader.record().type == EVENT_CUSTOM);
+	CHECK(reader.record().payload == JournalPayload::NONE);
+
+	CHECK(!reader.next());
+
+	// Timestamps come from one clock and only move forward
+	reader.rewind();
+	Int64 previous = 0;
+	while (reader.next())
+	{
+		CHECK(reader.record().timestamp >= previous);
+		previous = reader.record().timestamp;
+	}
+	return 0;
+}
+
+int main()
+{
+	std::filesystem::path folder = std::filesystem::temp_directory_path() /
+		("kt_journal_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::filesystem::create_directories(folder);
+
+	int result = TestRoundTrip(MakeEventEmitter(), folder.string());
+
+	std::filesystem::remove_all(folder);
+
+	std::printf("journal_test: %s\n", (result == 0) ? "passed" : "FAILED");
+	return result;
+}
@@ -0,0 +1,140 @@
+#include <api/Globals.h>
+#include <api/TimerWheel.h>
+#include "check.h"
+
+using namespace Keen;
+using namespace Keen::api;
+
+/** Drives the wheel by hand: advance() takes times relative to the wheel's own epoch. */
+class TestWheel : public TimerWheel
+{
+public:
+	/** Schedules the callback and returns the tick it is due at. schedule() reads the clock itself, so this tries
+	again until the clock stayed on one tick around the call. */
+	UInt64 schedule_at(std::chrono::milliseconds delay, std::chrono::milliseconds period, const Callback& callback, UInt64& id)
+	{
+		while (true)
+		{
+			UInt64 before = this->_ticks(Clock::now());
+			id = this->schedule(delay, period, callback);
+			if (this->_ticks(Clock::now()) == before)
+			{
+				return before + static_cast<UInt64>(delay.count());
+			}
+			this->cancel(id);
+		}
+	}
+
+	void advance_to(UInt64 tick)
+	{
+		this->advance(this->_epoch + std::chrono::milliseconds(tick));
+	}
+
+	UInt64 current() const { return this->_current; }
+};
+
+/** A callback cancels a one-shot and a periodic timer due in the same tick after it; neither may run. */
+static int TestCancelInSameTick()
+{
+	TestWheel wheel;
+	int first = 0;
+	int later_one_shot = 0;
+	int later_periodic = 0;
+	UInt64 first_id = 0;
+	UInt64 one_shot_id = 0;
+	UInt64 periodic_id = 0;
+	bool cancelled_one_shot = false;
+	bool cancelled_periodic = false;
+	bool cancelled_self = true;
+
+	// An idle wheel jumps ahead to the driver's time, and nothing is scheduled before the tick after it: all three
+	// are due at tick 1001 while the test is still in its first second
+	wheel.advance_to(1000);
+	first_id = wheel.schedule(std::chrono::milliseconds(0), std::chrono::milliseconds(0), [&]() {
+		++first;
+		cancelled_one_shot = wheel.cancel(one_shot_id);
+		cancelled_periodic = wheel.cancel(periodic_id);
+		cancelled_self = wheel.cancel(first_id);
+	});
+	one_shot_id = wheel.schedule(std::chrono::milliseconds(0), std::chrono::milliseconds(0), [&]() { ++later_one_shot; });
+	periodic_id = wheel.schedule(std::chrono::milliseconds(0), std::chrono::milliseconds(5), [&]() { ++later_periodic; });
+	UInt64 due = 1001;
+	wheel.advance_to(due + 20);
+	CHECK(first == 1);
+	CHECK(cancelled_one_shot);
+	CHECK(cancelled_periodic);
+	CHECK(!cancelled_self);    // a one-shot that is running has fired
+	CHECK(later_one_shot == 0);
+	CHECK(later_periodic == 0);
+	CHECK(wheel.size() == 0);
+	return 0;
+}
+
+/** Timers on every upper level come down level by level and fire on their own tick, not a slot early or late. */
+static int TestLevelCascading()
+{
+	TestWheel wheel;
+	// level 1 from 256 ms, level 2 from 65536 ms, level 3 from 16777216 ms
+	const std::chrono::milliseconds delays[] = {
+		std::chrono::milliseconds(3), std::chrono::milliseconds(300), std::chrono::milliseconds(70000),
+		std::chrono::milliseconds(16777216 + 4321)
+	};
+	const size_t COUNT = sizeof(delays) / sizeof(delays[0]);
+	UInt64 fired_at[COUNT] = {};
+	UInt64 due[COUNT] = {};
+
+	for (size_t i = 0; i < COUNT; ++i)
+	{
+		UInt64 id;
+		due[i] = wheel.schedule_at(delays[i], std::chrono::milliseconds(0), [&wheel, &fired_at, i]() {
+			fired_at[i] = wheel.current();
+		}, id);
+	}
+
+	for (size_t i = 0; i < COUNT; ++i)
+	{
+		wheel.advance_to(due[i] - 1);
+		CHECK(fired_at[i] == 0);
+
+		wheel.advance_to(due[i]);
+		CHECK(fired_at[i] == due[i]);
+		CHECK(wheel.size() == COUNT - i - 1);
+	}
+	return 0;
+}
+
+/** A periodic timer keeps its phase and skips the beats the driver missed. */
+static int TestPeriodicSkipsMissedBeats()
+{
+	TestWheel wheel;
+	int beats = 0;
+	UInt64 id;
+	UInt64 due = wheel.schedule_at(std::chrono::milliseconds(10), std::chrono::milliseconds(10), [&]() { ++beats; }, id);
+
+	wheel.advance_to(due + 35);     // three beats late, runs once
+	CHECK(beats == 1);
+	wheel.advance_to(due + 44);
+	CHECK(beats == 1);
+	wheel.advance_to(due + 45);
+	CHECK(beats == 2);
+	CHECK(wheel.cancel(id));
+	wheel.advance_to(due + 100);
+	CHECK(beats == 2);
+	return 0;
+}
+
+int main()
+{
+	int result = TestCancelInSameTick();
+	if (result == 0)
+	{
+		result = TestLevelCascading();
+	}
+	if (result == 0)
+	{
+		result = TestPeriodicSkipsMissedBeats();
+	}
+
+	std::printf("timer_test: %s\n", (result == 0) ? "passed" : "FAILED");
+	return result;
+}